@@ -0,0 +1,1280 @@
+//benchmark.c
+// Compilar: make benchmark (ou gcc -O2 -pthread benchmark.c calculadora.c -o benchmark -lm)
+// Uso: benchmark escala [linhas] [maxThreads]
+//      benchmark conversao [repeticoes]
+//      benchmark jit [linhas]
+//      benchmark precisao [linhas]
+//      benchmark rapido [linhas]
+//      benchmark tokens [repeticoes]
+//      benchmark alocacoes [repeticoes]
+//      benchmark incremental [atualizacoes]
+//      benchmark curtas [repeticoes]
+//      benchmark diferencial [casos]
+//      benchmark pacote [formulas]
+//      benchmark multi [linhas] [formulas]
+//      benchmark gerar [opcoes do gerador] [--posfixa] [--sem-variaveis]
+//      benchmark suite [opcoes do gerador] [--repeticoes R] [--cache N] > resultado.json
+// Opções do gerador: --expressoes N --profundidade D --variaveis V --operadores "+-*/%^rsctl" --semente S
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <stdatomic.h> // Para o contador de alocações, incrementado também pelas threads da biblioteca
+#include "calculadora.h"
+
+// Na glibc, malloc, calloc e realloc são substituídos aqui para contar as chamadas de todo o processo.
+// O contador é atômico (incremento relaxado) porque em escala as threads de avaliarLoteParalelo também alocam.
+static _Atomic long alocacoes = 0;
+#ifdef __GLIBC__
+#define CONTA_ALOCACOES 1
+extern void *__libc_malloc(size_t tamanho);
+extern void *__libc_calloc(size_t n, size_t tamanho);
+extern void *__libc_realloc(void *p, size_t tamanho);
+static inline void contarAlocacao(void) { atomic_fetch_add_explicit(&alocacoes, 1, memory_order_relaxed); }
+void *malloc(size_t tamanho) { contarAlocacao(); return __libc_malloc(tamanho); }
+void *calloc(size_t n, size_t tamanho) { contarAlocacao(); return __libc_calloc(n, tamanho); }
+void *realloc(void *p, size_t tamanho) { contarAlocacao(); return __libc_realloc(p, tamanho); }
+#else
+#define CONTA_ALOCACOES 0
+#endif
+
+// Tempo atual em segundos
+static double agora() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Tempo atual em nanossegundos, inteiro: em segundos num double, a época atual só tem resolução de ~240 ns
+static long long agoraNs() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Encerra o benchmark se a avaliação em lote falhou (retorno -1, com o código em erro); senão, retorna erros
+static long exigirLote(long erros, const ErroCalc *erro) {
+    if (erros < 0) {
+        fprintf(stderr, "Erro na avaliacao em lote: %s\n", mensagemErro(erro->codigo));
+        exit(EXIT_FAILURE);
+    }
+    return erros;
+}
+
+// Mede avaliarLoteParalelo com 1..maxThreads threads sobre as mesmas colunas
+static void benchmarkEscala(long linhas, int maxThreads) {
+    char expressao[] = "raiz(x*x + y*y) / (1 + z) - sen(x) * cos(y) + x ^ 2 % 7";
+    Programa prog;
+    if (compilarInFixa(expressao, &prog, NULL) != CALC_OK) exit(EXIT_FAILURE);
+
+    float *colunas[3];
+    for (int v = 0; v < prog.numVariaveis; v++) {
+        colunas[v] = (float*)malloc(linhas * sizeof(float));
+        for (long i = 0; i < linhas; i++) colunas[v][i] = (float)((i * (v + 7)) % 1000) / 10.0f;
+    }
+    float *saida = (float*)malloc(linhas * sizeof(float));
+    unsigned char *status = (unsigned char*)malloc(linhas);
+
+    printf("Expressao: %s\n", expressao);
+    printf("Linhas: %ld\n", linhas);
+    printf("%8s %12s %14s %10s\n", "threads", "segundos", "linhas/s", "speedup");
+
+    double base = 0;
+    ErroCalc erro;
+    for (int t = 1; t <= maxThreads; t++) {
+        exigirLote(avaliarLoteParalelo(&prog, (const float *const *)colunas, linhas, saida, status, t, &erro), &erro); // Aquecimento
+        double inicio = agora();
+        long erros = exigirLote(avaliarLoteParalelo(&prog, (const float *const *)colunas, linhas, saida, status, t, &erro), &erro);
+        double tempo = agora() - inicio;
+        if (t == 1) base = tempo;
+        printf("%8d %12.4f %14.0f %10.2f  (%ld linhas com erro)\n", t, tempo, linhas / tempo, base / tempo, erros);
+    }
+
+    for (int v = 0; v < prog.numVariaveis; v++) free(colunas[v]);
+    free(saida); free(status);
+    liberarPrograma(&prog);
+}
+
+// Mede chamadas por segundo das conversões e da avaliação infixa em expressões curtas
+static void benchmarkConversao(long repeticoes) {
+    const char *infixas[] = {
+        "3 * (12 + 4)",
+        "raiz(16) + sen(30) * cos(60) - log(100) / 2",
+        "((1 + 2) * (3 - 4) / 5) ^ 2 % 7 + tg(45) * (8 - (9 + 10) * 11)",
+    };
+    int numInfixas = sizeof(infixas) / sizeof(infixas[0]);
+    char posFixas[3][512], saida[512];
+    for (int k = 0; k < numInfixas; k++) getFormaPosFixa_r(infixas[k], posFixas[k], sizeof(posFixas[k]), NULL);
+
+    printf("%-20s %14s\n", "funcao", "chamadas/s");
+
+    double inicio = agora();
+    for (long r = 0; r < repeticoes; r++) getFormaPosFixa_r(infixas[r % numInfixas], saida, sizeof(saida), NULL);
+    printf("%-20s %14.0f\n", "getFormaPosFixa_r", repeticoes / (agora() - inicio));
+
+    inicio = agora();
+    for (long r = 0; r < repeticoes; r++) getFormaInFixa_r(posFixas[r % numInfixas], saida, sizeof(saida), NULL);
+    printf("%-20s %14.0f\n", "getFormaInFixa_r", repeticoes / (agora() - inicio));
+
+    volatile float soma = 0;
+    inicio = agora();
+    for (long r = 0; r < repeticoes; r++) soma += getValorInFixa((char*)infixas[r % numInfixas]);
+    printf("%-20s %14.0f\n", "getValorInFixa", repeticoes / (agora() - inicio));
+}
+
+// Regressão: tg aninhada gera a instrução mais longa do JIT e já estourou as páginas de código. Compara
+// código de erro e valor do JIT com executarPrograma para cadeias de várias profundidades, nos dois modos.
+static long conferirJitAninhado(void) {
+    const int profundidades[] = { 1, 50, 100, 300, 1000 };
+    const float valores[] = { 0.5f, 10, 44.9f, -123.25f };
+    long divergencias = 0;
+    for (int p = 0; p < (int)(sizeof(profundidades) / sizeof(profundidades[0])); p++) {
+        char *texto = (char*)malloc(4 * profundidades[p] + 2), *t = texto;
+        if (texto == NULL) exit(EXIT_FAILURE);
+        for (int i = 0; i < profundidades[p]; i++, t += 3) memcpy(t, "tg(", 3);
+        *t++ = 'x';
+        for (int i = 0; i < profundidades[p]; i++) *t++ = ')';
+        *t = '\0';
+        for (int matematica = MATEMATICA_EXATA; matematica <= MATEMATICA_RAPIDA; matematica++) {
+            Programa prog;
+            ProgramaJit jit;
+            if (compilarInFixa(texto, &prog, NULL) != CALC_OK) exit(EXIT_FAILURE);
+            prog.matematica = (ModoMatematica)matematica;
+            ErroCalc erro;
+            if (compilarJit(&prog, &jit, &erro) != CALC_OK) {
+                printf("JIT: %s\n", mensagemErro(erro.codigo));
+                exit(EXIT_FAILURE);
+            }
+            for (int v = 0; v < (int)(sizeof(valores) / sizeof(valores[0])); v++) {
+                float esperado = 0, obtido = 0;
+                ErroCalc erroEsperado = { CALC_OK, -2 }, erroObtido = { CALC_OK, -2 };
+                int codEsperado = executarPrograma(&prog, &valores[v], &esperado, &erroEsperado);
+                int codObtido = executarJit(&jit, &valores[v], &obtido, &erroObtido);
+                if (codEsperado != codObtido || erroEsperado.posicao != erroObtido.posicao ||
+                    (codEsperado == CALC_OK && memcmp(&esperado, &obtido, sizeof(float)) != 0)) divergencias++;
+            }
+            liberarJit(&jit);
+            liberarPrograma(&prog);
+        }
+        free(texto);
+    }
+    printf("tg aninhada (ate 1000 niveis): %ld divergencias\n\n", divergencias);
+    return divergencias;
+}
+
+// Regressão: o erro do JIT leva o índice da instrução em 23 bits, e um programa maior lia jit->posicoes fora do
+// vetor. Uma soma de 2^23 parcelas (a constante 1 é compartilhada, então são 2^23 instruções) deve ir para o interpretador.
+static long conferirJitLongo(void) {
+    const long parcelas = 1L << 23;
+    char *texto = (char*)malloc(2 * parcelas + 4), *t = texto;
+    if (texto == NULL) exit(EXIT_FAILURE);
+    for (long i = 0; i < parcelas; i++, t += 2) memcpy(t, "1+", 2);
+    strcpy(t, "1/0");
+    Programa prog;
+    ProgramaJit jit;
+    ErroCalc erro = { CALC_OK, -1 };
+    if (compilarInFixa(texto, &prog, NULL) != CALC_OK) exit(EXIT_FAILURE);
+    int cod = compilarJit(&prog, &jit, &erro);
+    if (cod == CALC_OK) liberarJit(&jit);
+    liberarPrograma(&prog);
+    free(texto);
+    printf("soma de 2^23 parcelas: %s\n\n", cod == CALC_ERRO_JIT_INDISPONIVEL ? "recusada pelo JIT" : "DIVERGENCIA (aceita pelo JIT)");
+    return cod != CALC_ERRO_JIT_INDISPONIVEL;
+}
+
+// Compara, linha a linha, o interpretador de pilha, o de registradores e o JIT (e o lote vetorizado como referência).
+// Retorna 1 se o JIT divergiu de executarPrograma.
+static int benchmarkJit(long linhas) {
+    long divergencias = conferirJitAninhado() + conferirJitLongo();
+    const char *expressoes[] = {
+        "x * y + z - x / (y + 1)",
+        "(x + y) * (x + y) / raiz(x * x + y * y + 1) - (x + y)",
+        "raiz(x*x + y*y) / (1 + z) - sen(x) * cos(y) + x ^ 2 % 7",
+    };
+    float *colunas[3];
+    for (int v = 0; v < 3; v++) {
+        colunas[v] = (float*)malloc(linhas * sizeof(float));
+        for (long i = 0; i < linhas; i++) colunas[v][i] = (float)((i * (v + 7)) % 1000) / 10.0f + 1;
+    }
+    float *esperado = (float*)malloc(linhas * sizeof(float));
+    float *saida = (float*)malloc(linhas * sizeof(float));
+
+    for (int e = 0; e < (int)(sizeof(expressoes) / sizeof(expressoes[0])); e++) {
+        Programa prog;
+        ProgramaReg reg;
+        ProgramaJit jit;
+        if (compilarInFixa(expressoes[e], &prog, NULL) != CALC_OK || compilarRegistros(&prog, &reg, NULL) != CALC_OK) exit(EXIT_FAILURE);
+        ErroCalc erro;
+        if (compilarJit(&prog, &jit, &erro) != CALC_OK) {
+            printf("JIT: %s\n", mensagemErro(erro.codigo));
+            exit(EXIT_FAILURE);
+        }
+        float valores[3];
+        int slots[3];
+        for (int v = 0; v < prog.numVariaveis; v++) slots[v] = prog.variaveis[v][0] - 'x';
+
+        printf("Expressao: %s\n", expressoes[e]);
+        printf("%-22s %14s %10s\n", "avaliador", "linhas/s", "diferencas");
+        for (int modo = 0; modo < 4; modo++) {
+            double inicio = agora();
+            if (modo == 3) {
+                const float *ordenadas[3];
+                for (int v = 0; v < prog.numVariaveis; v++) ordenadas[v] = colunas[slots[v]];
+                exigirLote(avaliarLote(&prog, ordenadas, linhas, saida, NULL, &erro), &erro);
+            } else {
+                for (long i = 0; i < linhas; i++) {
+                    for (int v = 0; v < prog.numVariaveis; v++) valores[v] = colunas[slots[v]][i];
+                    if (modo == 0) executarPrograma(&prog, valores, &esperado[i], NULL);
+                    else if (modo == 1) executarRegistros(&reg, valores, &saida[i], NULL);
+                    else executarJit(&jit, valores, &saida[i], NULL);
+                }
+            }
+            double tempo = agora() - inicio;
+            long diferencas = 0;
+            for (long i = 0; modo > 0 && i < linhas; i++) diferencas += memcmp(&esperado[i], &saida[i], sizeof(float)) != 0;
+            const char *nomes[] = { "executarPrograma", "executarRegistros", "executarJit", "avaliarLote" };
+            printf("%-22s %14.0f %10ld\n", nomes[modo], linhas / tempo, diferencas);
+            if (modo == 2) divergencias += diferencas;
+        }
+        printf("\n");
+        liberarJit(&jit);
+        liberarRegistros(&reg);
+        liberarPrograma(&prog);
+    }
+
+    for (int v = 0; v < 3; v++) free(colunas[v]);
+    free(esperado); free(saida);
+    return divergencias > 0;
+}
+
+// Mede a mesma expressão nas três precisões (linha a linha) e no lote vetorizado em float.
+// A coluna "erro max" é a maior diferença relativa para o resultado em long double.
+static void benchmarkPrecisao(long linhas) {
+    const char *expressao = "raiz(x*x + y*y) / (1 + z) - sen(x) * cos(y) + log(x + y) ^ 2";
+    Programa prog;
+    if (compilarInFixa(expressao, &prog, NULL) != CALC_OK) exit(EXIT_FAILURE);
+
+    float *colunas[3];
+    for (int v = 0; v < 3; v++) {
+        colunas[v] = (float*)malloc(linhas * sizeof(float));
+        for (long i = 0; i < linhas; i++) colunas[v][i] = (float)((i * (v + 7)) % 1000) / 10.0f + 1;
+    }
+    double *referencia = (double*)malloc(linhas * sizeof(double));
+    float *saida = (float*)malloc(linhas * sizeof(float));
+
+    printf("Expressao: %s\n", expressao);
+    printf("%-24s %14s %12s\n", "avaliador", "linhas/s", "erro max");
+    const Precisao precisoes[] = { PRECISAO_LONG_DOUBLE, PRECISAO_DOUBLE, PRECISAO_FLOAT };
+    const char *nomes[] = { "long double", "double", "float", "avaliarLote (float)" };
+    for (int modo = 0; modo < 4; modo++) {
+        double inicio = agora(), erroMax = 0;
+        if (modo == 3) {
+            ErroCalc erro;
+            prog.precisao = PRECISAO_FLOAT;
+            exigirLote(avaliarLote(&prog, (const float *const *)colunas, linhas, saida, NULL, &erro), &erro);
+        } else {
+            prog.precisao = precisoes[modo];
+            double valores[3], resultado;
+            for (long i = 0; i < linhas; i++) {
+                for (int v = 0; v < 3; v++) valores[v] = colunas[v][i];
+                executarProgramaDouble(&prog, valores, &resultado, NULL);
+                if (modo == 0) referencia[i] = resultado;
+                else erroMax = fmax(erroMax, fabs(resultado - referencia[i]) / fabs(referencia[i]));
+            }
+        }
+        double tempo = agora() - inicio;
+        for (long i = 0; modo == 3 && i < linhas; i++) erroMax = fmax(erroMax, fabs(saida[i] - referencia[i]) / fabs(referencia[i]));
+        printf("%-24s %14.0f %12.3g\n", nomes[modo], linhas / tempo, erroMax);
+    }
+
+    for (int v = 0; v < 3; v++) free(colunas[v]);
+    free(referencia); free(saida);
+    liberarPrograma(&prog);
+}
+
+// Compara MATEMATICA_EXATA e MATEMATICA_RAPIDA em expressões dominadas por sen, cos, tg e log.
+// "diferencas" conta as linhas em que o avaliador difere de executarPrograma no mesmo modo.
+static void benchmarkRapido(long linhas) {
+    const char *expressoes[] = {
+        "sen(x) * cos(y) + tg(x / 4)",
+        "log(x * y + 1) + raiz(x) * sen(y)",
+    };
+    float *colunas[2];
+    for (int v = 0; v < 2; v++) {
+        colunas[v] = (float*)malloc(linhas * sizeof(float));
+        for (long i = 0; i < linhas; i++) colunas[v][i] = (float)((i * (v + 7)) % 3600) / 10.0f + 0.5f;
+    }
+    float *esperado = (float*)malloc(linhas * sizeof(float));
+    float *saida = (float*)malloc(linhas * sizeof(float));
+
+    for (int e = 0; e < (int)(sizeof(expressoes) / sizeof(expressoes[0])); e++) {
+        printf("Expressao: %s\n", expressoes[e]);
+        printf("%-8s %-18s %14s %10s\n", "modo", "avaliador", "linhas/s", "diferencas");
+        for (int modoMat = 0; modoMat < 2; modoMat++) {
+            Programa prog;
+            ProgramaJit jit;
+            if (compilarInFixa(expressoes[e], &prog, NULL) != CALC_OK) exit(EXIT_FAILURE);
+            prog.matematica = modoMat ? MATEMATICA_RAPIDA : MATEMATICA_EXATA;
+            int temJit = compilarJit(&prog, &jit, NULL) == CALC_OK;
+            float valores[2];
+            for (int modo = 0; modo < 3; modo++) {
+                if (modo == 1 && !temJit) continue;
+                double inicio = agora();
+                if (modo == 2) {
+                    ErroCalc erro;
+                    exigirLote(avaliarLote(&prog, (const float *const *)colunas, linhas, saida, NULL, &erro), &erro);
+                } else {
+                    for (long i = 0; i < linhas; i++) {
+                        for (int v = 0; v < prog.numVariaveis; v++) valores[v] = colunas[v][i];
+                        if (modo == 0 && executarPrograma(&prog, valores, &esperado[i], NULL) != CALC_OK) esperado[i] = NAN;
+                        if (modo == 1 && executarJit(&jit, valores, &saida[i], NULL) != CALC_OK) saida[i] = NAN;
+                    }
+                }
+                double tempo = agora() - inicio;
+                long diferencas = 0;
+                for (long i = 0; modo > 0 && i < linhas; i++) diferencas += memcmp(&esperado[i], &saida[i], sizeof(float)) != 0;
+                const char *nomes[] = { "executarPrograma", "executarJit", "avaliarLote" };
+                printf("%-8s %-18s %14.0f %10ld\n", modoMat ? "rapida" : "exata", nomes[modo], linhas / tempo, diferencas);
+            }
+            if (temJit) liberarJit(&jit);
+            liberarPrograma(&prog);
+        }
+        printf("\n");
+    }
+
+    for (int v = 0; v < 2; v++) free(colunas[v]);
+    free(esperado); free(saida);
+}
+
+// Mede a vazão do lexer (tokens/s) nas formas infixa e pós-fixa e a da compilação completa
+static void benchmarkTokens(long repeticoes) {
+    const char *infixas[] = {
+        "3 * (12 + 4)",
+        "raiz(16) + sen(30) * cos(60) - log(100) / 2",
+        "((1.5 + 2,25) * (x - 4) / 5) ^ 2 % 7 + tg(45) * (8 - (y + 10) * 11.125)",
+        "preco * quantidade * (1 - desconto) + frete",
+    };
+    int numInfixas = sizeof(infixas) / sizeof(infixas[0]);
+    char posFixas[4][512];
+    int tamanhos[2][4];
+    long tokens[2] = { 0, 0 };
+    for (int k = 0; k < numInfixas; k++) {
+        getFormaPosFixa_r(infixas[k], posFixas[k], sizeof(posFixas[k]), NULL);
+        tamanhos[0][k] = (int)strlen(infixas[k]);
+        tamanhos[1][k] = (int)strlen(posFixas[k]);
+    }
+
+    printf("%-20s %14s %14s\n", "funcao", "tokens/s", "expressoes/s");
+    for (int posFixa = 0; posFixa < 2; posFixa++) {
+        double inicio = agora();
+        for (long r = 0; r < repeticoes; r++) {
+            int k = (int)(r % numInfixas);
+            tokens[posFixa] += contarTokensN(posFixa ? posFixas[k] : infixas[k], tamanhos[posFixa][k], posFixa, NULL);
+        }
+        double tempo = agora() - inicio;
+        printf("%-20s %14.0f %14.0f\n", posFixa ? "lexer posfixa" : "lexer infixa", tokens[posFixa] / tempo, repeticoes / tempo);
+    }
+
+    Programa prog;
+    double inicio = agora();
+    for (long r = 0; r < repeticoes; r++) {
+        int k = (int)(r % numInfixas);
+        if (compilarInFixaN(infixas[k], tamanhos[0][k], &prog, NULL) == CALC_OK) liberarPrograma(&prog);
+    }
+    double tempo = agora() - inicio;
+    printf("%-20s %14.0f %14.0f\n", "compilarInFixaN", tokens[0] / tempo, repeticoes / tempo);
+}
+
+// Mede as alocações por expressão das variantes N (malloc e free a cada chamada) e das variantes com
+// ContextoCalc, reiniciado entre as expressões depois de uma rodada de aquecimento
+static void benchmarkAlocacoes(long repeticoes) {
+    const char *infixas[] = {
+        "3 * (12 + 4)",
+        "raiz(16) + sen(30) * cos(60) - log(100) / 2",
+        "((1.5 + 2,25) * (x - 4) / 5) ^ 2 % 7 + tg(45) * (8 - (y + 10) * 11.125)",
+        "preco * quantidade * (1 - desconto) + frete + a + b + c + d + e",
+    };
+    int numInfixas = sizeof(infixas) / sizeof(infixas[0]);
+    char posFixas[4][512], saida[2048];
+    int tamanhos[2][4];
+    for (int k = 0; k < numInfixas; k++) {
+        getFormaPosFixa_r(infixas[k], posFixas[k], sizeof(posFixas[k]), NULL);
+        tamanhos[0][k] = (int)strlen(infixas[k]);
+        tamanhos[1][k] = (int)strlen(posFixas[k]);
+    }
+    ContextoCalc *ctx = criarContexto(0);
+    if (ctx == NULL) exit(EXIT_FAILURE);
+    const char *nomes[] = { "avaliarInFixa", "avaliarPosFixa", "getFormaPosFixa", "getFormaInFixa", "getFormaPosFixaOtimizada" };
+
+    if (!CONTA_ALOCACOES) printf("(malloc não é contado fora da glibc; a coluna do contexto vem de getEstatisticasContexto)\n");
+    printf("%-26s %14s %14s %14s %14s\n", "funcao", "N aloc/expr", "N expr/s", "ctx aloc/expr", "ctx expr/s");
+    for (int f = 0; f < 5; f++) {
+        double resultados[2][2]; // [variante][alocações por expressão, expressões/s]
+        for (int variante = 0; variante < 2; variante++) {
+            ContextoCalc *c = variante ? ctx : NULL;
+            EstatisticasContexto antes, depois;
+            long aquecimento = variante ? numInfixas : 0;
+            long inicioAlocacoes = 0;
+            double inicio = 0;
+            for (long r = -aquecimento; r < repeticoes; r++) {
+                if (r == 0) {
+                    getEstatisticasContexto(ctx, &antes);
+                    inicioAlocacoes = alocacoes;
+                    inicio = agora();
+                }
+                int k = (int)((r + aquecimento) % numInfixas);
+                float valor;
+                reiniciarContexto(c);
+                if (f == 0) avaliarInFixaContexto(c, infixas[k], tamanhos[0][k], &valor, NULL);
+                else if (f == 1) avaliarPosFixaContexto(c, posFixas[k], tamanhos[1][k], &valor, NULL);
+                else if (f == 2) getFormaPosFixaContexto(c, infixas[k], tamanhos[0][k], saida, sizeof(saida), NULL);
+                else if (f == 3) getFormaInFixaContexto(c, posFixas[k], tamanhos[1][k], saida, sizeof(saida), NULL);
+                else getFormaPosFixaOtimizadaContexto(c, infixas[k], tamanhos[0][k], saida, sizeof(saida), NULL);
+            }
+            double tempo = agora() - inicio;
+            getEstatisticasContexto(ctx, &depois);
+            long total = CONTA_ALOCACOES ? alocacoes - inicioAlocacoes : depois.alocacoes - antes.alocacoes;
+            resultados[variante][0] = (double)total / repeticoes;
+            resultados[variante][1] = repeticoes / tempo;
+        }
+        if (CONTA_ALOCACOES) printf("%-26s %14.2f %14.0f %14.2f %14.0f\n", nomes[f], resultados[0][0], resultados[0][1], resultados[1][0], resultados[1][1]);
+        else printf("%-26s %14s %14.0f %14.2f %14.0f\n", nomes[f], "-", resultados[0][1], resultados[1][0], resultados[1][1]);
+    }
+    EstatisticasContexto estatisticas;
+    getEstatisticasContexto(ctx, &estatisticas);
+    printf("contexto: %ld bytes de bloco, pico de %ld bytes, %ld alocações no total\n", estatisticas.capacidade, estatisticas.pico, estatisticas.alocacoes);
+    liberarContexto(ctx);
+}
+
+// Escreve em t a soma balanceada dos termos [de, ate), cada um da forma xk * 2.5 + sen(xk)
+static char *escreverSomaBalanceada(char *t, int de, int ate) {
+    if (ate - de == 1) return t + sprintf(t, "x%d * 2.5 + sen(x%d)", de, de);
+    int meio = (de + ate) / 2;
+    *t++ = '(';
+    t = escreverSomaBalanceada(t, de, meio);
+    t += sprintf(t, ") + (");
+    t = escreverSomaBalanceada(t, meio, ate);
+    *t++ = ')';
+    *t = '\0';
+    return t;
+}
+
+// Compara a reexecução completa de uma soma de termos (cada termo com a sua variável) com a avaliação
+// incremental trocando 1 variável ou 1/16 das variáveis por passo: o custo incremental deve acompanhar
+// os nós recalculados (o caminho até a raiz tem ~log2(termos) somas), não o tamanho da expressão
+static void benchmarkIncremental(long atualizacoes) {
+    printf("%-8s %8s %14s %14s %12s %14s %12s\n", "termos", "nos", "completa ns", "1 var ns", "1 var nos", "1/16 vars ns", "1/16 nos");
+    for (int termos = 16; termos <= 65536; termos *= 4) {
+        char *texto = (char*)malloc(termos * 48L + 16);
+        if (texto == NULL) exit(EXIT_FAILURE);
+        escreverSomaBalanceada(texto, 0, termos);
+        Programa prog;
+        if (compilarInFixa(texto, &prog, NULL) != CALC_OK) exit(EXIT_FAILURE);
+        prog.precisao = PRECISAO_DOUBLE;
+        double *valores = (double*)malloc(prog.numVariaveis * sizeof(double));
+        if (valores == NULL) exit(EXIT_FAILURE);
+        for (int v = 0; v < prog.numVariaveis; v++) valores[v] = v;
+
+        // Reexecução completa: tantos passos quanto der para o mesmo trabalho de atualizacoes passos de 16 termos
+        long passosCompletos = atualizacoes * 16 / termos > 20 ? atualizacoes * 16 / termos : 20;
+        double resultado, soma = 0, inicio = agora();
+        for (long p = 0; p < passosCompletos; p++) {
+            valores[p % prog.numVariaveis] += 0.5;
+            executarProgramaDouble(&prog, valores, &resultado, NULL);
+            soma += resultado;
+        }
+        double nsCompleta = (agora() - inicio) * 1e9 / passosCompletos;
+
+        double ns[2], nosPorPasso[2];
+        for (int caso = 0; caso < 2; caso++) {
+            AvaliacaoIncremental *av = criarAvaliacaoIncremental(&prog, valores, NULL);
+            if (av == NULL) exit(EXIT_FAILURE);
+            int trocas = caso == 0 ? 1 : prog.numVariaveis / 16;
+            long passos = caso == 0 ? atualizacoes : (atualizacoes / trocas > 20 ? atualizacoes / trocas : 20);
+            inicio = agora();
+            for (long p = 0; p < passos; p++) {
+                for (int t = 0; t < trocas; t++) {
+                    int slot = (int)((p * trocas + t) * 7919 % prog.numVariaveis); // Espalha as trocas pela expressão
+                    valores[slot] += 0.5;
+                    definirVariavelIncremental(av, slot, valores[slot]);
+                }
+                getValorIncremental(av, &resultado, NULL);
+                soma += resultado;
+            }
+            ns[caso] = (agora() - inicio) * 1e9 / passos;
+            EstatisticasIncremental estatisticas;
+            getEstatisticasIncremental(av, &estatisticas);
+            nosPorPasso[caso] = (double)estatisticas.recalculados / estatisticas.atualizacoes;
+            liberarAvaliacaoIncremental(av);
+        }
+        printf("%-8d %8d %14.0f %14.0f %12.1f %14.0f %12.1f\n", termos, prog.tamanho, nsCompleta, ns[0], nosPorPasso[0], ns[1], nosPorPasso[1]);
+        if (soma == 42) printf("\n"); // Usa os resultados, para o compilador não descartar as avaliações
+        liberarPrograma(&prog);
+        free(valores);
+        free(texto);
+    }
+}
+
+// ===== Gerador de expressões =====
+// Árvores aleatórias com profundidade máxima, mistura de operadores e número de variáveis configuráveis,
+// escritas nas formas infixa e pós-fixa. O valor de cada nó é acompanhado em double, com uma estimativa
+// do erro que a avaliação em float acumula, para evitar erros de domínio com folga (divisor perto de zero,
+// raiz e log de não positivos, tg perto dos polos). Cada expressão ainda é conferida com avaliarInFixa e
+// avaliarPosFixa e sorteada de novo se der erro, já que getValorInFixa e getValorPosFixa encerram o programa.
+
+#define ERRO_RELATIVO_FLOAT 1e-6 // Erro relativo por operação em float, com folga (o épsilon é 6e-8)
+
+typedef struct {
+    int numExpressoes;
+    int profundidade; // Profundidade máxima da árvore
+    int numVariaveis; // Variáveis distintas (x0, x1...); 0 gera só constantes
+    const char *operadores; // Um caractere por operador: + - * / % ^ e r(aiz) s(en) c(os) t(g) l(og); repetir aumenta o peso
+    unsigned long long semente;
+} ParametrosGerador;
+
+typedef struct {
+    char op; // 0 nas folhas
+    int esq, dir;
+    int variavel; // Índice da variável da folha, ou -1 para número
+    double valor;
+    double erro; // Estimativa do erro absoluto do valor calculado em float
+} NoGerado;
+
+typedef struct {
+    ParametrosGerador parametros;
+    unsigned long long estado;
+    NoGerado *nos;
+    int numNos, capacidadeNos;
+} Gerador;
+
+typedef struct {
+    char *dados;
+    long tamanho, capacidade;
+} Texto;
+
+static void anexarTexto(Texto *t, const char *s) {
+    long n = (long)strlen(s);
+    if (t->tamanho + n + 1 > t->capacidade) {
+        while (t->tamanho + n + 1 > t->capacidade) t->capacidade = t->capacidade ? 2 * t->capacidade : 256;
+        if ((t->dados = (char*)realloc(t->dados, t->capacidade)) == NULL) exit(EXIT_FAILURE);
+    }
+    memcpy(t->dados + t->tamanho, s, n + 1);
+    t->tamanho += n;
+}
+
+// xorshift64*: reprodutível a partir da semente, sem depender do rand() da plataforma
+static unsigned long long sortear(Gerador *g) {
+    g->estado ^= g->estado >> 12;
+    g->estado ^= g->estado << 25;
+    g->estado ^= g->estado >> 27;
+    return g->estado * 2685821657736338717ull;
+}
+
+static double sortearFracao(Gerador *g) {
+    return (sortear(g) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double valorVariavel(int k) {
+    return k % 9 + 1.5;
+}
+
+static int novoNo(Gerador *g, char op, int esq, int dir, int variavel, double valor, double erro) {
+    if (g->numNos == g->capacidadeNos) {
+        g->capacidadeNos = g->capacidadeNos ? 2 * g->capacidadeNos : 64;
+        if ((g->nos = (NoGerado*)realloc(g->nos, g->capacidadeNos * sizeof(NoGerado))) == NULL) exit(EXIT_FAILURE);
+    }
+    NoGerado *no = &g->nos[g->numNos];
+    no->op = op; no->esq = esq; no->dir = dir; no->variavel = variavel; no->valor = valor;
+    no->erro = erro + fabs(valor) * ERRO_RELATIVO_FLOAT;
+    return g->numNos++;
+}
+
+// Folha: variável (se houver) ou número com até uma casa decimal
+static int gerarFolha(Gerador *g) {
+    if (g->parametros.numVariaveis > 0 && sortearFracao(g) < 0.4) {
+        int k = (int)(sortear(g) % g->parametros.numVariaveis);
+        return novoNo(g, 0, -1, -1, k, valorVariavel(k), 0);
+    }
+    int n = (int)(sortear(g) % 1000) + 1;
+    return novoNo(g, 0, -1, -1, -1, (n % 3 == 0) ? n / 10.0 : (double)(n % 100 + 1), 0);
+}
+
+// Gera um nó no nível dado; operações que dariam erro de domínio viram soma (binárias) ou somem (funções)
+static int gerarNo(Gerador *g, int nivel) {
+    if (nivel >= g->parametros.profundidade || (nivel > 1 && sortearFracao(g) < 0.15)) return gerarFolha(g);
+    const char *ops = g->parametros.operadores;
+    char op = ops[sortear(g) % strlen(ops)];
+    int a = gerarNo(g, nivel + 1);
+    double va = g->nos[a].valor, ea = g->nos[a].erro, r, e;
+
+    if (strchr("rsctl", op) != NULL) {
+        const double grau = 3.14159265358979323846 / 180;
+        double folga = 10 * ea + 1e-3;
+        if ((op == 'r' || op == 'l') && va < folga) return a;
+        if (op == 't' && (fabs(fmod(fabs(va), 180) - 90) < 1 + 10 * ea || ea > 1)) return a;
+        switch (op) {
+            case 'r': r = sqrt(va); e = ea / (2 * r); break;
+            case 's': r = sin(va * grau); e = ea * grau; break;
+            case 'c': r = cos(va * grau); e = ea * grau; break;
+            case 't': r = tan(va * grau); e = ea * grau * (1 + r * r); break;
+            default: r = log10(va); e = ea / (va * 2.302585092994046); break;
+        }
+        return novoNo(g, op, a, -1, -1, r, e);
+    }
+
+    // O expoente é um inteiro pequeno, para a potência não estourar
+    int b = op == '^' ? novoNo(g, 0, -1, -1, -1, (double)(sortear(g) % 4), 0) : gerarNo(g, nivel + 1);
+    double vb = g->nos[b].valor, eb = g->nos[b].erro;
+    if ((op == '/' || op == '%') && fabs(vb) < 10 * eb + 1e-3) op = '+';
+    switch (op) {
+        case '+': r = va + vb; e = ea + eb; break;
+        case '-': r = va - vb; e = ea + eb; break;
+        case '*': r = va * vb; e = fabs(va) * eb + fabs(vb) * ea + ea * eb; break;
+        case '/': r = va / vb; e = (ea + fabs(r) * eb) / (fabs(vb) - eb); break;
+        case '%': r = fmod(va, vb); e = ea + eb * (fabs(va / vb) + 1); break;
+        default: r = pow(va, vb); e = vb * pow(fabs(va) + ea, vb - 1) * ea; break;
+    }
+    if (fabs(r) > 1e6 && op != '+' && op != '-') { // Mantém os valores (e o erro do float) pequenos
+        op = '-';
+        r = va - vb;
+        e = ea + eb;
+    }
+    return novoNo(g, op, a, b, -1, r, e);
+}
+
+static int prioridadeGerada(char op) {
+    switch (op) {
+        case '+': case '-': return 1;
+        case '*': case '/': case '%': return 2;
+        case '^': return 3;
+        default: return 4; // Folhas e funções
+    }
+}
+
+static const char *nomeFuncaoGerada(char op) {
+    switch (op) {
+        case 'r': return "raiz";
+        case 's': return "sen";
+        case 'c': return "cos";
+        case 't': return "tg";
+        default: return "log";
+    }
+}
+
+// Escreve o nó nas duas formas; a infixa só tem os parênteses exigidos pelas prioridades.
+// Sem variáveis, cada variável é escrita com o seu valor, o que mantém o mesmo resultado.
+static void escreverNo(const Gerador *g, int idx, int comVariaveis, Texto *infixa, Texto *posFixa) {
+    const NoGerado *no = &g->nos[idx];
+    char folha[32];
+    if (no->op == 0) {
+        if (no->variavel >= 0 && comVariaveis) snprintf(folha, sizeof(folha), "x%d", no->variavel);
+        else snprintf(folha, sizeof(folha), "%.15g", no->valor);
+        anexarTexto(infixa, folha);
+        anexarTexto(posFixa, folha);
+        return;
+    }
+    if (no->dir < 0) {
+        anexarTexto(infixa, nomeFuncaoGerada(no->op));
+        anexarTexto(infixa, "(");
+        escreverNo(g, no->esq, comVariaveis, infixa, posFixa);
+        anexarTexto(infixa, ")");
+        anexarTexto(posFixa, " ");
+        anexarTexto(posFixa, nomeFuncaoGerada(no->op));
+        return;
+    }
+    int p = prioridadeGerada(no->op), pa = prioridadeGerada(g->nos[no->esq].op), pb = prioridadeGerada(g->nos[no->dir].op);
+    int parentesesA = pa < p || (no->op == '^' && pa == p);
+    int parentesesB = pb < p || (pb == p && no->op != '^');
+    char operador[4] = { ' ', no->op, ' ', '\0' };
+
+    if (parentesesA) anexarTexto(infixa, "(");
+    escreverNo(g, no->esq, comVariaveis, infixa, posFixa);
+    if (parentesesA) anexarTexto(infixa, ")");
+    anexarTexto(infixa, operador);
+    anexarTexto(posFixa, " ");
+    if (parentesesB) anexarTexto(infixa, "(");
+    escreverNo(g, no->dir, comVariaveis, infixa, posFixa);
+    if (parentesesB) anexarTexto(infixa, ")");
+    operador[2] = '\0'; // Na pós-fixa o operador vem depois de um espaço, sem outro no fim
+    anexarTexto(posFixa, operador);
+}
+
+// Conjunto de expressões geradas: com variáveis (para as conversões) e com os valores no lugar delas (para as avaliações)
+typedef struct {
+    char **infixas, **posFixas; // Com variáveis
+    char **infixasValor, **posFixasValor; // Sem variáveis
+    int numExpressoes;
+} Carga;
+
+static char *copiarTexto(const Texto *t) {
+    char *c = (char*)malloc(t->tamanho + 1);
+    if (c == NULL) exit(EXIT_FAILURE);
+    memcpy(c, t->dados, t->tamanho + 1);
+    return c;
+}
+
+static void gerarCarga(const ParametrosGerador *parametros, Carga *carga) {
+    Gerador g = { *parametros, parametros->semente ? parametros->semente : 1, NULL, 0, 0 };
+    Texto textos[4] = { { NULL, 0, 0 }, { NULL, 0, 0 }, { NULL, 0, 0 }, { NULL, 0, 0 } };
+    char **vetores[4];
+    for (int v = 0; v < 4; v++) {
+        if ((vetores[v] = (char**)malloc(parametros->numExpressoes * sizeof(char*))) == NULL) exit(EXIT_FAILURE);
+    }
+    for (int e = 0; e < parametros->numExpressoes; e++) {
+        for (int tentativa = 0;; tentativa++) {
+            g.numNos = 0;
+            int raiz = gerarNo(&g, 0);
+            for (int v = 0; v < 4; v++) textos[v].tamanho = 0;
+            escreverNo(&g, raiz, 1, &textos[0], &textos[1]);
+            escreverNo(&g, raiz, 0, &textos[2], &textos[3]);
+            float valor;
+            if (avaliarInFixa(textos[2].dados, &valor, NULL) == CALC_OK && avaliarPosFixa(textos[3].dados, &valor, NULL) == CALC_OK) break;
+            if (tentativa == 1000) {
+                fprintf(stderr, "Erro: o gerador não achou expressões sem erro de domínio com esses operadores.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (int v = 0; v < 4; v++) vetores[v][e] = copiarTexto(&textos[v]);
+    }
+    carga->infixas = vetores[0]; carga->posFixas = vetores[1];
+    carga->infixasValor = vetores[2]; carga->posFixasValor = vetores[3];
+    carga->numExpressoes = parametros->numExpressoes;
+    for (int v = 0; v < 4; v++) free(textos[v].dados);
+    free(g.nos);
+}
+
+static void liberarCarga(Carga *carga) {
+    for (int e = 0; e < carga->numExpressoes; e++) {
+        free(carga->infixas[e]); free(carga->posFixas[e]);
+        free(carga->infixasValor[e]); free(carga->posFixasValor[e]);
+    }
+    free(carga->infixas); free(carga->posFixas);
+    free(carga->infixasValor); free(carga->posFixasValor);
+}
+
+typedef struct {
+    ParametrosGerador gerador;
+    long repeticoes;
+    int capacidadeCache;
+    int posFixa, semVariaveis; // Só no modo gerar
+} OpcoesSuite;
+
+// Lê as opções a partir de argv[inicio]; retorna 0 se alguma for desconhecida ou inválida
+static int lerOpcoesSuite(int argc, char *argv[], int inicio, OpcoesSuite *o) {
+    o->gerador.numExpressoes = 1000;
+    o->gerador.profundidade = 6;
+    o->gerador.numVariaveis = 3;
+    o->gerador.operadores = "++--**//%^rsctl";
+    o->gerador.semente = 42;
+    o->repeticoes = 200000;
+    o->capacidadeCache = 0;
+    o->posFixa = o->semVariaveis = 0;
+    for (int i = inicio; i < argc; i++) {
+        int temValor = i + 1 < argc;
+        if (strcmp(argv[i], "--expressoes") == 0 && temValor) o->gerador.numExpressoes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--profundidade") == 0 && temValor) o->gerador.profundidade = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--variaveis") == 0 && temValor) o->gerador.numVariaveis = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--operadores") == 0 && temValor) o->gerador.operadores = argv[++i];
+        else if (strcmp(argv[i], "--semente") == 0 && temValor) o->gerador.semente = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--repeticoes") == 0 && temValor) o->repeticoes = atol(argv[++i]);
+        else if (strcmp(argv[i], "--cache") == 0 && temValor) o->capacidadeCache = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--posfixa") == 0) o->posFixa = 1;
+        else if (strcmp(argv[i], "--sem-variaveis") == 0) o->semVariaveis = 1;
+        else return 0;
+    }
+    const char *ops = o->gerador.operadores;
+    return o->gerador.numExpressoes > 0 && o->gerador.profundidade >= 0 && o->gerador.numVariaveis >= 0 &&
+           o->repeticoes > 0 && ops[0] != '\0' && strspn(ops, "+-*/%^rsctl") == strlen(ops);
+}
+
+// Escreve as expressões geradas, uma por linha (entrada para o modo lote do programa principal)
+static void executarGerador(const OpcoesSuite *o) {
+    Carga carga;
+    gerarCarga(&o->gerador, &carga);
+    for (int e = 0; e < carga.numExpressoes; e++) {
+        char **textos = o->posFixa ? (o->semVariaveis ? carga.posFixasValor : carga.posFixas)
+                                   : (o->semVariaveis ? carga.infixasValor : carga.infixas);
+        puts(textos[e]);
+    }
+    liberarCarga(&carga);
+}
+
+static int compararLatencia(const void *a, const void *b) {
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+// Chama a função f da suíte sobre a expressão e da carga
+static void chamarFuncaoSuite(int f, const Carga *carga, int e) {
+    volatile float valor;
+    switch (f) {
+        case 0: getFormaPosFixa(carga->infixas[e]); break;
+        case 1: getFormaInFixa(carga->posFixas[e]); break;
+        case 2: valor = getValorInFixa(carga->infixasValor[e]); break;
+        default: valor = getValorPosFixa(carga->posFixasValor[e]); break;
+    }
+    (void)valor;
+}
+
+// Mede as quatro funções públicas de calculadora.h sobre uma carga gerada e escreve o resultado em JSON:
+// vazão (sem medir cada chamada), latência p50/p99 (cada chamada medida) e alocações por chamada
+static void executarSuite(const OpcoesSuite *o) {
+    const char *nomes[] = { "getFormaPosFixa", "getFormaInFixa", "getValorInFixa", "getValorPosFixa" };
+    Carga carga;
+    gerarCarga(&o->gerador, &carga);
+    ativarCacheGlobal(o->capacidadeCache);
+    long long *latencias = (long long*)malloc(o->repeticoes * sizeof(long long));
+    if (latencias == NULL) exit(EXIT_FAILURE);
+
+    long tamanhoInfixas = 0, tamanhoPosFixas = 0;
+    for (int e = 0; e < carga.numExpressoes; e++) {
+        tamanhoInfixas += (long)strlen(carga.infixas[e]);
+        tamanhoPosFixas += (long)strlen(carga.posFixas[e]);
+    }
+
+    printf("{\n");
+    printf("  \"parametros\": {\"expressoes\": %d, \"profundidade\": %d, \"variaveis\": %d, \"operadores\": \"%s\", "
+           "\"semente\": %llu, \"repeticoes\": %ld, \"cache\": %d, \"contaAlocacoes\": %s},\n",
+           o->gerador.numExpressoes, o->gerador.profundidade, o->gerador.numVariaveis, o->gerador.operadores,
+           o->gerador.semente, o->repeticoes, o->capacidadeCache, CONTA_ALOCACOES ? "true" : "false");
+    printf("  \"carga\": {\"tamanhoMedioInfixa\": %.1f, \"tamanhoMedioPosFixa\": %.1f},\n",
+           (double)tamanhoInfixas / carga.numExpressoes, (double)tamanhoPosFixas / carga.numExpressoes);
+    printf("  \"funcoes\": [\n");
+    for (int f = 0; f < 4; f++) {
+        for (int e = 0; e < carga.numExpressoes; e++) chamarFuncaoSuite(f, &carga, e); // Aquecimento
+
+        long inicioAlocacoes = alocacoes;
+        double inicio = agora();
+        for (long r = 0; r < o->repeticoes; r++) chamarFuncaoSuite(f, &carga, (int)(r % carga.numExpressoes));
+        double tempo = agora() - inicio;
+        long totalAlocacoes = alocacoes - inicioAlocacoes;
+
+        for (long r = 0; r < o->repeticoes; r++) {
+            long long t = agoraNs();
+            chamarFuncaoSuite(f, &carga, (int)(r % carga.numExpressoes));
+            latencias[r] = agoraNs() - t;
+        }
+        qsort(latencias, o->repeticoes, sizeof(long long), compararLatencia);
+
+        printf("    {\"nome\": \"%s\", \"chamadas\": %ld, \"chamadasPorSegundo\": %.0f, \"p50Ns\": %lld, \"p99Ns\": %lld, "
+               "\"alocacoesPorChamada\": ", nomes[f], o->repeticoes, o->repeticoes / tempo,
+               latencias[o->repeticoes / 2], latencias[(long)(o->repeticoes * 0.99)]);
+        if (CONTA_ALOCACOES) printf("%.3f}", (double)totalAlocacoes / o->repeticoes);
+        else printf("null}");
+        printf(f < 3 ? ",\n" : "\n");
+    }
+    printf("  ]\n}\n");
+
+    ativarCacheGlobal(0);
+    free(latencias);
+    liberarCarga(&carga);
+}
+
+// ===== Avaliação direta da infixa =====
+
+// O caminho compilado (shunting-yard e execução do programa), que a avaliação direta deve reproduzir
+static int avaliarCompilado(const char *Str, int n, Precisao precisao, ModoMatematica matematica, double *resultado, ErroCalc *erro) {
+    Programa prog;
+    int cod = compilarInFixaN(Str, n, &prog, erro);
+    if (cod != CALC_OK) return cod;
+    prog.precisao = precisao;
+    prog.matematica = matematica;
+    cod = executarProgramaDouble(&prog, NULL, resultado, erro);
+    liberarPrograma(&prog);
+    return cod;
+}
+
+// Latência de expressões do tamanho das digitadas no modo interativo: avaliarInFixaN (direta), e o
+// caminho compilado com malloc e com um ContextoCalc reaproveitado
+static void benchmarkCurtas(long repeticoes) {
+    const char *infixas[] = {
+        "3 * (12 + 4)",
+        "2 ^ 3 ^ 2 % 7",
+        "raiz(16) + sen(30) * cos(60) - log(100) / 2",
+        "((1.5 + 2,25) * (8 - 4) / 5) ^ 2 % 7 + tg(45) * (8 - (3 + 10) * 11.125)",
+    };
+    ContextoCalc *ctx = criarContexto(0);
+    if (ctx == NULL) exit(EXIT_FAILURE);
+    printf("%-72s %10s %12s %12s\n", "expressao", "direta ns", "compilada ns", "contexto ns");
+    for (int k = 0; k < 4; k++) {
+        int n = (int)strlen(infixas[k]);
+        double ns[3] = { 0, 0, 0 }, soma = 0;
+        for (int rodada = 0; rodada < 15; rodada++) { // Rodadas intercaladas; vale a melhor de cada caminho
+            int caminho = rodada % 3;
+            double inicio = agora(), resultado = 0;
+            for (long r = 0; r < repeticoes / 5; r++) {
+                float valor = 0;
+                if (caminho == 0) avaliarInFixaN(infixas[k], n, &valor, NULL);
+                else if (caminho == 1) avaliarCompilado(infixas[k], n, PRECISAO_FLOAT, MATEMATICA_EXATA, &resultado, NULL);
+                else {
+                    Programa prog;
+                    reiniciarContexto(ctx);
+                    if (compilarInFixaContexto(ctx, infixas[k], n, &prog, NULL) == CALC_OK) executarPrograma(&prog, NULL, &valor, NULL);
+                }
+                soma += valor + resultado;
+            }
+            double tempo = (agora() - inicio) * 1e9 / (repeticoes / 5);
+            if (rodada < 3 || tempo < ns[caminho]) ns[caminho] = tempo;
+        }
+        printf("%-72s %10.0f %12.0f %12.0f\n", infixas[k], ns[0], ns[1], ns[2]);
+        if (soma == 42) printf("\n"); // Usa os resultados, para o compilador não descartar as avaliações
+    }
+    liberarContexto(ctx);
+}
+
+// Sequência aleatória de tokens (quase sempre mal formada) com espaços opcionais
+static void gerarSopaTokens(Gerador *g, Texto *t) {
+    static const char *const tokens[] = {
+        "1", "2.5", "0", "90", "3,5", "x", "inf", "#", "sen", "cos", "tg", "log", "raiz",
+        "+", "-", "*", "/", "%", "^", "(", ")", "(", ")",
+    };
+    int numTokens = 1 + (int)(sortear(g) % 16);
+    t->tamanho = 0;
+    anexarTexto(t, "");
+    for (int i = 0; i < numTokens; i++) {
+        anexarTexto(t, tokens[sortear(g) % (sizeof(tokens) / sizeof(tokens[0]))]);
+        if (sortear(g) % 2) anexarTexto(t, " ");
+    }
+}
+
+// Compara avaliarInFixaPrecisaoN (avaliação direta, com volta ao caminho compilado fora da gramática) com o
+// caminho compilado em todas as precisões e modos: código, posição do erro e valor bit a bit.
+// Entradas: expressões do gerador, sequências aleatórias de tokens e aninhamentos acima do limite da recursão.
+static int executarDiferencial(long casos) {
+    ParametrosGerador parametros = { 2000, 8, 0, "++--**//%^rsctl", 7 };
+    Carga carga;
+    gerarCarga(&parametros, &carga);
+    Gerador g = { parametros, 99, NULL, 0, 0 };
+    Texto t = { NULL, 0, 0 };
+    long divergencias = 0, comErro = 0;
+
+    for (long c = 0; c < casos; c++) {
+        int tipo = (int)(c % 4);
+        t.tamanho = 0;
+        if (tipo == 0) {
+            anexarTexto(&t, carga.infixasValor[(c / 4) % carga.numExpressoes]);
+        } else if (tipo == 3 && c % 400 == 3) { // Aninhamento de parênteses, funções e potências em torno do limite
+            int profundidade = (int)(sortear(&g) % 600);
+            const char *abre[] = { "(", "sen(", "2 ^ (" };
+            int k = (int)(sortear(&g) % 3);
+            for (int i = 0; i < profundidade; i++) anexarTexto(&t, abre[k]);
+            anexarTexto(&t, "1.5");
+            for (int i = 0; i < profundidade; i++) anexarTexto(&t, ")");
+        } else {
+            gerarSopaTokens(&g, &t);
+        }
+        for (int precisao = PRECISAO_FLOAT; precisao <= PRECISAO_LONG_DOUBLE; precisao++) {
+            for (int matematica = MATEMATICA_EXATA; matematica <= MATEMATICA_RAPIDA; matematica++) {
+                double direta = 0, compilada = 0;
+                ErroCalc erroDireta = { CALC_OK, -2 }, erroCompilada = { CALC_OK, -2 };
+                int codDireta = avaliarInFixaPrecisaoN(t.dados, (int)t.tamanho, (Precisao)precisao, (ModoMatematica)matematica, &direta, &erroDireta);
+                int codCompilada = avaliarCompilado(t.dados, (int)t.tamanho, (Precisao)precisao, (ModoMatematica)matematica, &compilada, &erroCompilada);
+                int mesmoValor = memcmp(&direta, &compilada, sizeof(double)) == 0 || (direta != direta && compilada != compilada);
+                if (codCompilada != CALC_OK) comErro++;
+                if (codDireta != codCompilada || (codDireta != CALC_OK && erroDireta.posicao != erroCompilada.posicao) ||
+                    (codDireta == CALC_OK && !mesmoValor)) {
+                    if (divergencias++ < 10) {
+                        printf("Divergencia (precisao %d, modo %d): %s\n  direta: %d na posicao %d, %.17g\n  compilada: %d na posicao %d, %.17g\n",
+                               precisao, matematica, t.dados, codDireta, erroDireta.posicao, direta, codCompilada, erroCompilada.posicao, compilada);
+                    }
+                }
+            }
+        }
+    }
+    printf("%ld casos x 6 (precisao e modo), %ld avaliacoes com erro, %ld divergencias\n", casos, comErro, divergencias);
+    free(t.dados);
+    liberarCarga(&carga);
+    return divergencias > 0;
+}
+
+// Inicialização de um serviço com muitas fórmulas: compilar o texto de cada uma, contra abrir um pacote já
+// compilado (mmap e validação) e carregar os programas dele. O arquivo acabou de ser gravado, então está no
+// cache de páginas, como num reinício do serviço. Vale a melhor de 5 rodadas de cada caminho. Retorna 1 se algum
+// programa carregado, otimizado ou não, der resultado diferente do compilado.
+static int benchmarkPacote(int numFormulas) {
+    ParametrosGerador parametros = { numFormulas, 6, 8, "++--**//%^rsctl", 23 };
+    const char *nomeArquivo = "benchmark_pacote.tmp";
+    Carga carga;
+    gerarCarga(&parametros, &carga);
+    Programa *compilados = (Programa*)malloc(numFormulas * sizeof(Programa));
+    Programa *carregados = (Programa*)malloc(numFormulas * sizeof(Programa));
+    if (compilados == NULL || carregados == NULL) exit(EXIT_FAILURE);
+    long bytesTexto = 0;
+    for (int e = 0; e < numFormulas; e++) bytesTexto += (long)strlen(carga.infixas[e]) + 1;
+
+    double compilar = 0, abrir = 0, carregar = 0;
+    PacoteProgramas *pacote = NULL;
+    ErroCalc erro;
+    for (int rodada = 0; rodada < 5; rodada++) {
+        if (rodada > 0) {
+            for (int e = 0; e < numFormulas; e++) liberarPrograma(&compilados[e]);
+            fecharPacote(pacote);
+        }
+        double inicio = agora();
+        for (int e = 0; e < numFormulas; e++) compilarInFixa(carga.infixas[e], &compilados[e], NULL);
+        double tempo = agora() - inicio;
+        if (rodada == 0 || tempo < compilar) compilar = tempo;
+
+        if (rodada == 0 && salvarPacote(nomeArquivo, compilados, (const char *const*)carga.infixas, numFormulas, &erro) != CALC_OK) {
+            fprintf(stderr, "Erro ao gravar '%s': %s\n", nomeArquivo, mensagemErro(erro.codigo));
+            exit(EXIT_FAILURE);
+        }
+        inicio = agora();
+        if ((pacote = abrirPacote(nomeArquivo, &erro)) == NULL) {
+            fprintf(stderr, "Erro ao abrir '%s': %s\n", nomeArquivo, mensagemErro(erro.codigo));
+            exit(EXIT_FAILURE);
+        }
+        double meio = agora();
+        for (int e = 0; e < numFormulas; e++) carregarPrograma(pacote, e, &carregados[e], NULL);
+        tempo = agora() - inicio;
+        if (rodada == 0 || tempo < carregar) {
+            carregar = tempo;
+            abrir = meio - inicio;
+        }
+    }
+
+    // Os carregados também são otimizados (código e constantes novos, sem escrever no mapeamento só de leitura)
+    double valores[8] = { 1.5, 2.5, 3.5, 4.5, 5.5, 6.5, 7.5, 8.5 };
+    long diferentes = 0;
+    for (int passo = 0; passo < 2; passo++) {
+        for (int e = 0; e < numFormulas; e++) {
+            double a = 0, b = 0;
+            if (passo == 1 && (otimizarPrograma(&compilados[e]) != CALC_OK || otimizarPrograma(&carregados[e]) != CALC_OK)) {
+                diferentes++;
+                continue;
+            }
+            int codA = executarProgramaDouble(&compilados[e], valores, &a, NULL);
+            int codB = executarProgramaDouble(&carregados[e], valores, &b, NULL);
+            if (codA != codB || memcmp(&a, &b, sizeof(double)) != 0) diferentes++;
+        }
+    }
+    for (int e = 0; e < numFormulas; e++) liberarPrograma(&compilados[e]);
+    printf("%d formulas: texto %ld bytes, pacote %ld bytes\n", numFormulas, bytesTexto,
+           tamanhoPacote(carregados, (const char *const*)carga.infixas, numFormulas));
+    printf("compilar texto:           %8.2f ms (%6.0f ns/formula)\n", compilar * 1e3, compilar * 1e9 / numFormulas);
+    printf("abrir pacote (validando): %8.2f ms\n", abrir * 1e3);
+    printf("abrir e carregar todos:   %8.2f ms (%6.0f ns/formula, %.1fx mais rapido)\n", carregar * 1e3, carregar * 1e9 / numFormulas, compilar / carregar);
+    printf("resultados diferentes:    %ld (antes e depois de otimizar)\n", diferentes);
+    fecharPacote(pacote);
+    remove(nomeArquivo);
+    free(compilados);
+    free(carregados);
+    liberarCarga(&carga);
+    return diferentes > 0;
+}
+
+// Mede avaliarLoteMulti contra avaliarLote fórmula por fórmula sobre as mesmas colunas, conferindo que
+// resultados e códigos de erro são iguais bit a bit. Vale a melhor de 3 rodadas de cada caminho.
+static void medirMulti(const char *nome, Programa *programas, int numFormulas, long linhas) {
+    ErroCalc erro;
+    double inicio = agora();
+    ProgramaMulti *multi = compilarMulti(programas, numFormulas, &erro);
+    double compilar = agora() - inicio;
+    if (multi == NULL) {
+        fprintf(stderr, "Erro: %s\n", mensagemErro(erro.codigo));
+        exit(EXIT_FAILURE);
+    }
+    EstatisticasMulti estatisticas;
+    getEstatisticasMulti(multi, &estatisticas);
+
+    // Coluna k: valor da variável xk do gerador, com uma pequena variação por linha
+    float **colunas = (float**)malloc((estatisticas.variaveis + 1) * sizeof(float*));
+    const float **colunasFormula = (const float**)malloc((estatisticas.variaveis + 1) * sizeof(float*));
+    float **saidas[2];
+    unsigned char **status[2];
+    if (colunas == NULL || colunasFormula == NULL) exit(EXIT_FAILURE);
+    for (int c = 0; c < estatisticas.variaveis; c++) {
+        char nomeVariavel[16];
+        int k;
+        for (k = 0; k < estatisticas.variaveis; k++) {
+            snprintf(nomeVariavel, sizeof(nomeVariavel), "x%d", k);
+            if (getIndiceVariavelMulti(multi, nomeVariavel) == c) break;
+        }
+        if ((colunas[c] = (float*)malloc(linhas * sizeof(float))) == NULL) exit(EXIT_FAILURE);
+        for (long i = 0; i < linhas; i++) colunas[c][i] = (float)(valorVariavel(k) * (1 + ((i * (k + 7)) % 201 - 100) * 1e-4));
+    }
+    for (int caminho = 0; caminho < 2; caminho++) {
+        saidas[caminho] = (float**)malloc(numFormulas * sizeof(float*));
+        status[caminho] = (unsigned char**)malloc(numFormulas * sizeof(unsigned char*));
+        if (saidas[caminho] == NULL || status[caminho] == NULL) exit(EXIT_FAILURE);
+        for (int f = 0; f < numFormulas; f++) {
+            saidas[caminho][f] = (float*)malloc(linhas * sizeof(float));
+            status[caminho][f] = (unsigned char*)malloc(linhas);
+            if (saidas[caminho][f] == NULL || status[caminho][f] == NULL) exit(EXIT_FAILURE);
+        }
+    }
+
+    double separado = 0, fundido = 0;
+    long errosSeparado = 0, errosFundido = 0;
+    for (int rodada = 0; rodada < 3; rodada++) {
+        inicio = agora();
+        errosSeparado = 0;
+        for (int f = 0; f < numFormulas; f++) {
+            for (int v = 0; v < programas[f].numVariaveis; v++) {
+                colunasFormula[v] = colunas[getIndiceVariavelMulti(multi, programas[f].variaveis[v])];
+            }
+            errosSeparado += exigirLote(avaliarLote(&programas[f], colunasFormula, linhas, saidas[0][f], status[0][f], &erro), &erro);
+        }
+        double tempo = agora() - inicio;
+        if (rodada == 0 || tempo < separado) separado = tempo;
+
+        inicio = agora();
+        errosFundido = exigirLote(avaliarLoteMulti(multi, (const float *const *)colunas, linhas, saidas[1], status[1], &erro), &erro);
+        tempo = agora() - inicio;
+        if (rodada == 0 || tempo < fundido) fundido = tempo;
+    }
+
+    long diferentes = 0;
+    for (int f = 0; f < numFormulas; f++) {
+        if (memcmp(saidas[0][f], saidas[1][f], linhas * sizeof(float)) != 0 || memcmp(status[0][f], status[1][f], linhas) != 0) diferentes++;
+    }
+    printf("%s: %d formulas, %d variaveis, %ld linhas\n", nome, numFormulas, estatisticas.variaveis, linhas);
+    printf("  DAG fundido: %d instrucoes -> %d nos, %d registradores, blocos de %d linhas (compilado em %.2f ms)\n",
+           estatisticas.instrucoes, estatisticas.nos, estatisticas.registradores, estatisticas.linhasPorBloco, compilar * 1e3);
+    printf("  uma por vez (avaliarLote):   %9.2f ms (%6.2f ns/formula/linha)\n", separado * 1e3, separado * 1e9 / numFormulas / linhas);
+    printf("  fundidas (avaliarLoteMulti): %9.2f ms (%6.2f ns/formula/linha, %.2fx)\n", fundido * 1e3, fundido * 1e9 / numFormulas / linhas, separado / fundido);
+    printf("  linhas com erro: %ld / %ld; formulas com resultado diferente: %ld\n", errosSeparado, errosFundido, diferentes);
+
+    for (int caminho = 0; caminho < 2; caminho++) {
+        for (int f = 0; f < numFormulas; f++) {
+            free(saidas[caminho][f]);
+            free(status[caminho][f]);
+        }
+        free(saidas[caminho]);
+        free(status[caminho]);
+    }
+    for (int c = 0; c < estatisticas.variaveis; c++) free(colunas[c]);
+    free(colunas);
+    free((void*)colunasFormula);
+    liberarMulti(multi);
+}
+
+// Relatório com muitas fórmulas sobre a mesma tabela: fórmulas do gerador (16 variáveis, pouca subexpressão
+// em comum) e fórmulas montadas de um repertório de subexpressões, como indicadores derivados uns dos outros.
+// Nas montadas, algumas são em double ou com matemática rápida, e log e raiz dão erro de domínio em parte das linhas.
+static void benchmarkMulti(long linhas, int numFormulas) {
+    ParametrosGerador parametros = { numFormulas, 5, 16, "++--**//%^rsctl", 25 };
+    Carga carga;
+    gerarCarga(&parametros, &carga);
+    Programa *programas = (Programa*)malloc(numFormulas * sizeof(Programa));
+    if (programas == NULL) exit(EXIT_FAILURE);
+    for (int f = 0; f < numFormulas; f++) {
+        if (compilarInFixa(carga.infixas[f], &programas[f], NULL) != CALC_OK) exit(EXIT_FAILURE);
+    }
+    medirMulti("geradas", programas, numFormulas, linhas);
+    for (int f = 0; f < numFormulas; f++) liberarPrograma(&programas[f]);
+    liberarCarga(&carga);
+
+    const char *repertorio[] = {
+        "raiz(x0*x0 + x1*x1)", "(x2 - x3) / (1 + x4)", "log(x5 - 3)", "x6 * x7 - x8",
+        "sen(x9) * cos(x10)", "raiz(x11 - 5.5)", "(x0 + x1) / (x2 + x3)", "x12 ^ 2 % 7",
+        "tg(x13 * 10)", "(x14 - x15) * (x14 + x15)", "log(x0 * x1 + x2)", "x3 / (x4 - 5)",
+    };
+    const int tamanhoRepertorio = (int)(sizeof(repertorio) / sizeof(repertorio[0]));
+    unsigned long long estado = 25;
+    char texto[512];
+    for (int f = 0; f < numFormulas; f++) {
+        int termos[3];
+        for (int t = 0; t < 3; t++) {
+            estado = estado * 6364136223846793005ull + 1442695040888963407ull;
+            termos[t] = (int)((estado >> 33) % tamanhoRepertorio);
+        }
+        snprintf(texto, sizeof(texto), "%s + %s * (%s - %d)", repertorio[termos[0]], repertorio[termos[1]], repertorio[termos[2]], f % 10);
+        if (compilarInFixa(texto, &programas[f], NULL) != CALC_OK) exit(EXIT_FAILURE);
+        if (f % 10 == 3) programas[f].precisao = PRECISAO_DOUBLE;
+        if (f % 10 == 7) programas[f].matematica = MATEMATICA_RAPIDA;
+    }
+    medirMulti("montadas", programas, numFormulas, linhas);
+    for (int f = 0; f < numFormulas; f++) liberarPrograma(&programas[f]);
+    free(programas);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "escala") == 0) {
+        long linhas = argc >= 3 ? atol(argv[2]) : 10000000;
+        int maxThreads = argc >= 4 ? atoi(argv[3]) : getNumeroNucleos();
+        benchmarkEscala(linhas, maxThreads);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "conversao") == 0) {
+        benchmarkConversao(argc >= 3 ? atol(argv[2]) : 200000);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "jit") == 0) {
+        return benchmarkJit(argc >= 3 ? atol(argv[2]) : 2000000);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "precisao") == 0) {
+        benchmarkPrecisao(argc >= 3 ? atol(argv[2]) : 2000000);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "rapido") == 0) {
+        benchmarkRapido(argc >= 3 ? atol(argv[2]) : 2000000);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "tokens") == 0) {
+        benchmarkTokens(argc >= 3 ? atol(argv[2]) : 2000000);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "alocacoes") == 0) {
+        benchmarkAlocacoes(argc >= 3 ? atol(argv[2]) : 2000000);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "incremental") == 0) {
+        benchmarkIncremental(argc >= 3 ? atol(argv[2]) : 200000);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "curtas") == 0) {
+        benchmarkCurtas(argc >= 3 ? atol(argv[2]) : 2000000);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "diferencial") == 0) {
+        return executarDiferencial(argc >= 3 ? atol(argv[2]) : 200000);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "pacote") == 0) {
+        return benchmarkPacote(argc >= 3 ? atoi(argv[2]) : 50000);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "multi") == 0) {
+        benchmarkMulti(argc >= 3 ? atol(argv[2]) : 200000, argc >= 4 ? atoi(argv[3]) : 100);
+        return 0;
+    }
+
+    OpcoesSuite opcoes;
+    if (argc >= 2 && (strcmp(argv[1], "gerar") == 0 || strcmp(argv[1], "suite") == 0)) {
+        if (!lerOpcoesSuite(argc, argv, 2, &opcoes)) {
+            fprintf(stderr, "Opcoes: --expressoes N --profundidade D --variaveis V --operadores \"+-*/%%^rsctl\" --semente S\n");
+            fprintf(stderr, "        (gerar) --posfixa --sem-variaveis; (suite) --repeticoes R --cache N\n");
+            return 1;
+        }
+        if (strcmp(argv[1], "gerar") == 0) executarGerador(&opcoes);
+        else executarSuite(&opcoes);
+        return 0;
+    }
+
+    printf("Uso: %s escala [linhas] [maxThreads]\n", argv[0]);
+    printf("     %s conversao [repeticoes]\n", argv[0]);
+    printf("     %s jit [linhas]\n", argv[0]);
+    printf("     %s precisao [linhas]\n", argv[0]);
+    printf("     %s rapido [linhas]\n", argv[0]);
+    printf("     %s tokens [repeticoes]\n", argv[0]);
+    printf("     %s alocacoes [repeticoes]\n", argv[0]);
+    printf("     %s incremental [atualizacoes]\n", argv[0]);
+    printf("     %s curtas [repeticoes]\n", argv[0]);
+    printf("     %s diferencial [casos]\n", argv[0]);
+    printf("     %s pacote [formulas]\n", argv[0]);
+    printf("     %s multi [linhas] [formulas]\n", argv[0]);
+    printf("     %s gerar [opcoes do gerador] [--posfixa] [--sem-variaveis]\n", argv[0]);
+    printf("     %s suite [opcoes do gerador] [--repeticoes R] [--cache N]\n", argv[0]);
+    return 1;
+}
@@ -5,543 +5,3668 @@
 #include <string.h>
 #include <math.h>
 #include <ctype.h> // Para isspace, isdigit, isalpha
+#include <stdarg.h> // Para o relatório do perfil
+#include <stdint.h> // Para os campos de tamanho fixo do pacote de programas
+#include <stddef.h> // Para offsetof
+
+#include <pthread.h>
+#include <stdatomic.h>
+#ifdef _WIN32
+#include <windows.h> // Para GetSystemInfo e o mapeamento dos pacotes
+#else
+#include <unistd.h> // Para sysconf
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h> // Para mmap/mprotect do JIT e o mapeamento dos pacotes
+#endif
 
 #define PI 3.14159265358979323846
+#define PI_LONGO 3.14159265358979323846264338327950288L // PI do motor long double
+
+// Largura vetorial da avaliação em lote; CALC_SEM_SIMD força o caminho escalar
+#if defined(__AVX__) && !defined(CALC_SEM_SIMD)
+#include <immintrin.h>
+#define LOTE_LARGURA 8
+#define VET_TIPO __m256
+#define VET_CARREGA _mm256_loadu_ps
+#define VET_GRAVA _mm256_storeu_ps
+#define VET_SOMA _mm256_add_ps
+#define VET_SUB _mm256_sub_ps
+#define VET_MUL _mm256_mul_ps
+#define VET_DIV _mm256_div_ps
+#define VET_RAIZ _mm256_sqrt_ps
+#elif defined(__SSE2__) && !defined(CALC_SEM_SIMD)
+#include <emmintrin.h>
+#define LOTE_LARGURA 4
+#define VET_TIPO __m128
+#define VET_CARREGA _mm_loadu_ps
+#define VET_GRAVA _mm_storeu_ps
+#define VET_SOMA _mm_add_ps
+#define VET_SUB _mm_sub_ps
+#define VET_MUL _mm_mul_ps
+#define VET_DIV _mm_div_ps
+#define VET_RAIZ _mm_sqrt_ps
+#else
+#define LOTE_LARGURA 1
+#endif
+
+// ===== Códigos de erro =====
+
+// Mensagem de cada CodigoErro
+const char *mensagemErro(int codigo) {
+    switch (codigo) {
+        case CALC_OK: return "Sem erro";
+        case CALC_ERRO_DIVISAO_ZERO: return "Divisão por zero";
+        case CALC_ERRO_RAIZ_NEGATIVA: return "Raiz quadrada de número negativo";
+        case CALC_ERRO_TANGENTE: return "Tangente de ângulo invalido (90, 270 graus, etc.)";
+        case CALC_ERRO_LOG: return "Logaritmo de número não positivo";
+        case CALC_ERRO_TOKEN_DESCONHECIDO: return "Token desconhecido";
+        case CALC_ERRO_PARENTESES: return "Parênteses desbalanceados";
+        case CALC_ERRO_FALTA_OPERANDO: return "Poucos operandos para o operador";
+        case CALC_ERRO_SOBRA_OPERANDO: return "Expressão mal formada - operandos sobrando na pilha";
+        case CALC_ERRO_EXPRESSAO_VAZIA: return "Expressão vazia";
+        case CALC_ERRO_VARIAVEL_SEM_VALOR: return "Variável sem valor";
+        case CALC_ERRO_PILHA_CHEIA: return "Pilha cheia. Aumente a capacidade";
+        case CALC_ERRO_BUFFER_PEQUENO: return "Buffer de saída pequeno demais para a expressão convertida";
+        case CALC_ERRO_MEMORIA: return "Erro de alocação de memória";
+        case CALC_ERRO_JIT_INDISPONIVEL: return "JIT indisponível (só x86-64, precisão float, até 65536 registradores e 2^23 instruções)";
+        case CALC_ERRO_ARQUIVO: return "Não foi possível abrir, ler ou gravar o arquivo";
+        case CALC_ERRO_PACOTE_INVALIDO: return "Pacote de programas inválido, corrompido ou de outra versão";
+        case CALC_ERRO_NOME_LONGO: return "Nome de variável longo demais (máximo de 31 caracteres)";
+        case CALC_ERRO_INFIXA_GRANDE: return "Forma infixa grande demais (cada dup repete a subexpressão)";
+    }
+    return "Erro desconhecido";
+}
+
+// Preenche erro (se não for NULL) e devolve o código, para uso em "return falhar(...)"
+static int falhar(ErroCalc *erro, int codigo, int posicao) {
+    if (erro != NULL) {
+        erro->codigo = (CodigoErro)codigo;
+        erro->posicao = posicao;
+    }
+    return codigo;
+}
+
+// ===== Perfil (CALC_PERFIL) =====
+// Cada thread registra um bloco de contadores numa lista global na primeira medição. Os blocos não são
+// liberados (um por thread que já mediu algo), então getPerfil os soma mesmo depois que a thread terminou.
+// Sem CALC_PERFIL as macros abaixo não geram código.
+
+#ifdef CALC_PERFIL
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // Para __rdtsc
+#define PERFIL_UNIDADE "ciclos"
+static inline long long lerRelogioPerfil(void) {
+    return (long long)__rdtsc();
+}
+#else
+#include <time.h>
+#define PERFIL_UNIDADE "ns"
+static inline long long lerRelogioPerfil(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+#endif
+
+typedef struct BlocoPerfil {
+    PerfilCalc contadores;
+    long long inicioToken; // Relógio no início da leitura do token atual
+    struct BlocoPerfil *proximo;
+} BlocoPerfil;
+
+static BlocoPerfil *blocosPerfil = NULL;
+static pthread_mutex_t travaPerfil = PTHREAD_MUTEX_INITIALIZER;
+static long long custoRelogio = 0; // Menor intervalo entre duas leituras seguidas, descontado de cada medição
+static _Thread_local BlocoPerfil *perfilThread = NULL;
+
+static BlocoPerfil *registrarPerfil(void) {
+    BlocoPerfil *b = (BlocoPerfil*)calloc(1, sizeof(BlocoPerfil));
+    if (b == NULL) {
+        fprintf(stderr, "Erro de alocação de memória para o perfil.\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_lock(&travaPerfil);
+    if (blocosPerfil == NULL) {
+        long long menor = -1;
+        for (int i = 0; i < 1000; i++) {
+            long long t = lerRelogioPerfil(), d = lerRelogioPerfil() - t;
+            if (menor < 0 || d < menor) menor = d;
+        }
+        custoRelogio = menor;
+    }
+    b->proximo = blocosPerfil;
+    blocosPerfil = b;
+    pthread_mutex_unlock(&travaPerfil);
+    return perfilThread = b;
+}
+
+static inline PerfilCalc *perfilAtual(void) {
+    return &(perfilThread != NULL ? perfilThread : registrarPerfil())->contadores;
+}
+
+// Tempo desde inicio, sem o custo da leitura do relógio
+static inline long long tempoPerfil(long long inicio) {
+    long long d = lerRelogioPerfil() - inicio - custoRelogio;
+    return d > 0 ? d : 0;
+}
+
+static inline void perfilIniciarToken(void) {
+    perfilAtual();
+    perfilThread->inicioToken = lerRelogioPerfil();
+}
+
+// As duas leituras do relógio por token caem dentro do tempo da compilação; elas são descontadas de lá
+static inline int perfilContarToken(int lido) {
+    PerfilCalc *p = perfilAtual();
+    p->tokens += lido;
+    p->tempoTokens += tempoPerfil(perfilThread->inicioToken);
+    p->tempoCompilacao -= 2 * custoRelogio;
+    return lido;
+}
+
+// Idem para a avaliação direta da infixa, que não compila: o tempo vai só para os contadores dela
+static inline int perfilContarTokenDireto(int lido) {
+    PerfilCalc *p = perfilAtual();
+    p->tokensDiretos += lido;
+    p->tempoTokensDiretos += tempoPerfil(perfilThread->inicioToken);
+    return lido;
+}
+
+static inline void perfilCompilacao(long long inicio) {
+    PerfilCalc *p = perfilAtual();
+    p->compilacoes++;
+    p->tempoCompilacao += tempoPerfil(inicio);
+}
+
+static inline void perfilExecucao(int altura) {
+    PerfilCalc *p = perfilAtual();
+    p->execucoes++;
+    if (altura > p->picoPilhaExecucao) p->picoPilhaExecucao = altura;
+}
+
+static inline void perfilOperacao(int op, long long vezes, long long inicio) {
+    PerfilCalc *p = perfilAtual();
+    p->operacoes[op] += vezes;
+    p->tempoOperacoes[op] += tempoPerfil(inicio);
+}
+
+static inline void perfilPilhaOp(int altura) {
+    PerfilCalc *p = perfilAtual();
+    if (altura > p->picoPilhaOp) p->picoPilhaOp = altura;
+}
+
+#define PERFIL_INICIO(t) long long t = lerRelogioPerfil()
+#define PERFIL_COMPILACAO(t) perfilCompilacao(t)
+#define PERFIL_EXECUCAO(altura) perfilExecucao(altura)
+#define PERFIL_OPERACAO(op, vezes, t) perfilOperacao(op, vezes, t)
+#define PERFIL_PILHA_OP(altura) perfilPilhaOp(altura)
+#define PERFIL_AVALIACAO_DIRETA() (perfilAtual()->avaliacoesDiretas++)
+// Lê um token com ler (lerTokenInFixa ou lerTokenPosFixa), contando o token e o tempo gasto
+#define LER_TOKEN(ler, cursor, fim, token) (perfilIniciarToken(), perfilContarToken(ler(cursor, fim, token)))
+#define LER_TOKEN_DIRETO(ler, cursor, fim, token) (perfilIniciarToken(), perfilContarTokenDireto(ler(cursor, fim, token)))
+#else
+#define PERFIL_INICIO(t)
+#define PERFIL_COMPILACAO(t)
+#define PERFIL_EXECUCAO(altura)
+#define PERFIL_OPERACAO(op, vezes, t)
+#define PERFIL_PILHA_OP(altura)
+#define PERFIL_AVALIACAO_DIRETA()
+#define LER_TOKEN(ler, cursor, fim, token) ler(cursor, fim, token)
+#define LER_TOKEN_DIRETO(ler, cursor, fim, token) ler(cursor, fim, token)
+#endif
+
+// ===== Tokens =====
+
+// Trecho da entrada (ponteiro e comprimento): os tokens apontam para o texto original, sem cópia nem '\0'
+typedef struct {
+    const char *inicio;
+    int tamanho;
+} Trecho;
+
+// Converte o trecho em número se ele for um número completo; aceitaVirgula trata ',' como '.'
+static int converterNumero(Trecho t, int aceitaVirgula, double *valor) {
+    char numero[64];
+    char *endptr;
+    if (t.tamanho == 0 || t.tamanho >= (int)sizeof(numero) || isspace((unsigned char)t.inicio[0])) return 0;
+    for (int i = 0; i < t.tamanho; i++) {
+        numero[i] = (aceitaVirgula && t.inicio[i] == ',') ? '.' : t.inicio[i];
+    }
+    numero[t.tamanho] = '\0';
+    double v = strtod(numero, &endptr);
+    if (endptr != numero + t.tamanho) return 0;
+    *valor = v;
+    return 1;
+}
+
+// Verifica se o caractere pode iniciar um nome; "sen30" continua sendo sen(30), mas "seno" é variável
+static int iniciaNome(char c) {
+    return isalpha((unsigned char)c) || c == '_';
+}
+
+// Verifica se o caractere pode continuar um nome (variável ou função)
+static int continuaNome(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// Caminho rápido de converterNumero: sinal opcional, até 15 dígitos e um separador decimal.
+// m / 10^k com m < 10^15 e k <= 15 é uma divisão exata arredondada uma vez, então o valor é o mesmo de strtod.
+// Retorna 0 se o trecho tiver outra forma (expoente, hexadecimal, inf...), para o chamador usar strtod.
+static int converterNumeroRapido(Trecho t, int aceitaVirgula, double *valor) {
+    static const double potencia10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+    const char *p = t.inicio, *fim = t.inicio + t.tamanho;
+    int negativo = 0, digitos = 0, decimais = -1;
+    long long m = 0;
+    if (p < fim && (*p == '+' || *p == '-')) negativo = *p++ == '-';
+    for (; p < fim; p++) {
+        if (*p >= '0' && *p <= '9') {
+            if (++digitos > 15) return 0;
+            m = m * 10 + (*p - '0');
+            if (decimais >= 0) decimais++;
+        } else if ((*p == '.' || (aceitaVirgula && *p == ',')) && decimais < 0) {
+            decimais = 0;
+        } else {
+            return 0;
+        }
+    }
+    if (digitos == 0) return 0;
+    double v = decimais > 0 ? (double)m / potencia10[decimais] : (double)m;
+    *valor = negativo ? -v : v;
+    return 1;
+}
+
+// strtod também aceita inf, infinity e nan, que o lexer veria como nomes
+static int podeSerNumeroNomeado(char c) {
+    return c == 'i' || c == 'I' || c == 'n' || c == 'N';
+}
+
+// Opcode do operador de um caractere, ou -1
+static int opcodeOperador(char c) {
+    switch (c) {
+        case '+': return OP_SOMA;
+        case '-': return OP_SUB;
+        case '*': return OP_MUL;
+        case '/': return OP_DIV;
+        case '%': return OP_MOD;
+        case '^': return OP_POT;
+    }
+    return -1;
+}
+
+// Opcode da função de nome [p, p + n), ou -1. O primeiro caractere já separa as cinco funções (hash perfeito),
+// então basta comparar o resto do nome com uma só candidata.
+static int opcodeFuncao(const char *p, int n) {
+    switch (p[0]) {
+        case 'r': return n == 4 && memcmp(p, "raiz", 4) == 0 ? OP_RAIZ : -1;
+        case 's': return n == 3 && p[1] == 'e' && p[2] == 'n' ? OP_SEN : -1;
+        case 'c': return n == 3 && p[1] == 'o' && p[2] == 's' ? OP_COS : -1;
+        case 't': return n == 2 && p[1] == 'g' ? OP_TG : -1;
+        case 'l': return n == 3 && p[1] == 'o' && p[2] == 'g' ? OP_LOG : -1;
+    }
+    return -1;
+}
+
+// "dup" é o token de OP_DUP na pós-fixa (é como escreverProgramaPosFixa o escreve), então não pode ser nome de variável
+static int ehNomeDup(const char *p, int n) {
+    return n == 3 && memcmp(p, "dup", 3) == 0;
+}
+
+typedef enum {
+    TOKEN_NUMERO, // valor já convertido
+    TOKEN_OPERADOR, // op é o OpCode do operador ou da função
+    TOKEN_VARIAVEL,
+    TOKEN_ABRE, // '(' (só na infixa)
+    TOKEN_FECHA, // ')' (só na infixa)
+    TOKEN_DESCONHECIDO
+} TipoToken;
+
+// Token tipado: o lexer classifica o token e converte o número na mesma passada sobre o texto
+typedef struct {
+    Trecho texto;
+    TipoToken tipo;
+    int op;
+    double valor;
+} Token;
+
+// Lê o próximo token da expressão infixa em [*cursor, fim) (espaços entre tokens são opcionais); retorna 0 no fim.
+// Escolhe o tipo pelo primeiro caractere. ',' vale como separador decimal, como '.'.
+static int lerTokenInFixa(const char **cursor, const char *fim, Token *token) {
+    const char *p = *cursor;
+    while (p < fim && isspace((unsigned char)*p)) p++;
+    if (p == fim) {
+        *cursor = p;
+        return 0;
+    }
+
+    char c = *p;
+    token->texto.inicio = p;
+    token->tipo = TOKEN_DESCONHECIDO;
+    if (isdigit((unsigned char)c) || ((c == '.' || c == ',') && p + 1 < fim && isdigit((unsigned char)p[1]))) {
+        while (p < fim && (isdigit((unsigned char)*p) || *p == '.' || *p == ',')) p++;
+        token->texto.tamanho = (int)(p - token->texto.inicio);
+        if (converterNumeroRapido(token->texto, 1, &token->valor) || converterNumero(token->texto, 1, &token->valor)) {
+            token->tipo = TOKEN_NUMERO;
+        }
+    } else if (iniciaNome(c)) {
+        // Um nome de função vale como função se não vier seguido de letra ou '_' (sen30 é sen 30; seno é variável)
+        const char *letras = p;
+        while (letras < fim && (isalpha((unsigned char)*letras) || *letras == '_')) letras++;
+        if ((token->op = opcodeFuncao(p, (int)(letras - p))) >= 0) {
+            p = letras;
+            token->tipo = TOKEN_OPERADOR;
+        } else {
+            while (p < fim && continuaNome(*p)) p++;
+            token->tipo = TOKEN_VARIAVEL;
+        }
+        token->texto.tamanho = (int)(p - token->texto.inicio);
+        if (token->tipo == TOKEN_VARIAVEL && podeSerNumeroNomeado(c) && converterNumero(token->texto, 1, &token->valor)) {
+            token->tipo = TOKEN_NUMERO;
+        } else if (token->tipo == TOKEN_VARIAVEL && ehNomeDup(token->texto.inicio, token->texto.tamanho)) {
+            token->tipo = TOKEN_DESCONHECIDO; // Reservado: não há dup na infixa
+        }
+    } else {
+        p++;
+        token->texto.tamanho = 1;
+        if (c == '(') token->tipo = TOKEN_ABRE;
+        else if (c == ')') token->tipo = TOKEN_FECHA;
+        else if ((token->op = opcodeOperador(c)) >= 0) token->tipo = TOKEN_OPERADOR;
+    }
+
+    *cursor = p;
+    return 1;
+}
+
+// Lê o próximo token da expressão pós-fixa em [*cursor, fim), delimitado por espaços; retorna 0 no fim.
+// Números podem ter sinal e qualquer forma aceita por strtod.
+static int lerTokenPosFixa(const char **cursor, const char *fim, Token *token) {
+    const char *p = *cursor;
+    while (p < fim && *p == ' ') p++;
+    if (p == fim) {
+        *cursor = p;
+        return 0;
+    }
+    const char *inicio = p;
+    while (p < fim && *p != ' ') p++;
+    *cursor = p;
+
+    Trecho t = { inicio, (int)(p - inicio) };
+    char c = inicio[0];
+    token->texto = t;
+    token->tipo = TOKEN_DESCONHECIDO;
+    if ((isdigit((unsigned char)c) || c == '.' || c == '+' || c == '-' || podeSerNumeroNomeado(c)) &&
+        (converterNumeroRapido(t, 0, &token->valor) || converterNumero(t, 0, &token->valor))) {
+        token->tipo = TOKEN_NUMERO;
+    } else if (t.tamanho == 1 && (token->op = opcodeOperador(c)) >= 0) {
+        token->tipo = TOKEN_OPERADOR;
+    } else if (iniciaNome(c)) {
+        int i = 1;
+        while (i < t.tamanho && continuaNome(inicio[i])) i++;
+        if (i == t.tamanho && ehNomeDup(inicio, t.tamanho)) {
+            token->op = OP_DUP;
+            token->tipo = TOKEN_OPERADOR;
+        } else if (i == t.tamanho) {
+            token->tipo = (token->op = opcodeFuncao(inicio, t.tamanho)) >= 0 ? TOKEN_OPERADOR : TOKEN_VARIAVEL;
+        }
+    }
+    return 1;
+}
+
+// Conta os tokens de [Str, Str + n); retorna o número de tokens, ou -1 no primeiro token desconhecido
+int contarTokensN(const char *Str, int n, int posFixa, ErroCalc *erro) {
+    const char *cursor = Str, *fim = Str + n;
+    Token token;
+    int total = 0;
+    while (posFixa ? lerTokenPosFixa(&cursor, fim, &token) : lerTokenInFixa(&cursor, fim, &token)) {
+        if (token.tipo == TOKEN_DESCONHECIDO) {
+            falhar(erro, CALC_ERRO_TOKEN_DESCONHECIDO, (int)(token.texto.inicio - Str));
+            return -1;
+        }
+        total++;
+    }
+    return total;
+}
+
+// ===== Contexto de avaliação (arena) =====
+// Um bloco principal com alocação por incremento de ponteiro. Pedidos que não cabem nele vão para blocos
+// extras; ao reiniciar, os extras são liberados e o principal cresce até o pico de uso, então depois das
+// primeiras expressões as alocações saem só do bloco principal.
+
+#define CONTEXTO_CAPACIDADE_PADRAO (64 * 1024)
+#define CONTEXTO_ALINHAMENTO 16 // Suficiente para double, long double e os vetores SSE
+
+typedef struct BlocoExtra {
+    struct BlocoExtra *proximo;
+} BlocoExtra;
+
+// Espaço do cabeçalho de um bloco extra, mantendo os dados alinhados
+#define CABECALHO_EXTRA ((sizeof(BlocoExtra) + CONTEXTO_ALINHAMENTO - 1) & ~(size_t)(CONTEXTO_ALINHAMENTO - 1))
+
+struct ContextoCalc {
+    char *bloco;
+    long capacidade, usado;
+    long usadoExtras; // Bytes entregues pelos blocos extras desde a última reinicialização
+    long pico; // Maior uso (principal + extras) entre duas reinicializações
+    BlocoExtra *extras;
+    long alocacoes; // Pedidos de memória ao sistema (malloc), inclusive o da criação
+};
+
+ContextoCalc *criarContexto(long capacidade) {
+    ContextoCalc *ctx = (ContextoCalc*)calloc(1, sizeof(ContextoCalc));
+    if (ctx == NULL) return NULL;
+    ctx->capacidade = capacidade > 0 ? capacidade : CONTEXTO_CAPACIDADE_PADRAO;
+    if ((ctx->bloco = (char*)malloc(ctx->capacidade)) == NULL) {
+        free(ctx);
+        return NULL;
+    }
+    ctx->alocacoes = 2;
+    return ctx;
+}
+
+static void liberarExtras(ContextoCalc *ctx) {
+    while (ctx->extras != NULL) {
+        BlocoExtra *proximo = ctx->extras->proximo;
+        free(ctx->extras);
+        ctx->extras = proximo;
+    }
+    ctx->usadoExtras = 0;
+}
+
+void liberarContexto(ContextoCalc *ctx) {
+    if (ctx == NULL) return;
+    liberarExtras(ctx);
+    free(ctx->bloco);
+    free(ctx);
+}
+
+void reiniciarContexto(ContextoCalc *ctx) {
+    if (ctx == NULL) return;
+    if (ctx->extras != NULL) {
+        liberarExtras(ctx);
+        long capacidade = ctx->capacidade;
+        while (capacidade < ctx->pico) capacidade *= 2;
+        char *bloco = (char*)malloc(capacidade);
+        if (bloco != NULL) { // Sem memória, continua com o bloco antigo e os extras
+            free(ctx->bloco);
+            ctx->bloco = bloco;
+            ctx->capacidade = capacidade;
+            ctx->alocacoes++;
+        }
+    }
+    ctx->usado = 0;
+}
+
+void *alocarContexto(ContextoCalc *ctx, long bytes) {
+    if (ctx == NULL) return malloc(bytes);
+    bytes = (bytes + CONTEXTO_ALINHAMENTO - 1) & ~(long)(CONTEXTO_ALINHAMENTO - 1);
+    void *p;
+    if (ctx->usado + bytes <= ctx->capacidade) {
+        p = ctx->bloco + ctx->usado;
+        ctx->usado += bytes;
+    } else {
+        BlocoExtra *extra = (BlocoExtra*)malloc(CABECALHO_EXTRA + bytes);
+        if (extra == NULL) return NULL;
+        extra->proximo = ctx->extras;
+        ctx->extras = extra;
+        ctx->usadoExtras += bytes;
+        ctx->alocacoes++;
+        p = (char*)extra + CABECALHO_EXTRA;
+    }
+    if (ctx->usado + ctx->usadoExtras > ctx->pico) ctx->pico = ctx->usado + ctx->usadoExtras;
+    return p;
+}
+
+void getEstatisticasContexto(const ContextoCalc *ctx, EstatisticasContexto *estatisticas) {
+    memset(estatisticas, 0, sizeof(*estatisticas));
+    if (ctx == NULL) return;
+    estatisticas->alocacoes = ctx->alocacoes;
+    estatisticas->capacidade = ctx->capacidade;
+    estatisticas->pico = ctx->pico;
+}
+
+// Libera p se veio de malloc (ctx NULL); memória do contexto só volta na reinicialização
+static void liberarMemoria(ContextoCalc *ctx, void *p) {
+    if (ctx == NULL) free(p);
+}
+
+// ===== Pilha compacta de operadores (para conversão infixa/posfixa) =====
+#define PILHA_OP_LOCAL 512 // Operadores que cabem na própria PilhaOp; acima disso, os vetores são alocados
+#define OP_PARENTESE 0xFF // Marca de '(' na pilha de operadores
+
+typedef struct {
+    unsigned char *items; // OpCode de cada operador, ou OP_PARENTESE
+    int *posicoes; // Posição do token de cada operador na entrada
+    int top;
+    unsigned char itemsLocal[PILHA_OP_LOCAL];
+    int posicoesLocal[PILHA_OP_LOCAL];
+} PilhaOp;
+
+static void liberarPilhaOp(ContextoCalc *ctx, PilhaOp *s) {
+    if (s->items != s->itemsLocal) liberarMemoria(ctx, s->items);
+    if (s->posicoes != s->posicoesLocal) liberarMemoria(ctx, s->posicoes);
+}
+
+// Prepara s para até capacidade operadores, tirando os vetores maiores de ctx (NULL: malloc); retorna 0 se faltar memória
+static int iniciarPilhaOp(ContextoCalc *ctx, PilhaOp *s, int capacidade) {
+    s->top = -1;
+    if (capacidade <= PILHA_OP_LOCAL) {
+        s->items = s->itemsLocal;
+        s->posicoes = s->posicoesLocal;
+        return 1;
+    }
+    s->items = (unsigned char*)alocarContexto(ctx, capacidade);
+    s->posicoes = (int*)alocarContexto(ctx, capacidade * sizeof(int));
+    if (s->items == NULL || s->posicoes == NULL) {
+        liberarPilhaOp(ctx, s);
+        return 0;
+    }
+    return 1;
+}
+
+// Empilha op; a pilha foi iniciada com um lugar por token, então nunca enche
+void pushOp(PilhaOp* s, int op, int posicao) {
+    s->items[++s->top] = (unsigned char)op;
+    s->posicoes[s->top] = posicao;
+    PERFIL_PILHA_OP(s->top + 1);
+}
+
+// Os chamadores só desempilham depois de testar isEmptyOp
+int popOp(PilhaOp* s) {
+    return s->items[s->top--];
+}
+
+int peekOp(PilhaOp* s) {
+    return s->items[s->top];
+}
+
+int isEmptyOp(PilhaOp* s) {
+    return s->top == -1;
+}
+
+// Prioridade dos operadores, indexada por OpCode
+static const unsigned char prioridadeOp[] = {
+    [OP_SOMA] = 1, [OP_SUB] = 1,
+    [OP_MUL] = 2, [OP_DIV] = 2, [OP_MOD] = 2,
+    [OP_POT] = 3,
+    [OP_RAIZ] = 4, [OP_SEN] = 4, [OP_COS] = 4, [OP_TG] = 4, [OP_LOG] = 4,
+};
+
+// Texto de cada operador, indexado por OpCode
+static const char *const nomeOp[] = {
+    [OP_SOMA] = "+", [OP_SUB] = "-", [OP_MUL] = "*", [OP_DIV] = "/", [OP_MOD] = "%", [OP_POT] = "^",
+    [OP_RAIZ] = "raiz", [OP_SEN] = "sen", [OP_COS] = "cos", [OP_TG] = "tg", [OP_LOG] = "log",
+    [OP_DUP] = "dup",
+};
+
+static int ehFuncaoOp(int op) {
+    return op >= OP_RAIZ && op <= OP_LOG;
+}
+
+// Verifica se o operador no topo da pilha deve ser desempilhado antes de empilhar op (binário)
+static int desempilhaAntes(PilhaOp *pilha, int op) {
+    if (isEmptyOp(pilha) || peekOp(pilha) == OP_PARENTESE) return 0;
+    int topo = peekOp(pilha);
+    return prioridadeOp[topo] > prioridadeOp[op] || (prioridadeOp[topo] == prioridadeOp[op] && op != OP_POT);
+}
+
+// ===== Programa compilado (bytecode) =====
+
+// Zera prog e reserva espaço para até capacidade instruções, no contexto ctx (NULL: malloc)
+static int iniciarPrograma(ContextoCalc *ctx, Programa *prog, int capacidade, ErroCalc *erro) {
+    prog->tamanho = 0;
+    prog->numConstantes = 0;
+    prog->profundidade = 0;
+    prog->precisao = PRECISAO_FLOAT;
+    prog->matematica = MATEMATICA_EXATA;
+    prog->variaveis = NULL;
+    prog->numVariaveis = 0;
+    prog->contexto = ctx;
+    prog->codigo = (Instrucao*)alocarContexto(ctx, capacidade * sizeof(Instrucao));
+    prog->constantes = (double*)alocarContexto(ctx, capacidade * sizeof(double));
+    prog->posicoes = (int*)alocarContexto(ctx, capacidade * sizeof(int));
+    if (prog->codigo == NULL || prog->constantes == NULL || prog->posicoes == NULL) {
+        liberarPrograma(prog);
+        return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    }
+    return CALC_OK;
+}
+
+// Acrescenta uma instrução a prog, conferindo operandos e a altura da pilha de execução
+static int emitir(Programa *prog, int op, int arg, int posicao, int *altura, ErroCalc *erro) {
+    if (op == OP_NUM || op == OP_VAR) {
+        (*altura)++;
+    } else if (op == OP_DUP) {
+        if (*altura < 1) return falhar(erro, CALC_ERRO_FALTA_OPERANDO, posicao);
+        (*altura)++;
+    } else if (ehFuncaoOp(op)) {
+        if (*altura < 1) return falhar(erro, CALC_ERRO_FALTA_OPERANDO, posicao);
+    } else {
+        if (*altura < 2) return falhar(erro, CALC_ERRO_FALTA_OPERANDO, posicao);
+        (*altura)--;
+    }
+    if (*altura > prog->profundidade) prog->profundidade = *altura;
+
+    prog->codigo[prog->tamanho].op = (OpCode)op;
+    prog->codigo[prog->tamanho].arg = arg;
+    prog->posicoes[prog->tamanho] = posicao;
+    prog->tamanho++;
+    return CALC_OK;
+}
+
+// Emite o empilhamento de uma constante
+static int emitirConstante(Programa *prog, double valor, int posicao, int *altura, ErroCalc *erro) {
+    prog->constantes[prog->numConstantes] = valor;
+    return emitir(prog, OP_NUM, prog->numConstantes++, posicao, altura, erro);
+}
+
+// Busca dos nomes de variáveis durante a compilação: linear enquanto há poucas, depois por uma tabela hash
+// (endereçamento aberto) dimensionada pelo número de tokens, para expressões geradas com milhares de variáveis
+#define VARIAVEIS_BUSCA_LINEAR 16
+
+typedef struct {
+    int *tabela; // Slot de cada posição, ou -1; NULL enquanto a busca é linear
+    unsigned mascara;
+    int maxTokens; // Limite do número de variáveis, usado para dimensionar a tabela
+} IndiceVariaveis;
+
+static unsigned hashNome(const char *nome) {
+    unsigned h = 2166136261u; // FNV-1a de 32 bits
+    while (*nome) h = (h ^ (unsigned char)*nome++) * 16777619u;
+    return h;
+}
+
+// Posição de nome na tabela: a do slot que o contém, ou a vaga onde ele entraria
+static unsigned posicaoNome(const Programa *prog, const IndiceVariaveis *indice, const char *nome) {
+    unsigned i = hashNome(nome) & indice->mascara;
+    while (indice->tabela[i] >= 0 && strcmp(prog->variaveis[indice->tabela[i]], nome) != 0) i = (i + 1) & indice->mascara;
+    return i;
+}
+
+// Cria a tabela com os slots já existentes; retorna 0 se faltar memória
+static int criarTabelaVariaveis(const Programa *prog, IndiceVariaveis *indice) {
+    unsigned tamanho = 1;
+    while (tamanho < 2u * (unsigned)indice->maxTokens) tamanho *= 2;
+    if ((indice->tabela = (int*)alocarContexto(prog->contexto, tamanho * sizeof(int))) == NULL) return 0;
+    memset(indice->tabela, 0xFF, tamanho * sizeof(int));
+    indice->mascara = tamanho - 1;
+    for (int slot = 0; slot < prog->numVariaveis; slot++) {
+        indice->tabela[posicaoNome(prog, indice, prog->variaveis[slot])] = slot;
+    }
+    return 1;
+}
+
+// Emite o empilhamento de uma variável, criando o slot na primeira ocorrência. Nomes que não cabem em
+// TAM_NOME_VARIAVEL são recusados: truncados, dois nomes com o mesmo prefixo cairiam no mesmo slot
+static int emitirVariavel(Programa *prog, IndiceVariaveis *indice, Trecho t, int posicao, int *altura, ErroCalc *erro) {
+    if (t.tamanho > TAM_NOME_VARIAVEL - 1) return falhar(erro, CALC_ERRO_NOME_LONGO, posicao);
+    char nome[TAM_NOME_VARIAVEL];
+    memcpy(nome, t.inicio, t.tamanho);
+    nome[t.tamanho] = '\0';
+
+    if (indice->tabela == NULL && prog->numVariaveis >= VARIAVEIS_BUSCA_LINEAR && !criarTabelaVariaveis(prog, indice)) {
+        return falhar(erro, CALC_ERRO_MEMORIA, posicao);
+    }
+    unsigned vaga = indice->tabela != NULL ? posicaoNome(prog, indice, nome) : 0;
+    int slot = indice->tabela != NULL ? indice->tabela[vaga] : getIndiceVariavel(prog, nome);
+    if (slot < 0) {
+        if ((prog->numVariaveis & (prog->numVariaveis - 1)) == 0) { // Capacidade dobra em potências de 2
+            int capacidade = prog->numVariaveis ? prog->numVariaveis * 2 : 1;
+            char (*novas)[TAM_NOME_VARIAVEL];
+            if (prog->contexto == NULL) {
+                novas = (char(*)[TAM_NOME_VARIAVEL])realloc(prog->variaveis, capacidade * TAM_NOME_VARIAVEL);
+            } else if ((novas = (char(*)[TAM_NOME_VARIAVEL])alocarContexto(prog->contexto, capacidade * TAM_NOME_VARIAVEL)) != NULL) {
+                if (prog->numVariaveis > 0) memcpy(novas, prog->variaveis, prog->numVariaveis * TAM_NOME_VARIAVEL);
+            }
+            if (novas == NULL) return falhar(erro, CALC_ERRO_MEMORIA, posicao);
+            prog->variaveis = novas;
+        }
+        slot = prog->numVariaveis++;
+        strcpy(prog->variaveis[slot], nome);
+        if (indice->tabela != NULL) indice->tabela[vaga] = slot;
+    }
+    return emitir(prog, OP_VAR, slot, posicao, altura, erro);
+}
+
+// Confere o estado final da pilha de execução
+static int finalizarPrograma(int altura, int posicaoFinal, ErroCalc *erro) {
+    if (altura == 0) return falhar(erro, CALC_ERRO_EXPRESSAO_VAZIA, posicaoFinal);
+    if (altura != 1) return falhar(erro, CALC_ERRO_SOBRA_OPERANDO, posicaoFinal);
+    return CALC_OK;
+}
+
+// Compila a expressão pós-fixa em [Str, Str + n); os tokens são lidos no próprio texto, sem cópia
+int compilarPosFixaContexto(ContextoCalc *ctx, const char *Str, int n, Programa *prog, ErroCalc *erro) {
+    PERFIL_INICIO(inicioPerfil);
+    // Cada token gera no máximo uma instrução e tem ao menos um caractere
+    int cod = iniciarPrograma(ctx, prog, n + 1, erro);
+    if (cod != CALC_OK) return cod;
+
+    int altura = 0;
+    IndiceVariaveis indice = { NULL, 0, n + 1 };
+    const char *cursor = Str, *fim = Str + n;
+    Token token;
+
+    while (cod == CALC_OK && LER_TOKEN(lerTokenPosFixa, &cursor, fim, &token)) {
+        int posicao = (int)(token.texto.inicio - Str);
+        switch (token.tipo) {
+            case TOKEN_NUMERO: cod = emitirConstante(prog, token.valor, posicao, &altura, erro); break;
+            case TOKEN_OPERADOR: cod = emitir(prog, token.op, 0, posicao, &altura, erro); break;
+            case TOKEN_VARIAVEL: cod = emitirVariavel(prog, &indice, token.texto, posicao, &altura, erro); break;
+            default: cod = falhar(erro, CALC_ERRO_TOKEN_DESCONHECIDO, posicao); break;
+        }
+    }
+
+    if (cod == CALC_OK) cod = finalizarPrograma(altura, n, erro);
+    liberarMemoria(ctx, indice.tabela);
+    if (cod != CALC_OK) liberarPrograma(prog);
+    PERFIL_COMPILACAO(inicioPerfil);
+    return cod;
+}
+
+// Compila a expressão infixa em [Str, Str + n) pelo algoritmo shunting-yard, sem copiar o texto
+int compilarInFixaContexto(ContextoCalc *ctx, const char *Str, int n, Programa *prog, ErroCalc *erro) {
+    PERFIL_INICIO(inicioPerfil);
+    int cod = iniciarPrograma(ctx, prog, n + 1, erro);
+    if (cod != CALC_OK) return cod;
+
+    PilhaOp pilha;
+    if (!iniciarPilhaOp(ctx, &pilha, n + 1)) {
+        liberarPrograma(prog);
+        return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    }
+    int altura = 0;
+    IndiceVariaveis indice = { NULL, 0, n + 1 };
+
+    const char *expr_ptr = Str, *fim = Str + n;
+    Token token;
+
+    while (cod == CALC_OK && LER_TOKEN(lerTokenInFixa, &expr_ptr, fim, &token)) {
+        int posicao = (int)(token.texto.inicio - Str);
+        int op = token.tipo == TOKEN_OPERADOR ? token.op : -1;
+
+        if (token.tipo == TOKEN_NUMERO) {
+            cod = emitirConstante(prog, token.valor, posicao, &altura, erro);
+        } else if (ehFuncaoOp(op)) {
+            pushOp(&pilha, op, posicao);
+        } else if (token.tipo == TOKEN_ABRE) {
+            pushOp(&pilha, OP_PARENTESE, posicao);
+        } else if (token.tipo == TOKEN_FECHA) {
+            while (cod == CALC_OK && !isEmptyOp(&pilha) && peekOp(&pilha) != OP_PARENTESE) {
+                int p = pilha.posicoes[pilha.top];
+                cod = emitir(prog, popOp(&pilha), 0, p, &altura, erro);
+            }
+            if (cod == CALC_OK) {
+                if (isEmptyOp(&pilha)) {
+                    cod = falhar(erro, CALC_ERRO_PARENTESES, posicao);
+                } else {
+                    popOp(&pilha);
+                    if (!isEmptyOp(&pilha) && ehFuncaoOp(peekOp(&pilha))) {
+                        int p = pilha.posicoes[pilha.top];
+                        cod = emitir(prog, popOp(&pilha), 0, p, &altura, erro);
+                    }
+                }
+            }
+        } else if (op >= 0) {
+            while (cod == CALC_OK && desempilhaAntes(&pilha, op)) {
+                int p = pilha.posicoes[pilha.top];
+                cod = emitir(prog, popOp(&pilha), 0, p, &altura, erro);
+            }
+            if (cod == CALC_OK) pushOp(&pilha, op, posicao);
+        } else if (token.tipo == TOKEN_VARIAVEL) {
+            cod = emitirVariavel(prog, &indice, token.texto, posicao, &altura, erro);
+        } else {
+            cod = falhar(erro, CALC_ERRO_TOKEN_DESCONHECIDO, posicao);
+        }
+    }
+
+    while (cod == CALC_OK && !isEmptyOp(&pilha)) {
+        int p = pilha.posicoes[pilha.top];
+        cod = (peekOp(&pilha) == OP_PARENTESE) ? falhar(erro, CALC_ERRO_PARENTESES, p)
+                                                : emitir(prog, popOp(&pilha), 0, p, &altura, erro);
+    }
+
+    if (cod == CALC_OK) cod = finalizarPrograma(altura, n, erro);
+    liberarPilhaOp(ctx, &pilha);
+    liberarMemoria(ctx, indice.tabela);
+    if (cod != CALC_OK) liberarPrograma(prog);
+    PERFIL_COMPILACAO(inicioPerfil);
+    return cod;
+}
+
+int compilarPosFixaN(const char *Str, int n, Programa *prog, ErroCalc *erro) {
+    return compilarPosFixaContexto(NULL, Str, n, prog, erro);
+}
+
+int compilarInFixaN(const char *Str, int n, Programa *prog, ErroCalc *erro) {
+    return compilarInFixaContexto(NULL, Str, n, prog, erro);
+}
+
+// Compila uma expressão pós-fixada em um programa de opcodes com constantes pré-convertidas
+int compilarPosFixa(const char *StrPosFixa, Programa *prog, ErroCalc *erro) {
+    return compilarPosFixaN(StrPosFixa, (int)strlen(StrPosFixa), prog, erro);
+}
+
+// Compila uma expressão infixa direto em opcodes, sem passar pelo texto pós-fixo
+int compilarInFixa(const char *StrInFixa, Programa *prog, ErroCalc *erro) {
+    return compilarInFixaN(StrInFixa, (int)strlen(StrInFixa), prog, erro);
+}
+
+// Retorna o slot da variável nome em prog, ou -1 se a expressão não a usa
+int getIndiceVariavel(const Programa *prog, const char *nome) {
+    for (int i = 0; i < prog->numVariaveis; i++) {
+        if (strcmp(prog->variaveis[i], nome) == 0) return i;
+    }
+    return -1;
+}
+
+// ===== Núcleos rápidos de sen, cos, tg e log (MATEMATICA_RAPIDA) =====
+// O ângulo em graus é reduzido a g = 15n + r, com |r| <= 7.5 e r exato, e
+// sen(g) = sen(15n)cos(r) + cos(15n)sen(r), com sen(15n) e cos(15n) de uma tabela e sen(r), cos(r) por
+// polinômios de Taylor em double. Em múltiplos de 15 graus (30, 45, 90...) r = 0 e o resultado é o valor
+// da tabela, arredondado corretamente. log10 separa o expoente binário e usa a série de atanh na mantissa.
+// Os núcleos não têm desvios nem chamadas, então os laços do lote podem ser vetorizados.
+#define GRAUS_RAPIDO_MAX 1e9 // Acima disso (ou NaN/infinito), sen, cos e tg usam a libm
+#define ARREDONDA_DOUBLE 6755399441055744.0 // 1.5 * 2^52: (x + c) - c arredonda x para inteiro
+
+// sen(15k graus), k = 0..23; cos(15k) = sen(15(k + 6))
+static const double senTabela15[24] = {
+    0, 0.25881904510252074, 0.5, 0.70710678118654757, 0.8660254037844386, 0.96592582628906831,
+    1, 0.96592582628906831, 0.8660254037844386, 0.70710678118654757, 0.5, 0.25881904510252074,
+    0, -0.25881904510252074, -0.5, -0.70710678118654757, -0.8660254037844386, -0.96592582628906831,
+    -1, -0.96592582628906831, -0.8660254037844386, -0.70710678118654757, -0.5, -0.25881904510252074
+};
+
+// Reduz g (|g| <= GRAUS_RAPIDO_MAX) e calcula sen(g) e cos(g)
+static inline void nucleoSenCosGraus(double g, double *sen, double *cos) {
+    double n = (g * (1.0 / 15.0) + ARREDONDA_DOUBLE) - ARREDONDA_DOUBLE;
+    double x = (g - 15.0 * n) * (PI / 180.0);
+    double x2 = x * x;
+    double s = x * (1 - x2 * (1.0 / 6) * (1 - x2 * (1.0 / 20) * (1 - x2 * (1.0 / 42) * (1 - x2 * (1.0 / 72)))));
+    double c = 1 - x2 * 0.5 * (1 - x2 * (1.0 / 12) * (1 - x2 * (1.0 / 30) * (1 - x2 * (1.0 / 56) * (1 - x2 * (1.0 / 90)))));
+    int k = (int)n % 24;
+    k += k < 0 ? 24 : 0;
+    double senA = senTabela15[k], cosA = senTabela15[k < 18 ? k + 6 : k - 18];
+    *sen = senA * c + cosA * s;
+    *cos = cosA * c - senA * s;
+}
+
+static inline double nucleoSenGraus(double g) {
+    double sen, cos;
+    nucleoSenCosGraus(g, &sen, &cos);
+    return sen;
+}
+
+static inline double nucleoCosGraus(double g) {
+    double sen, cos;
+    nucleoSenCosGraus(g, &sen, &cos);
+    return cos;
+}
+
+static inline double nucleoTgGraus(double g) {
+    double sen, cos;
+    nucleoSenCosGraus(g, &sen, &cos);
+    return sen / cos + 0.0; // + 0.0 troca o -0 de tg(180) por 0
+}
+
+// log10(x) para x > 0 finito; outros valores não passam pelo teste de domínio, exceto +inf, que é devolvido
+static inline double nucleoLog10(double x) {
+    unsigned long long bits;
+    memcpy(&bits, &x, sizeof(bits));
+    // x = m * 2^e com m em [sqrt(1/2), sqrt(2))
+    bits += 0x3FF0000000000000ull - 0x3FE6A09E667F3BCDull;
+    int e = (int)(bits >> 52) - 1023;
+    bits = (bits & 0x000FFFFFFFFFFFFFull) + 0x3FE6A09E667F3BCDull;
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    // ln(m) = 2 atanh(s), s = (m - 1) / (m + 1), |s| < 0.172
+    double s = (m - 1) / (m + 1), s2 = s * s;
+    double ln = 2 * s * (1 + s2 * (1.0 / 3 + s2 * (1.0 / 5 + s2 * (1.0 / 7 + s2 * (1.0 / 9 + s2 * (1.0 / 11 +
+                s2 * (1.0 / 13 + s2 * (1.0 / 15 + s2 * (1.0 / 17 + s2 * (1.0 / 19))))))))));
+    double r = e * 0.30102999566398119521 + ln * 0.43429448190325182765;
+    return x <= 1.7976931348623157e308 ? r : x;
+}
+
+static double senGrausRapido(double g) {
+    return fabs(g) <= GRAUS_RAPIDO_MAX ? nucleoSenGraus(g) : sin(g * PI / 180.0);
+}
+
+static double cosGrausRapido(double g) {
+    return fabs(g) <= GRAUS_RAPIDO_MAX ? nucleoCosGraus(g) : cos(g * PI / 180.0);
+}
+
+static double tgGrausRapido(double g) {
+    return fabs(g) <= GRAUS_RAPIDO_MAX ? nucleoTgGraus(g) : tan(g * PI / 180.0);
+}
+
+static double log10Rapido(double x) {
+    return nucleoLog10(x);
+}
+
+// Mesmo teste de domínio de tg do modo exato (fmod(|g|, 180) a menos de 0.001 de 90), sem fmod:
+// g - 180n é exato, e seu valor absoluto dista de 90 o mesmo que fmod(|g|, 180)
+static int tangenteInvalidaRapida(double g) {
+    if (!(fabs(g) <= GRAUS_RAPIDO_MAX)) {
+        double angle_mod_180 = fmod(fabs(g), 180.0);
+        return fabs(angle_mod_180 - 90.0) < 0.001 || fabs(angle_mod_180 - 270.0) < 0.001;
+    }
+    double n = (g * (1.0 / 180.0) + ARREDONDA_DOUBLE) - ARREDONDA_DOUBLE;
+    return fabs(fabs(g - 180.0 * n) - 90.0) < 0.001;
+}
+
+// ===== Avaliação direta da infixa =====
+// Avaliação numa passada só, por descida recursiva com precedência (precedence climbing), sem compilar nem
+// alocar. A gramática é a mesma que o shunting-yard aceita,
+//     expressao := unario (binario unario)*      (+ - < * / % < ^; só ^ associa à direita)
+//     unario    := funcao unario | numero | variavel | '(' expressao ')'
+// e os operandos são calculados na mesma ordem das instruções do programa compilado, então o primeiro erro de
+// domínio é o mesmo. Depois dele, o resto da expressão só é conferido, porque um erro de sintaxe vem antes.
+// Entradas fora da gramática (ou com aninhamento além do limite, para a recursão não esgotar a pilha) voltam
+// para o caminho compilado, que dá o código e a posição exatos do erro. O motor gera o avaliador de cada precisão.
+#define AVALIACAO_DIRETA_PROFUNDIDADE 256
+
+typedef struct {
+    const char *texto, *cursor, *fim;
+    Token token; // Próximo token, ainda não consumido
+    int temToken; // 0 no fim da entrada
+    int profundidade;
+    int rapido;
+    int codigo, posicao; // Primeiro erro de execução (CALC_OK se não houve)
+} AvaliadorDireto;
+
+static void avancarDireto(AvaliadorDireto *a) {
+    a->temToken = LER_TOKEN_DIRETO(lerTokenInFixa, &a->cursor, a->fim, &a->token);
+}
+
+// Guarda o erro de execução se for o primeiro
+static void registrarErroDireto(AvaliadorDireto *a, int codigo, int posicao) {
+    if (a->codigo != CALC_OK) return;
+    a->codigo = codigo;
+    a->posicao = posicao;
+}
+
+// Motores de execução em float, double e long double, gerados a partir do mesmo código
+#define MOTOR_SUFIXO Float
+#define MOTOR_TIPO float
+#define MOTOR_ENTRADA float
+#define MOTOR_CALC double
+#define MOTOR_PI PI
+#define MOTOR_SQRT sqrt
+#define MOTOR_SIN sin
+#define MOTOR_COS cos
+#define MOTOR_TAN tan
+#define MOTOR_POW pow
+#define MOTOR_FMOD fmod
+#define MOTOR_LOG10 log10
+#define MOTOR_FABS fabs
+#define MOTOR_RAPIDO 1
+#include "calculadora_motor.h"
+
+#define MOTOR_SUFIXO Double
+#define MOTOR_TIPO double
+#define MOTOR_ENTRADA double
+#define MOTOR_CALC double
+#define MOTOR_PI PI
+#define MOTOR_SQRT sqrt
+#define MOTOR_SIN sin
+#define MOTOR_COS cos
+#define MOTOR_TAN tan
+#define MOTOR_POW pow
+#define MOTOR_FMOD fmod
+#define MOTOR_LOG10 log10
+#define MOTOR_FABS fabs
+#define MOTOR_RAPIDO 1
+#include "calculadora_motor.h"
+
+#define MOTOR_SUFIXO LongDouble
+#define MOTOR_TIPO long double
+#define MOTOR_ENTRADA double
+#define MOTOR_CALC long double
+#define MOTOR_PI PI_LONGO
+#define MOTOR_SQRT sqrtl
+#define MOTOR_SIN sinl
+#define MOTOR_COS cosl
+#define MOTOR_TAN tanl
+#define MOTOR_POW powl
+#define MOTOR_FMOD fmodl
+#define MOTOR_LOG10 log10l
+#define MOTOR_FABS fabsl
+#define MOTOR_RAPIDO 0
+#include "calculadora_motor.h"
+
+// Aplica op na precisão e no modo de prog, com entrada e saída em double (usado pela otimização)
+static int aplicarOperacaoPrecisao(const Programa *prog, int op, double a, double b, double *resultado) {
+    int cod, rapido = prog->matematica == MATEMATICA_RAPIDA;
+    if (prog->precisao == PRECISAO_DOUBLE) return aplicarOperacaoDouble(op, a, b, rapido, resultado);
+    if (prog->precisao == PRECISAO_LONG_DOUBLE) {
+        long double r;
+        if ((cod = aplicarOperacaoLongDouble(op, a, b, rapido, &r)) == CALC_OK) *resultado = (double)r;
+        return cod;
+    }
+    float r = 0;
+    if ((cod = aplicarOperacaoFloat(op, (float)a, (float)b, rapido, &r)) == CALC_OK) *resultado = r;
+    return cod;
+}
+
+// Os valores das variáveis são convertidos no stack frame até este número de variáveis; acima disso, com malloc
+#define VALORES_LOCAIS 64
+
+// Converte n valores para float em local (ou num vetor alocado, se n > VALORES_LOCAIS); NULL se valores for NULL ou faltar memória
+static float *valoresFloat(const double *valores, int n, float *local) {
+    if (valores == NULL) return NULL;
+    float *v = n <= VALORES_LOCAIS ? local : (float*)malloc(n * sizeof(float));
+    for (int i = 0; v != NULL && i < n; i++) v[i] = (float)valores[i];
+    return v;
+}
+
+static double *valoresDouble(const float *valores, int n, double *local) {
+    if (valores == NULL) return NULL;
+    double *v = n <= VALORES_LOCAIS ? local : (double*)malloc(n * sizeof(double));
+    for (int i = 0; v != NULL && i < n; i++) v[i] = valores[i];
+    return v;
+}
+
+int executarProgramaDouble(const Programa *prog, const double *valores, double *resultado, ErroCalc *erro) {
+    int cod;
+    if (prog->precisao == PRECISAO_DOUBLE) return executarPilhaDouble(prog, valores, resultado, erro);
+    if (prog->precisao == PRECISAO_LONG_DOUBLE) {
+        long double r;
+        if ((cod = executarPilhaLongDouble(prog, valores, &r, erro)) == CALC_OK) *resultado = (double)r;
+        return cod;
+    }
+
+    float local[VALORES_LOCAIS], r;
+    float *v = valoresFloat(valores, prog->numVariaveis, local);
+    if (valores != NULL && v == NULL) return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    if ((cod = executarPilhaFloat(prog, v, &r, erro)) == CALC_OK) *resultado = r;
+    if (v != local) free(v);
+    return cod;
+}
+
+int executarPrograma(const Programa *prog, const float *valores, float *resultado, ErroCalc *erro) {
+    if (prog->precisao == PRECISAO_FLOAT) return executarPilhaFloat(prog, valores, resultado, erro);
+
+    double local[VALORES_LOCAIS], r;
+    double *v = valoresDouble(valores, prog->numVariaveis, local);
+    if (valores != NULL && v == NULL) return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    int cod = executarProgramaDouble(prog, v, &r, erro);
+    if (cod == CALC_OK) *resultado = (float)r;
+    if (v != local) free(v);
+    return cod;
+}
+
+void liberarPrograma(Programa *prog) {
+    liberarMemoria(prog->contexto, prog->codigo);
+    liberarMemoria(prog->contexto, prog->constantes);
+    liberarMemoria(prog->contexto, prog->variaveis);
+    liberarMemoria(prog->contexto, prog->posicoes);
+    prog->codigo = NULL;
+    prog->constantes = NULL;
+    prog->variaveis = NULL;
+    prog->posicoes = NULL;
+    prog->tamanho = 0;
+    prog->numConstantes = 0;
+    prog->numVariaveis = 0;
+}
+
+// Valor na pilha durante a otimização: calculado pelas instruções de saída a partir de inicio
+typedef struct {
+    int inicio;
+    int constante; // 1 se o valor é uma única OP_NUM
+    double valor;
+} ValorOtimizado;
+
+// A memória de trabalho sai de malloc e é liberada no fim: o contexto do programa (o de um pacote, por exemplo, que
+// só é liberado por fecharPacote) recebe apenas o código, as posições e as constantes finais, no tamanho exato
+int otimizarPrograma(Programa *prog) {
+    // Cada instrução gera no máximo duas de saída (x 3 ^ vira x dup dup * *)
+    int capacidade = 2 * prog->tamanho + 1;
+    ContextoCalc *ctx = prog->contexto;
+    Instrucao *codigo = (Instrucao*)malloc(capacidade * sizeof(Instrucao));
+    int *posicoes = (int*)malloc(capacidade * sizeof(int));
+    double *valores = (double*)malloc(capacidade * sizeof(double)); // Constante de cada OP_NUM de saída
+    ValorOtimizado *pilha = (ValorOtimizado*)malloc(capacidade * sizeof(ValorOtimizado));
+    // Vetor novo de constantes: o de um programa carregado de um pacote aponta para memória só de leitura
+    double *constantes = (double*)malloc((prog->numConstantes + 1) * sizeof(double));
+    int top = -1, m = 0, cod = CALC_OK;
+    if (codigo == NULL || posicoes == NULL || valores == NULL || pilha == NULL || constantes == NULL) {
+        cod = CALC_ERRO_MEMORIA;
+        goto fim;
+    }
+
+#define EMITIR(operacao, argumento, posicao) \
+    (codigo[m].op = (OpCode)(operacao), codigo[m].arg = (argumento), posicoes[m] = (posicao), m++)
+
+    for (int k = 0; k < prog->tamanho; k++) {
+        int op = prog->codigo[k].op, posicao = prog->posicoes[k];
+        double r;
+        if (op == OP_NUM || op == OP_VAR || op == OP_DUP) {
+            ValorOtimizado *v = &pilha[++top];
+            v->inicio = m;
+            v->constante = op == OP_NUM;
+            v->valor = op == OP_NUM ? prog->constantes[prog->codigo[k].arg] : 0;
+            if (op == OP_NUM) valores[m] = v->valor;
+            EMITIR(op, prog->codigo[k].arg, posicao);
+        } else if (ehFuncaoOp(op)) {
+            ValorOtimizado *a = &pilha[top];
+            // Constantes com erro de domínio ficam para a execução, que informa a posição
+            if (a->constante && aplicarOperacaoPrecisao(prog, op, a->valor, 0, &r) == CALC_OK) {
+                m = a->inicio;
+                a->valor = valores[m] = r;
+                EMITIR(OP_NUM, 0, posicao);
+            } else {
+                a->constante = 0;
+                EMITIR(op, 0, posicao);
+            }
+        } else {
+            ValorOtimizado b = pilha[top--], *a = &pilha[top];
+            if (a->constante && b.constante && aplicarOperacaoPrecisao(prog, op, a->valor, b.valor, &r) == CALC_OK) {
+                m = a->inicio;
+                a->valor = valores[m] = r;
+                EMITIR(OP_NUM, 0, posicao);
+            } else if (b.constante && ((b.valor == 1 && (op == OP_MUL || op == OP_DIV || op == OP_POT)) ||
+                                       (b.valor == 0 && (op == OP_SOMA || op == OP_SUB)))) {
+                m = b.inicio; // x*1, x/1, x^1, x+0, x-0: só o sinal de um zero pode mudar (-0 + 0 = +0)
+            } else if (a->constante && ((a->valor == 1 && op == OP_MUL) || (a->valor == 0 && op == OP_SOMA))) {
+                // 1*x, 0+x: remove a constante, que é uma única instrução em a->inicio
+                memmove(codigo + a->inicio, codigo + a->inicio + 1, (m - a->inicio - 1) * sizeof(Instrucao));
+                memmove(posicoes + a->inicio, posicoes + a->inicio + 1, (m - a->inicio - 1) * sizeof(int));
+                memmove(valores + a->inicio, valores + a->inicio + 1, (m - a->inicio - 1) * sizeof(double));
+                m--;
+                a->constante = 0;
+            } else if (op == OP_POT && b.constante && (b.valor == 2 || b.valor == 3)) {
+                // x^2 = x*x tem os mesmos bits que pow; x^3 = (x*x)*x pode diferir de pow em 1 ulp
+                m = b.inicio;
+                EMITIR(OP_DUP, 0, posicao);
+                if (b.valor == 3) EMITIR(OP_DUP, 0, posicao);
+                EMITIR(OP_MUL, 0, posicao);
+                if (b.valor == 3) EMITIR(OP_MUL, 0, posicao);
+                a->constante = 0;
+            } else {
+                a->constante = 0;
+                EMITIR(op, 0, posicao);
+            }
+        }
+    }
+#undef EMITIR
+
+    // Recalcula a profundidade; o dup pode aumentá-la
+    int altura = 0, profundidade = 0;
+    for (int k = 0; k < m; k++) {
+        int op = codigo[k].op;
+        if (op == OP_NUM || op == OP_VAR || op == OP_DUP) altura++;
+        else if (!ehFuncaoOp(op)) altura--;
+        if (altura > profundidade) profundidade = altura;
+    }
+
+    // Constantes compactadas na ordem de uso; nunca há mais do que no programa original
+    int numConstantes = 0;
+    for (int k = 0; k < m; k++) {
+        if (codigo[k].op == OP_NUM) {
+            constantes[numConstantes] = valores[k];
+            codigo[k].arg = numConstantes++;
+        }
+    }
+    Instrucao *codigoFinal = codigo;
+    int *posicoesFinais = posicoes;
+    double *constantesFinais = constantes;
+    if (ctx != NULL) { // Sem contexto, os vetores de trabalho viram os do programa
+        codigoFinal = (Instrucao*)alocarContexto(ctx, m * sizeof(Instrucao));
+        posicoesFinais = (int*)alocarContexto(ctx, m * sizeof(int));
+        constantesFinais = (double*)alocarContexto(ctx, (numConstantes + 1) * sizeof(double));
+        if (codigoFinal == NULL || posicoesFinais == NULL || constantesFinais == NULL) {
+            cod = CALC_ERRO_MEMORIA;
+            goto fim;
+        }
+        memcpy(codigoFinal, codigo, m * sizeof(Instrucao));
+        memcpy(posicoesFinais, posicoes, m * sizeof(int));
+        memcpy(constantesFinais, constantes, numConstantes * sizeof(double));
+    } else {
+        codigo = NULL;
+        posicoes = NULL;
+        constantes = NULL;
+    }
+    liberarMemoria(ctx, prog->codigo);
+    liberarMemoria(ctx, prog->posicoes);
+    liberarMemoria(ctx, prog->constantes);
+    prog->codigo = codigoFinal;
+    prog->posicoes = posicoesFinais;
+    prog->constantes = constantesFinais;
+    prog->numConstantes = numConstantes;
+    prog->tamanho = m;
+    prog->profundidade = profundidade;
+
+fim:
+    free(codigo); free(posicoes); free(valores); free(pilha); free(constantes);
+    return cod;
+}
+
+// ===== Programa em registradores (DAG) =====
+// O programa pós-fixo vira um DAG com hash-consing: nós com a mesma operação e os mesmos operandos são
+// um nó só, então (a+b)*(a+b)/raiz(a+b) calcula a+b uma vez. Os nós são criados na ordem da primeira
+// ocorrência, que já é uma ordem topológica e preserva qual erro aparece primeiro.
+
+typedef struct {
+    int op;
+    int a, b; // Nós dos operandos (-1 se não há); em OP_NUM, a e b são os bits da constante; em OP_VAR, o slot
+} NoDag;
+
+// Acha o nó (op, a, b) na tabela ou cria um novo; retorna o índice do nó. Com ordenar, a + b e b + a
+// (e a * b e b * a) são o mesmo nó. posicoes pode ser NULL.
+static int nodoDag(NoDag *nos, int *numNos, int *tabela, int mascara, int *posicoes, int ordenar, int op, int a, int b, int posicao) {
+    if (ordenar && (op == OP_SOMA || op == OP_MUL) && a > b) { // Comutativos: a + b e b + a têm os mesmos bits
+        int t = a; a = b; b = t;
+    }
+    unsigned h = ((unsigned)op * 0x9E3779B1u) ^ ((unsigned)a * 0x85EBCA77u) ^ ((unsigned)b * 0xC2B2AE3Du);
+    for (unsigned i = h & mascara;; i = (i + 1) & mascara) {
+        int id = tabela[i];
+        if (id < 0) {
+            id = (*numNos)++;
+            nos[id].op = op; nos[id].a = a; nos[id].b = b;
+            if (posicoes != NULL) posicoes[id] = posicao;
+            tabela[i] = id;
+            return id;
+        }
+        if (nos[id].op == op && nos[id].a == a && nos[id].b == b) return id;
+    }
+}
+
+int compilarRegistros(const Programa *prog, ProgramaReg *reg, ErroCalc *erro) {
+    int n = prog->tamanho, mascara = 1, numNos = 0, top = -1, cod = CALC_OK;
+    while (mascara < 2 * n) mascara *= 2;
+    NoDag *nos = (NoDag*)malloc(n * sizeof(NoDag));
+    int *tabela = (int*)malloc(mascara * sizeof(int));
+    int *pilha = (int*)malloc(n * sizeof(int));
+    int *usos = (int*)calloc(n, sizeof(int));
+    int *registro = (int*)malloc(n * sizeof(int)); // Registrador de cada nó
+    int *livres = (int*)malloc(n * sizeof(int)); // Pilha de registradores livres
+    memset(reg, 0, sizeof(*reg));
+    reg->codigo = (InstrucaoReg*)malloc(n * sizeof(InstrucaoReg));
+    reg->posicoes = (int*)malloc(n * sizeof(int));
+    reg->constantes = (double*)malloc(n * sizeof(double));
+    if (nos == NULL || tabela == NULL || pilha == NULL || usos == NULL || registro == NULL || livres == NULL ||
+        reg->codigo == NULL || reg->posicoes == NULL || reg->constantes == NULL) {
+        liberarRegistros(reg);
+        cod = falhar(erro, CALC_ERRO_MEMORIA, -1);
+        goto fim;
+    }
+    for (int i = 0; i < mascara; i++) tabela[i] = -1;
+    mascara--;
+
+    // Monta o DAG simulando a pilha do programa
+    for (int k = 0; k < n; k++) {
+        const Instrucao *ins = &prog->codigo[k];
+        int id;
+        if (ins->op == OP_NUM) {
+            int bits[2];
+            memcpy(bits, &prog->constantes[ins->arg], sizeof(bits));
+            id = nodoDag(nos, &numNos, tabela, mascara, reg->posicoes, 1, OP_NUM, bits[0], bits[1], prog->posicoes[k]);
+        } else if (ins->op == OP_VAR) {
+            id = nodoDag(nos, &numNos, tabela, mascara, reg->posicoes, 1, OP_VAR, ins->arg, -1, prog->posicoes[k]);
+        } else if (ins->op == OP_DUP) {
+            id = pilha[top];
+        } else if (ehFuncaoOp(ins->op)) {
+            id = nodoDag(nos, &numNos, tabela, mascara, reg->posicoes, 1, ins->op, pilha[top--], -1, prog->posicoes[k]);
+        } else {
+            int b = pilha[top--], a = pilha[top--];
+            id = nodoDag(nos, &numNos, tabela, mascara, reg->posicoes, 1, ins->op, a, b, prog->posicoes[k]);
+        }
+        pilha[++top] = id;
+    }
+
+    for (int i = 0; i < numNos; i++) {
+        if (nos[i].op == OP_NUM || nos[i].op == OP_VAR) continue;
+        usos[nos[i].a]++;
+        if (nos[i].b >= 0) usos[nos[i].b]++;
+    }
+    usos[pilha[0]]++; // O resultado nunca é liberado
+
+    // Escalona na ordem dos nós; o registrador do primeiro operando é liberado antes de escolher o destino,
+    // para a operação ser feita no lugar, e o do segundo só depois, para o destino nunca sobrescrevê-lo
+    int numLivres = 0;
+    for (int i = 0; i < numNos; i++) {
+        InstrucaoReg *ins = &reg->codigo[i];
+        ins->op = (OpCode)nos[i].op;
+        ins->a = ins->b = -1;
+        if (nos[i].op == OP_NUM) {
+            int bits[2] = { nos[i].a, nos[i].b };
+            memcpy(&reg->constantes[reg->numConstantes], bits, sizeof(double));
+            ins->a = reg->numConstantes++;
+        } else if (nos[i].op == OP_VAR) {
+            ins->a = nos[i].a;
+        } else {
+            ins->a = registro[nos[i].a];
+            if (--usos[nos[i].a] == 0) livres[numLivres++] = ins->a;
+        }
+        ins->destino = numLivres > 0 ? livres[--numLivres] : reg->numRegistros++;
+        if (nos[i].op != OP_NUM && nos[i].b >= 0) {
+            ins->b = registro[nos[i].b];
+            if (--usos[nos[i].b] == 0) livres[numLivres++] = ins->b;
+        }
+        registro[i] = ins->destino;
+    }
+    reg->tamanho = numNos;
+    reg->resultado = registro[pilha[0]];
+    reg->precisao = prog->precisao;
+    reg->matematica = prog->matematica;
+    reg->numVariaveis = prog->numVariaveis;
+
+fim:
+    free(nos); free(tabela); free(pilha); free(usos); free(registro); free(livres);
+    return cod;
+}
+
+// Executa reg na sua precisão, com valores e resultado em double
+static int executarRegistrosPrecisao(const ProgramaReg *reg, const double *valores, double *resultado, ErroCalc *erro) {
+    int cod;
+    if (reg->precisao == PRECISAO_DOUBLE) return executarRegistrosDouble(reg, valores, resultado, erro);
+    if (reg->precisao == PRECISAO_LONG_DOUBLE) {
+        long double r;
+        if ((cod = executarRegistrosLongDouble(reg, valores, &r, erro)) == CALC_OK) *resultado = (double)r;
+        return cod;
+    }
+
+    float local[VALORES_LOCAIS], r;
+    float *v = valoresFloat(valores, reg->numVariaveis, local);
+    if (valores != NULL && v == NULL) return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    if ((cod = executarRegistrosFloat(reg, v, &r, erro)) == CALC_OK) *resultado = r;
+    if (v != local) free(v);
+    return cod;
+}
+
+int executarRegistros(const ProgramaReg *reg, const float *valores, float *resultado, ErroCalc *erro) {
+    if (reg->precisao == PRECISAO_FLOAT) return executarRegistrosFloat(reg, valores, resultado, erro);
+
+    double local[VALORES_LOCAIS], r;
+    double *v = valoresDouble(valores, reg->numVariaveis, local);
+    if (valores != NULL && v == NULL) return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    int cod = executarRegistrosPrecisao(reg, v, &r, erro);
+    if (cod == CALC_OK) *resultado = (float)r;
+    if (v != local) free(v);
+    return cod;
+}
+
+void liberarRegistros(ProgramaReg *reg) {
+    free(reg->codigo);
+    free(reg->constantes);
+    free(reg->posicoes);
+    reg->codigo = NULL;
+    reg->constantes = NULL;
+    reg->posicoes = NULL;
+    reg->tamanho = 0;
+}
+
+// ===== Avaliação incremental =====
+// Os nós seguem a ordem das instruções (OP_DUP repete o nó do topo em vez de criar outro), então os filhos vêm
+// antes dos pais e o menor índice entre os nós cuja operação falha é a instrução em que executarPrograma pararia.
+// Os nós sujos saem de um heap pelo índice: quando um nó é recalculado, todos os filhos sujos já foram.
+
+typedef struct {
+    unsigned char op;
+    unsigned char codigo; // CodigoErro da operação do próprio nó (quando falha é o índice dele)
+    int a, b; // Nós dos operandos (-1 se não houver); em OP_VAR, a é o slot
+    int falha; // Menor índice de nó cuja operação falhou nesta subárvore, ou -1
+    int posicao; // Posição do token no texto de origem
+    long double valor; // Na precisão do programa (long double guarda float e double sem arredondar)
+} NoIncremental;
+
+struct AvaliacaoIncremental {
+    NoIncremental *nos;
+    int numNos, raiz;
+    int *inicioPais, *pais; // Pais do nó i: pais[inicioPais[i] .. inicioPais[i + 1]) (mais de um com OP_DUP)
+    int numVariaveis;
+    int *inicioFolhas, *folhas; // Folhas da variável do slot v: folhas[inicioFolhas[v] .. inicioFolhas[v + 1])
+    int *fila; // Heap mínimo dos nós a recalcular
+    int tamanhoFila;
+    unsigned char *naFila;
+    Precisao precisao;
+    int rapido;
+    long atualizacoes, recalculados;
+};
+
+static long double valorNaPrecisao(Precisao precisao, double v) {
+    return precisao == PRECISAO_FLOAT ? (long double)(float)v : (long double)v;
+}
+
+// Compara também o sinal, para 0 e -0 contarem como valores diferentes (1 / x e x ^ -1 dependem dele)
+static int mesmoValor(long double a, long double b) {
+    return a == b && signbit(a) == signbit(b);
+}
+
+// Aplica op no motor da precisão dada, com os valores guardados em long double
+static int aplicarOperacaoNaPrecisao(Precisao precisao, int rapido, int op, long double a, long double b, long double *resultado) {
+    int cod;
+    if (precisao == PRECISAO_LONG_DOUBLE) return aplicarOperacaoLongDouble(op, a, b, rapido, resultado);
+    if (precisao == PRECISAO_DOUBLE) {
+        double r = 0;
+        if ((cod = aplicarOperacaoDouble(op, (double)a, (double)b, rapido, &r)) == CALC_OK) *resultado = r;
+        return cod;
+    }
+    float r = 0;
+    if ((cod = aplicarOperacaoFloat(op, (float)a, (float)b, rapido, &r)) == CALC_OK) *resultado = r;
+    return cod;
+}
+
+// Recalcula o nó i a partir dos operandos; retorna 1 se o valor ou o erro mudou
+static int recalcularNo(AvaliacaoIncremental *av, int i) {
+    NoIncremental *no = &av->nos[i];
+    const NoIncremental *a = &av->nos[no->a], *b = no->b >= 0 ? &av->nos[no->b] : NULL;
+    long double anterior = no->valor;
+    int falhaAnterior = no->falha;
+
+    no->falha = a->falha;
+    if (b != NULL && b->falha >= 0 && (no->falha < 0 || b->falha < no->falha)) no->falha = b->falha;
+    if (no->falha < 0) {
+        int cod = aplicarOperacaoNaPrecisao(av->precisao, av->rapido, no->op, a->valor, b != NULL ? b->valor : 0, &no->valor);
+        if (cod != CALC_OK) {
+            no->falha = i;
+            no->codigo = (unsigned char)cod;
+        }
+    }
+    return no->falha != falhaAnterior || (no->falha < 0 && !mesmoValor(no->valor, anterior));
+}
+
+static void enfileirarNo(AvaliacaoIncremental *av, int i) {
+    if (av->naFila[i]) return;
+    av->naFila[i] = 1;
+    int k = av->tamanhoFila++;
+    while (k > 0 && av->fila[(k - 1) / 2] > i) {
+        av->fila[k] = av->fila[(k - 1) / 2];
+        k = (k - 1) / 2;
+    }
+    av->fila[k] = i;
+}
+
+static int retirarMenorNo(AvaliacaoIncremental *av) {
+    int menor = av->fila[0], ultimo = av->fila[--av->tamanhoFila], k = 0;
+    for (;;) {
+        int f = 2 * k + 1;
+        if (f >= av->tamanhoFila) break;
+        if (f + 1 < av->tamanhoFila && av->fila[f + 1] < av->fila[f]) f++;
+        if (av->fila[f] >= ultimo) break;
+        av->fila[k] = av->fila[f];
+        k = f;
+    }
+    av->fila[k] = ultimo;
+    av->naFila[menor] = 0;
+    return menor;
+}
+
+static void enfileirarPais(AvaliacaoIncremental *av, int i) {
+    for (int p = av->inicioPais[i]; p < av->inicioPais[i + 1]; p++) enfileirarNo(av, av->pais[p]);
+}
+
+void liberarAvaliacaoIncremental(AvaliacaoIncremental *av) {
+    if (av == NULL) return;
+    free(av->nos);
+    free(av->inicioPais); free(av->pais);
+    free(av->inicioFolhas); free(av->folhas);
+    free(av->fila); free(av->naFila);
+    free(av);
+}
+
+AvaliacaoIncremental *criarAvaliacaoIncremental(const Programa *prog, const double *valores, ErroCalc *erro) {
+    int n = prog->tamanho, nv = prog->numVariaveis, top = -1;
+    for (int k = 0; valores == NULL && k < n; k++) {
+        if (prog->codigo[k].op == OP_VAR) {
+            falhar(erro, CALC_ERRO_VARIAVEL_SEM_VALOR, prog->posicoes[k]);
+            return NULL;
+        }
+    }
+    AvaliacaoIncremental *av = (AvaliacaoIncremental*)calloc(1, sizeof(AvaliacaoIncremental));
+    int *pilha = (int*)malloc((n > nv ? n : nv) * sizeof(int) + 1); // Pilha dos nós; depois, cursor dos vetores de pais e folhas
+    if (av != NULL) {
+        av->nos = (NoIncremental*)malloc(n * sizeof(NoIncremental));
+        av->inicioPais = (int*)calloc(n + 1, sizeof(int));
+        av->pais = (int*)malloc(2 * n * sizeof(int) + 1); // Cada nó tem no máximo dois operandos
+        av->inicioFolhas = (int*)calloc(nv + 1, sizeof(int));
+        av->folhas = (int*)malloc(n * sizeof(int) + 1);
+        av->fila = (int*)malloc(n * sizeof(int) + 1);
+        av->naFila = (unsigned char*)calloc(n + 1, 1);
+    }
+    if (av == NULL || pilha == NULL || av->nos == NULL || av->inicioPais == NULL || av->pais == NULL ||
+        av->inicioFolhas == NULL || av->folhas == NULL || av->fila == NULL || av->naFila == NULL) {
+        liberarAvaliacaoIncremental(av);
+        free(pilha);
+        falhar(erro, CALC_ERRO_MEMORIA, -1);
+        return NULL;
+    }
+    av->numVariaveis = nv;
+    av->precisao = prog->precisao;
+    av->rapido = prog->matematica == MATEMATICA_RAPIDA;
+
+    // Monta os nós simulando a pilha do programa (já validado: toda instrução encontra seus operandos)
+    for (int k = 0; k < n; k++) {
+        const Instrucao *ins = &prog->codigo[k];
+        if (ins->op == OP_DUP) {
+            pilha[top + 1] = pilha[top];
+            top++;
+            continue;
+        }
+        NoIncremental *no = &av->nos[av->numNos];
+        no->op = (unsigned char)ins->op;
+        no->a = no->b = -1;
+        no->falha = -1;
+        no->posicao = prog->posicoes[k];
+        no->valor = 0;
+        if (ins->op == OP_NUM) {
+            no->valor = valorNaPrecisao(av->precisao, prog->constantes[ins->arg]);
+        } else if (ins->op == OP_VAR) {
+            no->a = ins->arg;
+            no->valor = valorNaPrecisao(av->precisao, valores[ins->arg]);
+            av->inicioFolhas[ins->arg + 1]++;
+        } else if (ehFuncaoOp(ins->op)) {
+            no->a = pilha[top--];
+            av->inicioPais[no->a + 1]++;
+        } else {
+            no->b = pilha[top--];
+            no->a = pilha[top--];
+            av->inicioPais[no->a + 1]++;
+            av->inicioPais[no->b + 1]++;
+        }
+        pilha[++top] = av->numNos++;
+    }
+    av->raiz = pilha[0];
+
+    // Pais e folhas em vetores compactos: as contagens viram inícios, e pilha serve de cursor de escrita
+    for (int i = 0; i < av->numNos; i++) av->inicioPais[i + 1] += av->inicioPais[i];
+    for (int v = 0; v < nv; v++) av->inicioFolhas[v + 1] += av->inicioFolhas[v];
+    memcpy(pilha, av->inicioPais, av->numNos * sizeof(int));
+    for (int i = 0; i < av->numNos; i++) {
+        const NoIncremental *no = &av->nos[i];
+        if (no->op == OP_NUM || no->op == OP_VAR) continue;
+        av->pais[pilha[no->a]++] = i;
+        if (no->b >= 0) av->pais[pilha[no->b]++] = i;
+    }
+    memcpy(pilha, av->inicioFolhas, nv * sizeof(int));
+    for (int i = 0; i < av->numNos; i++) {
+        if (av->nos[i].op == OP_VAR) av->folhas[pilha[av->nos[i].a]++] = i;
+    }
+    free(pilha);
+
+    for (int i = 0; i < av->numNos; i++) {
+        if (av->nos[i].op != OP_NUM && av->nos[i].op != OP_VAR) recalcularNo(av, i);
+    }
+    return av;
+}
+
+int definirVariavelIncremental(AvaliacaoIncremental *av, int slot, double valor) {
+    if (slot < 0 || slot >= av->numVariaveis) return CALC_ERRO_VARIAVEL_SEM_VALOR;
+    long double v = valorNaPrecisao(av->precisao, valor);
+    for (int f = av->inicioFolhas[slot]; f < av->inicioFolhas[slot + 1]; f++) {
+        NoIncremental *folha = &av->nos[av->folhas[f]];
+        if (mesmoValor(folha->valor, v)) continue;
+        folha->valor = v;
+        enfileirarPais(av, av->folhas[f]);
+    }
+    return CALC_OK;
+}
+
+int getValorIncremental(AvaliacaoIncremental *av, double *resultado, ErroCalc *erro) {
+    if (av->tamanhoFila > 0) av->atualizacoes++;
+    while (av->tamanhoFila > 0) {
+        int i = retirarMenorNo(av);
+        av->recalculados++;
+        if (recalcularNo(av, i)) enfileirarPais(av, i);
+    }
+    const NoIncremental *raiz = &av->nos[av->raiz];
+    if (raiz->falha >= 0) return falhar(erro, av->nos[raiz->falha].codigo, av->nos[raiz->falha].posicao);
+    *resultado = (double)raiz->valor;
+    return CALC_OK;
+}
+
+void getEstatisticasIncremental(const AvaliacaoIncremental *av, EstatisticasIncremental *estatisticas) {
+    estatisticas->nos = av->numNos;
+    estatisticas->atualizacoes = av->atualizacoes;
+    estatisticas->recalculados = av->recalculados;
+}
+
+// ===== JIT x86-64 =====
+// Traduz o programa em registradores para código de máquina SSE escalar numa página obtida com mmap.
+// Cada registrador do programa vira um float no quadro da função ([r13 + 4*reg]). As funções de libm
+// (ou os núcleos rápidos, em MATEMATICA_RAPIDA) são chamadas com os mesmos argumentos double que o
+// interpretador usa, então os resultados são bit a bit iguais aos de executarPrograma. A função gerada retorna 0, ou (instrução << 8) | CodigoErro.
+// Só há geração de código em x86-64 com a convenção System V (Linux, macOS, BSD), e só em precisão float.
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+#define JIT_REGISTROS_MAX 65536 // Os registradores ficam no stack frame (até 256 KiB); acima disso, o interpretador
+#define JIT_INSTRUCOES_MAX (1 << 23) // O erro retornado leva a instrução em 23 bits: (k << 8) | codigo cabe num int
+#define JIT_PAGINA_SONDA 4096 // O quadro cresce uma página de cada vez, tocando cada uma, para não pular a página de guarda
+
+typedef struct {
+    unsigned char *p; // NULL na passada que só mede o código
+    long n; // Bytes emitidos (ou que seriam emitidos)
+    long capacidade; // Nada é gravado além dela; n > capacidade indica que o código não coube
+    int quadro; // Bytes reservados no stack frame para os registradores
+} EmissorJit;
+
+static void jitBytes(EmissorJit *e, const void *bytes, int n) {
+    if (e->n + n <= e->capacidade) memcpy(e->p + e->n, bytes, n);
+    e->n += n;
+}
+
+static void jitByte(EmissorJit *e, int b) {
+    unsigned char c = (unsigned char)b;
+    jitBytes(e, &c, 1);
+}
+
+static void jitInt32(EmissorJit *e, int v) {
+    jitBytes(e, &v, 4);
+}
+
+// Instrução SSE prefixo 0F opcode xmm, [r13 + 4*reg] (movss, addss, ...)
+static void jitRegistro(EmissorJit *e, int prefixo, int opcode, int xmm, int reg) {
+    jitByte(e, prefixo); jitByte(e, 0x41); jitByte(e, 0x0F); jitByte(e, opcode);
+    jitByte(e, 0x85 | (xmm << 3));
+    jitInt32(e, 4 * reg);
+}
+
+// Instrução SSE entre registradores xmm: [prefixo] 0F opcode destino, origem
+static void jitXmm(EmissorJit *e, int prefixo, int opcode, int destino, int origem) {
+    if (prefixo) jitByte(e, prefixo);
+    jitByte(e, 0x0F); jitByte(e, opcode);
+    jitByte(e, 0xC0 | (destino << 3) | origem);
+}
+
+// xmm = constante double (mov rax, imm64; movq xmm, rax)
+static void jitDouble(EmissorJit *e, int xmm, double valor) {
+    jitBytes(e, "\x48\xB8", 2);
+    jitBytes(e, &valor, 8);
+    jitBytes(e, "\x66\x48\x0F\x6E", 4);
+    jitByte(e, 0xC0 | (xmm << 3));
+}
+
+// Chama uma função de libm (argumentos e retorno em xmm0/xmm1)
+static void jitChamar(EmissorJit *e, void (*funcao)(void)) {
+    jitBytes(e, "\x48\xB8", 2); // mov rax, funcao
+    jitBytes(e, &funcao, 8);
+    jitBytes(e, "\xFF\xD0", 2); // call rax
+}
+
+static void jitEpilogo(EmissorJit *e) {
+    jitBytes(e, "\x48\x81\xC4", 3); jitInt32(e, e->quadro); // add rsp, quadro
+    jitBytes(e, "\x41\x5D\x41\x5C\x5B\xC3", 6); // pop r13; pop r12; pop rbx; ret
+}
+
+// Retorna (k << 8) | codigo, a menos que uma das condições de salto (jcc curtos) pule o retorno
+static void jitFalha(EmissorJit *e, const char *pulos, int numPulos, int k, int codigo) {
+    long inicio = e->n;
+    for (int i = 0; i < numPulos; i++) { jitByte(e, pulos[i]); jitByte(e, 0); }
+    jitByte(e, 0xB8); jitInt32(e, (k << 8) | codigo); // mov eax, imm32
+    jitEpilogo(e);
+    for (int i = 0; i < numPulos; i++) {
+        if (e->n <= e->capacidade) e->p[inicio + 2 * i + 1] = (unsigned char)(e->n - (inicio + 2 * i + 2));
+    }
+}
+
+// xmm0 = (double)r[reg] * PI / 180.0, como no interpretador
+static void jitGraus(EmissorJit *e, int reg) {
+    jitRegistro(e, 0xF3, 0x10, 0, reg);
+    jitXmm(e, 0xF3, 0x5A, 0, 0); // cvtss2sd
+    jitDouble(e, 1, PI);
+    jitXmm(e, 0xF2, 0x59, 0, 1); // mulsd
+    jitDouble(e, 1, 180.0);
+    jitXmm(e, 0xF2, 0x5E, 0, 1); // divsd
+}
+
+// Erro se |xmm3 - angulo| < 0.001 (xmm3 = fmod(|a|, 180))
+static void jitTesteTangente(EmissorJit *e, double angulo, int k) {
+    jitXmm(e, 0x66, 0x28, 0, 3); // movapd xmm0, xmm3
+    jitDouble(e, 1, angulo);
+    jitXmm(e, 0xF2, 0x5C, 0, 1); // subsd
+    jitXmm(e, 0x66, 0x54, 0, 2); // andpd xmm0, xmm2 (fabs)
+    jitDouble(e, 1, 0.001);
+    jitXmm(e, 0x66, 0x2E, 1, 0); // ucomisd xmm1, xmm0
+    jitFalha(e, "\x76", 1, k, CALC_ERRO_TANGENTE); // jbe: 0.001 <= |m - angulo| ou NaN
+}
+
+static double valorAbsoluto(void) {
+    unsigned long long mascara = 0x7FFFFFFFFFFFFFFFull;
+    double d;
+    memcpy(&d, &mascara, sizeof(d));
+    return d;
+}
+
+// xmm0 = f(r[reg]) por um núcleo rápido (MATEMATICA_RAPIDA), com os mesmos testes de domínio do interpretador
+static void jitFuncaoRapida(EmissorJit *e, OpCode op, int reg, int k) {
+    if (op == OP_TG) {
+        jitRegistro(e, 0xF3, 0x10, 0, reg);
+        jitXmm(e, 0xF3, 0x5A, 0, 0);
+        jitChamar(e, (void (*)(void))tangenteInvalidaRapida);
+        jitBytes(e, "\x85\xC0", 2); // test eax, eax
+        jitFalha(e, "\x74", 1, k, CALC_ERRO_TANGENTE); // je: ângulo válido
+    } else if (op == OP_LOG) {
+        jitRegistro(e, 0xF3, 0x10, 0, reg);
+        jitXmm(e, 0, 0x57, 1, 1);
+        jitXmm(e, 0, 0x2E, 1, 0);
+        jitFalha(e, "\x72", 1, k, CALC_ERRO_LOG); // jb: a > 0 ou NaN
+    }
+    jitRegistro(e, 0xF3, 0x10, 0, reg);
+    jitXmm(e, 0xF3, 0x5A, 0, 0);
+    switch (op) {
+        case OP_SEN: jitChamar(e, (void (*)(void))senGrausRapido); break;
+        case OP_COS: jitChamar(e, (void (*)(void))cosGrausRapido); break;
+        case OP_TG: jitChamar(e, (void (*)(void))tgGrausRapido); break;
+        default: jitChamar(e, (void (*)(void))log10Rapido); break;
+    }
+    jitXmm(e, 0xF2, 0x5A, 0, 0);
+}
+
+static void jitEmitir(EmissorJit *e, const ProgramaReg *reg) {
+    // Prólogo: rbx = valores, r12 = resultado, r13 = quadro com os registradores; a pilha fica alinhada em 16
+    jitBytes(e, "\x53\x41\x54\x41\x55", 5); // push rbx; push r12; push r13
+    int resto = e->quadro;
+    for (; resto > JIT_PAGINA_SONDA; resto -= JIT_PAGINA_SONDA) {
+        jitBytes(e, "\x48\x81\xEC", 3); jitInt32(e, JIT_PAGINA_SONDA); // sub rsp, página
+        jitBytes(e, "\x48\x83\x0C\x24\x00", 5); // or qword [rsp], 0
+    }
+    jitBytes(e, "\x48\x81\xEC", 3); jitInt32(e, resto); // sub rsp, resto (menos de uma página abaixo do último toque)
+    jitBytes(e, "\x48\x89\xFB\x49\x89\xF4\x49\x89\xE5", 9); // mov rbx, rdi; mov r12, rsi; mov r13, rsp
+
+    for (int k = 0; k < reg->tamanho; k++) {
+        const InstrucaoReg *ins = &reg->codigo[k];
+        int d = ins->destino, a = ins->a, b = ins->b;
+        if (reg->matematica == MATEMATICA_RAPIDA && ins->op >= OP_SEN && ins->op <= OP_LOG) {
+            jitFuncaoRapida(e, ins->op, a, k);
+            jitRegistro(e, 0xF3, 0x11, 0, d);
+            continue;
+        }
+        switch (ins->op) {
+            case OP_NUM: {
+                float c = (float)reg->constantes[a];
+                jitBytes(e, "\x41\xC7\x85", 3); jitInt32(e, 4 * d); // mov dword [r13 + 4*d], imm32
+                jitBytes(e, &c, 4);
+                continue;
+            }
+            case OP_VAR:
+                jitBytes(e, "\x48\x85\xDB", 3); // test rbx, rbx
+                jitFalha(e, "\x75", 1, k, CALC_ERRO_VARIAVEL_SEM_VALOR);
+                jitBytes(e, "\xF3\x0F\x10\x83", 4); jitInt32(e, 4 * a); // movss xmm0, [rbx + 4*slot]
+                break;
+            case OP_SOMA: case OP_SUB: case OP_MUL:
+                jitRegistro(e, 0xF3, 0x10, 0, a);
+                jitRegistro(e, 0xF3, ins->op == OP_SOMA ? 0x58 : ins->op == OP_SUB ? 0x5C : 0x59, 0, b);
+                break;
+            case OP_DIV:
+                jitRegistro(e, 0xF3, 0x10, 1, b);
+                jitXmm(e, 0, 0x57, 2, 2); // xorps xmm2, xmm2
+                jitXmm(e, 0, 0x2E, 1, 2); // ucomiss xmm1, xmm2
+                jitFalha(e, "\x7A\x75", 2, k, CALC_ERRO_DIVISAO_ZERO); // jp, jne: b != 0
+                jitRegistro(e, 0xF3, 0x10, 0, a);
+                jitXmm(e, 0xF3, 0x5E, 0, 1); // divss
+                break;
+            case OP_MOD: case OP_POT:
+                jitRegistro(e, 0xF3, 0x10, 0, a);
+                jitXmm(e, 0xF3, 0x5A, 0, 0);
+                jitRegistro(e, 0xF3, 0x10, 1, b);
+                jitXmm(e, 0xF3, 0x5A, 1, 1);
+                jitChamar(e, ins->op == OP_MOD ? (void (*)(void))fmod : (void (*)(void))pow);
+                jitXmm(e, 0xF2, 0x5A, 0, 0); // cvtsd2ss
+                break;
+            case OP_RAIZ:
+                jitRegistro(e, 0xF3, 0x10, 0, a);
+                jitXmm(e, 0, 0x57, 1, 1);
+                jitXmm(e, 0, 0x2E, 1, 0); // ucomiss xmm1 (0), xmm0
+                jitFalha(e, "\x76", 1, k, CALC_ERRO_RAIZ_NEGATIVA); // jbe: a >= 0 ou NaN
+                jitXmm(e, 0xF3, 0x51, 0, 0); // sqrtss
+                break;
+            case OP_SEN: case OP_COS:
+                jitGraus(e, a);
+                jitChamar(e, ins->op == OP_SEN ? (void (*)(void))sin : (void (*)(void))cos);
+                jitXmm(e, 0xF2, 0x5A, 0, 0);
+                break;
+            case OP_TG:
+                jitRegistro(e, 0xF3, 0x10, 0, a);
+                jitXmm(e, 0xF3, 0x5A, 0, 0);
+                jitDouble(e, 1, valorAbsoluto());
+                jitXmm(e, 0x66, 0x54, 0, 1); // andpd: fabs(a)
+                jitDouble(e, 1, 180.0);
+                jitChamar(e, (void (*)(void))fmod);
+                jitXmm(e, 0x66, 0x28, 3, 0); // movapd xmm3, xmm0
+                jitDouble(e, 2, valorAbsoluto());
+                jitTesteTangente(e, 90.0, k);
+                jitTesteTangente(e, 270.0, k);
+                jitGraus(e, a);
+                jitChamar(e, (void (*)(void))tan);
+                jitXmm(e, 0xF2, 0x5A, 0, 0);
+                break;
+            case OP_LOG:
+                jitRegistro(e, 0xF3, 0x10, 0, a);
+                jitXmm(e, 0, 0x57, 1, 1);
+                jitXmm(e, 0, 0x2E, 1, 0);
+                jitFalha(e, "\x72", 1, k, CALC_ERRO_LOG); // jb: a > 0 ou NaN
+                jitXmm(e, 0xF3, 0x5A, 0, 0);
+                jitChamar(e, (void (*)(void))log10);
+                jitXmm(e, 0xF2, 0x5A, 0, 0);
+                break;
+            default:
+                break;
+        }
+        jitRegistro(e, 0xF3, 0x11, 0, d); // movss [r13 + 4*d], xmm0
+    }
+
+    jitRegistro(e, 0xF3, 0x10, 0, reg->resultado);
+    jitBytes(e, "\xF3\x41\x0F\x11\x04\x24", 6); // movss [r12], xmm0
+    jitBytes(e, "\x31\xC0", 2); // xor eax, eax
+    jitEpilogo(e);
+}
+
+int compilarJit(const Programa *prog, ProgramaJit *jit, ErroCalc *erro) {
+    if (prog->precisao != PRECISAO_FLOAT) return falhar(erro, CALC_ERRO_JIT_INDISPONIVEL, -1);
+    ProgramaReg reg;
+    int cod = compilarRegistros(prog, &reg, erro);
+    if (cod != CALC_OK) return cod;
+    if (reg.numRegistros > JIT_REGISTROS_MAX || reg.tamanho >= JIT_INSTRUCOES_MAX) {
+        liberarRegistros(&reg);
+        return falhar(erro, CALC_ERRO_JIT_INDISPONIVEL, -1);
+    }
+
+    // Uma passada sem gravar mede o código; a segunda o grava nas páginas do tamanho exato
+    EmissorJit e = { NULL, 0, 0, ((4 * reg.numRegistros + 15) / 16) * 16 };
+    jitEmitir(&e, &reg);
+    long pagina = sysconf(_SC_PAGESIZE);
+    long tamanho = ((e.n + pagina - 1) / pagina) * pagina;
+    void *codigo = mmap(NULL, tamanho, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (codigo == MAP_FAILED) {
+        liberarRegistros(&reg);
+        return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    }
+
+    e.p = (unsigned char*)codigo;
+    e.n = 0;
+    e.capacidade = tamanho;
+    jitEmitir(&e, &reg);
+    if (e.n > e.capacidade) { // As duas passadas emitem o mesmo código; isto só protege a página
+        munmap(codigo, tamanho);
+        liberarRegistros(&reg);
+        return falhar(erro, CALC_ERRO_JIT_INDISPONIVEL, -1);
+    }
+    // A página deixa de ser gravável antes de virar executável
+    if (mprotect(codigo, tamanho, PROT_READ | PROT_EXEC) != 0) {
+        munmap(codigo, tamanho);
+        liberarRegistros(&reg);
+        return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    }
+
+    jit->codigo = codigo;
+    jit->tamanhoCodigo = tamanho;
+    memcpy(&jit->funcao, &codigo, sizeof(jit->funcao)); // ISO C não converte ponteiro de dados em ponteiro de função
+    jit->posicoes = reg.posicoes; // O resto do programa em registradores não é mais necessário
+    reg.posicoes = NULL;
+    liberarRegistros(&reg);
+    return CALC_OK;
+}
+
+void liberarJit(ProgramaJit *jit) {
+    if (jit->codigo != NULL) munmap(jit->codigo, jit->tamanhoCodigo);
+    free(jit->posicoes);
+    jit->codigo = NULL;
+    jit->posicoes = NULL;
+}
+
+#else
+
+int compilarJit(const Programa *prog, ProgramaJit *jit, ErroCalc *erro) {
+    (void)prog;
+    jit->codigo = NULL;
+    jit->posicoes = NULL;
+    return falhar(erro, CALC_ERRO_JIT_INDISPONIVEL, -1);
+}
+
+void liberarJit(ProgramaJit *jit) {
+    (void)jit;
+}
+
+#endif
+
+int executarJit(const ProgramaJit *jit, const float *valores, float *resultado, ErroCalc *erro) {
+    int r = jit->funcao(valores, resultado);
+    if (r != 0) return falhar(erro, r & 0xFF, jit->posicoes[r >> 8]);
+    return CALC_OK;
+}
+
+// ===== Cache de expressões (LRU) =====
+// A chave é a sequência normalizada de tokens: um espaço entre tokens e, na infixa, ',' trocada por '.'
+// nos números. Assim "2,5*x" e "2.5 * x" caem na mesma entrada. Só resultados sem erro entram no
+// cache, então as posições de erro sempre se referem ao texto recebido.
+
+typedef struct {
+    unsigned long long hash;
+    char *chave; // Tipo ('I' infixa, 'P' pós-fixa) seguido dos tokens normalizados
+    int tamanhoChave;
+    Programa prog;
+    int temPrograma;
+    float valor;
+    int temValor;
+    char *posFixa; // Forma pós-fixa (só entradas infixas), ou NULL se ainda não calculada
+    int tamanhoPosFixa;
+    int anterior, proximo; // Lista LRU (índices; -1 nas pontas)
+    int proximoBalde; // Próxima entrada no mesmo balde da tabela hash
+} EntradaCache;
+
+struct CacheCalc {
+    EntradaCache *entradas;
+    int *baldes; // Primeira entrada de cada balde, ou -1
+    int numBaldes; // Potência de 2
+    int capacidade, numEntradas;
+    int maisRecente, menosRecente;
+    long acertos, falhas;
+};
+
+static CacheCalc *cacheGlobal = NULL; // Usado por getValorInFixa, getValorPosFixa e getFormaPosFixa
+
+CacheCalc *criarCache(int capacidade) {
+    if (capacidade < 1) return NULL;
+    CacheCalc *cache = (CacheCalc*)calloc(1, sizeof(CacheCalc));
+    if (cache == NULL) return NULL;
+    cache->numBaldes = 1;
+    while (cache->numBaldes < 2 * capacidade) cache->numBaldes *= 2;
+    cache->entradas = (EntradaCache*)malloc(capacidade * sizeof(EntradaCache));
+    cache->baldes = (int*)malloc(cache->numBaldes * sizeof(int));
+    if (cache->entradas == NULL || cache->baldes == NULL) {
+        free(cache->entradas); free(cache->baldes); free(cache);
+        return NULL;
+    }
+    for (int b = 0; b < cache->numBaldes; b++) cache->baldes[b] = -1;
+    cache->capacidade = capacidade;
+    cache->maisRecente = cache->menosRecente = -1;
+    return cache;
+}
+
+static void esvaziarEntrada(EntradaCache *e) {
+    free(e->chave);
+    free(e->posFixa);
+    if (e->temPrograma) liberarPrograma(&e->prog);
+}
+
+void liberarCache(CacheCalc *cache) {
+    if (cache == NULL) return;
+    for (int i = 0; i < cache->numEntradas; i++) esvaziarEntrada(&cache->entradas[i]);
+    free(cache->entradas); free(cache->baldes); free(cache);
+}
+
+void getEstatisticasCache(const CacheCalc *cache, EstatisticasCache *estatisticas) {
+    memset(estatisticas, 0, sizeof(*estatisticas));
+    if (cache == NULL) return;
+    estatisticas->acertos = cache->acertos;
+    estatisticas->falhas = cache->falhas;
+    estatisticas->entradas = cache->numEntradas;
+    estatisticas->capacidade = cache->capacidade;
+}
+
+void ativarCacheGlobal(int capacidade) {
+    liberarCache(cacheGlobal);
+    cacheGlobal = criarCache(capacidade);
+}
+
+CacheCalc *getCacheGlobal(void) {
+    return cacheGlobal;
+}
+
+// Chave normalizada de uma expressão, montada num buffer local quando cabe
+typedef struct {
+    char local[512];
+    char *texto;
+    int tamanho;
+    unsigned long long hash;
+} ChaveCache;
+
+// Monta a chave de [Str, Str + n); retorna 0 se faltar memória
+static int normalizarChave(ChaveCache *c, char tipo, const char *Str, int n) {
+    // Cada token ganha no máximo um separador, então a chave tem até 2n + 1 bytes
+    c->texto = (2 * n + 1 <= (int)sizeof(c->local)) ? c->local : (char*)malloc(2 * n + 1);
+    if (c->texto == NULL) return 0;
+    c->tamanho = 0;
+    c->texto[c->tamanho++] = tipo;
+
+    const char *cursor = Str, *fim = Str + n;
+    Token token;
+    while (tipo == 'I' ? lerTokenInFixa(&cursor, fim, &token) : lerTokenPosFixa(&cursor, fim, &token)) {
+        int numero = tipo == 'I' && token.tipo == TOKEN_NUMERO;
+        if (c->tamanho > 1) c->texto[c->tamanho++] = ' ';
+        for (int i = 0; i < token.texto.tamanho; i++) {
+            c->texto[c->tamanho++] = (numero && token.texto.inicio[i] == ',') ? '.' : token.texto.inicio[i];
+        }
+    }
+
+    c->hash = 14695981039346656037ull; // FNV-1a de 64 bits
+    for (int i = 0; i < c->tamanho; i++) {
+        c->hash = (c->hash ^ (unsigned char)c->texto[i]) * 1099511628211ull;
+    }
+    return 1;
+}
+
+static void liberarChave(ChaveCache *c) {
+    if (c->texto != c->local) free(c->texto);
+}
+
+static void desligarLru(CacheCalc *cache, int i) {
+    EntradaCache *e = &cache->entradas[i];
+    if (e->anterior >= 0) cache->entradas[e->anterior].proximo = e->proximo;
+    else cache->maisRecente = e->proximo;
+    if (e->proximo >= 0) cache->entradas[e->proximo].anterior = e->anterior;
+    else cache->menosRecente = e->anterior;
+}
+
+static void ligarLruInicio(CacheCalc *cache, int i) {
+    EntradaCache *e = &cache->entradas[i];
+    e->anterior = -1;
+    e->proximo = cache->maisRecente;
+    if (cache->maisRecente >= 0) cache->entradas[cache->maisRecente].anterior = i;
+    cache->maisRecente = i;
+    if (cache->menosRecente < 0) cache->menosRecente = i;
+}
+
+// Procura a chave; se achar, a entrada passa a ser a mais recente. Retorna o índice ou -1.
+static int buscarEntrada(CacheCalc *cache, const ChaveCache *c) {
+    for (int i = cache->baldes[c->hash & (cache->numBaldes - 1)]; i >= 0; i = cache->entradas[i].proximoBalde) {
+        EntradaCache *e = &cache->entradas[i];
+        if (e->hash == c->hash && e->tamanhoChave == c->tamanho && memcmp(e->chave, c->texto, c->tamanho) == 0) {
+            desligarLru(cache, i);
+            ligarLruInicio(cache, i);
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Cria uma entrada vazia para a chave, descartando a menos recente se o cache estiver cheio; -1 se faltar memória
+static int inserirEntrada(CacheCalc *cache, const ChaveCache *c) {
+    char *chave = (char*)malloc(c->tamanho);
+    if (chave == NULL) return -1;
+    memcpy(chave, c->texto, c->tamanho);
+
+    int i;
+    if (cache->numEntradas < cache->capacidade) {
+        i = cache->numEntradas++;
+    } else {
+        i = cache->menosRecente;
+        EntradaCache *velha = &cache->entradas[i];
+        int *elo = &cache->baldes[velha->hash & (cache->numBaldes - 1)];
+        while (*elo != i) elo = &cache->entradas[*elo].proximoBalde;
+        *elo = velha->proximoBalde;
+        desligarLru(cache, i);
+        esvaziarEntrada(velha);
+    }
+
+    EntradaCache *e = &cache->entradas[i];
+    memset(e, 0, sizeof(*e));
+    e->hash = c->hash;
+    e->chave = chave;
+    e->tamanhoChave = c->tamanho;
+    int balde = (int)(c->hash & (cache->numBaldes - 1));
+    e->proximoBalde = cache->baldes[balde];
+    cache->baldes[balde] = i;
+    ligarLruInicio(cache, i);
+    return i;
+}
+
+// Garante que a entrada da chave tenha o programa compilado, criando a entrada se preciso. *entrada traz o
+// índice que buscarEntrada já achou para a chave (ou -1), para a tabela não ser sondada de novo.
+// Retorna CALC_OK e o índice em *entrada, ou o código do erro de compilação (nada é inserido).
+static int entradaComPrograma(CacheCalc *cache, const ChaveCache *c, const char *Str, int n, int *entrada, ErroCalc *erro) {
+    int i = *entrada;
+    if (i >= 0 && cache->entradas[i].temPrograma) return CALC_OK;
+    Programa prog;
+    int cod = (c->texto[0] == 'I') ? compilarInFixaN(Str, n, &prog, erro) : compilarPosFixaN(Str, n, &prog, erro);
+    if (cod != CALC_OK) return cod;
+    if (i < 0 && (i = inserirEntrada(cache, c)) < 0) {
+        liberarPrograma(&prog);
+        return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    }
+    cache->entradas[i].prog = prog;
+    cache->entradas[i].temPrograma = 1;
+    *entrada = i;
+    return CALC_OK;
+}
+
+static int compilarCache(CacheCalc *cache, char tipo, const char *Str, int n, const Programa **prog, ErroCalc *erro) {
+    ChaveCache c;
+    if (!normalizarChave(&c, tipo, Str, n)) return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    int i = buscarEntrada(cache, &c);
+    if (i >= 0 && cache->entradas[i].temPrograma) cache->acertos++;
+    else cache->falhas++;
+    int cod = entradaComPrograma(cache, &c, Str, n, &i, erro);
+    if (cod == CALC_OK) *prog = &cache->entradas[i].prog;
+    liberarChave(&c);
+    return cod;
+}
+
+int compilarInFixaCache(CacheCalc *cache, const char *Str, int n, const Programa **prog, ErroCalc *erro) {
+    return compilarCache(cache, 'I', Str, n, prog, erro);
+}
+
+int compilarPosFixaCache(CacheCalc *cache, const char *Str, int n, const Programa **prog, ErroCalc *erro) {
+    return compilarCache(cache, 'P', Str, n, prog, erro);
+}
+
+static int avaliarCache(CacheCalc *cache, char tipo, const char *Str, int n, float *resultado, ErroCalc *erro) {
+    ChaveCache c;
+    if (!normalizarChave(&c, tipo, Str, n)) return falhar(erro, CALC_ERRO_MEMORIA, -1);
+
+    int i = buscarEntrada(cache, &c);
+    if (i >= 0 && cache->entradas[i].temValor) {
+        cache->acertos++;
+        *resultado = cache->entradas[i].valor;
+        liberarChave(&c);
+        return CALC_OK;
+    }
+    cache->falhas++;
+
+    int cod = entradaComPrograma(cache, &c, Str, n, &i, erro);
+    if (cod == CALC_OK) {
+        EntradaCache *e = &cache->entradas[i];
+        cod = executarPrograma(&e->prog, NULL, resultado, erro);
+        if (cod == CALC_OK) {
+            e->valor = *resultado;
+            e->temValor = 1;
+        } else if (erro != NULL) {
+            // O programa pode ter vindo de outro texto com a mesma chave: recalcula para a posição se referir a Str
+            cod = (tipo == 'I') ? avaliarInFixaN(Str, n, resultado, erro) : avaliarPosFixaN(Str, n, resultado, erro);
+        }
+    }
+    liberarChave(&c);
+    return cod;
+}
+
+int avaliarInFixaCache(CacheCalc *cache, const char *Str, int n, float *resultado, ErroCalc *erro) {
+    if (cache == NULL) return avaliarInFixaN(Str, n, resultado, erro);
+    return avaliarCache(cache, 'I', Str, n, resultado, erro);
+}
+
+int avaliarPosFixaCache(CacheCalc *cache, const char *Str, int n, float *resultado, ErroCalc *erro) {
+    if (cache == NULL) return avaliarPosFixaN(Str, n, resultado, erro);
+    return avaliarCache(cache, 'P', Str, n, resultado, erro);
+}
+
+int getFormaPosFixaCache(CacheCalc *cache, const char *Str, int n, char *saida, int tamanho, ErroCalc *erro) {
+    if (cache == NULL) return getFormaPosFixaN(Str, n, saida, tamanho, erro);
+
+    ChaveCache c;
+    if (!normalizarChave(&c, 'I', Str, n)) {
+        falhar(erro, CALC_ERRO_MEMORIA, -1);
+        return -1;
+    }
+
+    int len;
+    int i = buscarEntrada(cache, &c);
+    if (i >= 0 && cache->entradas[i].posFixa != NULL) {
+        cache->acertos++;
+        EntradaCache *e = &cache->entradas[i];
+        len = e->tamanhoPosFixa;
+        if (len + 1 > tamanho) {
+            falhar(erro, CALC_ERRO_BUFFER_PEQUENO, -1);
+            len = -1;
+            if (tamanho > 0) saida[0] = '\0';
+        } else {
+            memcpy(saida, e->posFixa, len + 1);
+        }
+    } else {
+        cache->falhas++;
+        len = getFormaPosFixaN(Str, n, saida, tamanho, erro);
+        if (len >= 0 && (i >= 0 || (i = inserirEntrada(cache, &c)) >= 0)) {
+            EntradaCache *e = &cache->entradas[i];
+            if ((e->posFixa = (char*)malloc(len + 1)) != NULL) {
+                memcpy(e->posFixa, saida, len + 1);
+                e->tamanhoPosFixa = len;
+            }
+        }
+    }
+    liberarChave(&c);
+    return len;
+}
+
+// ===== Conversões =====
+
+// Anexa os n bytes de texto à saída; com separador, acrescenta um espaço. Retorna 0 se não couber em tamanho bytes
+static int anexarTexto(char *saida, int *len, int tamanho, const char *texto, int n, int separador) {
+    if (*len + n + separador + 1 > tamanho) return 0;
+    memcpy(saida + *len, texto, n);
+    *len += n;
+    if (separador) saida[(*len)++] = ' ';
+    saida[*len] = '\0';
+    return 1;
+}
+
+// Converte a infixa em [Str, Str + n) para pós-fixa em saida (tamanho bytes); retorna o comprimento, ou -1 se erro.
+// Compila a infixa e escreve as instruções; números e variáveis são copiados do texto de entrada.
+int getFormaPosFixaContexto(ContextoCalc *ctx, const char *Str, int n, char *saida, int tamanho, ErroCalc *erro) {
+    int len = 0;
+    if (tamanho < 1) {
+        falhar(erro, CALC_ERRO_BUFFER_PEQUENO, -1);
+        return -1;
+    }
+    saida[0] = '\0';
+
+    Programa prog;
+    if (compilarInFixaContexto(ctx, Str, n, &prog, erro) != CALC_OK) return -1;
+
+    for (int k = 0; k < prog.tamanho && len >= 0; k++) {
+        int ok;
+        if (prog.codigo[k].op == OP_NUM || prog.codigo[k].op == OP_VAR) {
+            const char *p = Str + prog.posicoes[k];
+            Token token;
+            lerTokenInFixa(&p, Str + n, &token);
+            int inicio = len;
+            ok = anexarTexto(saida, &len, tamanho, token.texto.inicio, token.texto.tamanho, 1);
+            for (int i = inicio; ok && i < len; i++) {
+                if (saida[i] == ',') saida[i] = '.';
+            }
+        } else {
+            const char *nome = nomeOp[prog.codigo[k].op];
+            ok = anexarTexto(saida, &len, tamanho, nome, (int)strlen(nome), 1);
+        }
+        if (!ok) {
+            falhar(erro, CALC_ERRO_BUFFER_PEQUENO, prog.posicoes[k]);
+            saida[0] = '\0';
+            len = -1;
+        }
+    }
+
+    if (len > 0 && saida[len - 1] == ' ') {
+        saida[--len] = '\0';
+    }
+
+    liberarPrograma(&prog);
+    return len;
+}
+
+int getFormaPosFixaN(const char *Str, int n, char *saida, int tamanho, ErroCalc *erro) {
+    return getFormaPosFixaContexto(NULL, Str, n, saida, tamanho, erro);
+}
 
-// Estrutura de pilha para números
-typedef struct {
-    float *items;
-    int top;
-    int capacity;
-} Stack;
+// Implementação reentrante de getFormaPosFixa: escreve em saida (tamanho bytes) e retorna o comprimento, ou -1 se erro
+int getFormaPosFixa_r(const char *Str, char *saida, int tamanho, ErroCalc *erro) {
+    return getFormaPosFixaN(Str, (int)strlen(Str), saida, tamanho, erro);
+}
 
-// Funções auxiliares para a pilha de floats
-Stack* createStack(int capacity) {
-    Stack* stack = (Stack*)malloc(sizeof(Stack));
-    stack->capacity = capacity;
-    stack->top = -1;
-    stack->items = (float*)malloc(stack->capacity * sizeof(float));
-    return stack;
+// Garante que o buffer das versões não reentrantes tenha ao menos tamanho bytes; retorna 0 se faltar memória
+static int reservarBufferEstatico(char **buffer, int *capacidade, int tamanho) {
+    if (tamanho <= *capacidade) return 1;
+    char *novo = (char*)realloc(*buffer, tamanho);
+    if (novo == NULL) return 0;
+    *buffer = novo;
+    *capacidade = tamanho;
+    return 1;
 }
 
-int isStackEmpty(Stack *stack) {
-    return stack->top == -1;
+// Implementação da função getFormaPosFixa: a saída (no máximo um espaço por caractere da entrada) fica
+// num buffer estático que cresce com a entrada
+char* getFormaPosFixa(char *Str) {
+    static char *saida = NULL;
+    static int capacidade = 0;
+    ErroCalc erro = { CALC_ERRO_MEMORIA, -1 };
+    int n = (int)strlen(Str);
+    if (!reservarBufferEstatico(&saida, &capacidade, 2 * n + 2) ||
+        getFormaPosFixaCache(cacheGlobal, Str, n, saida, capacidade, &erro) < 0) {
+        fprintf(stderr, "Erro: %s (posição %d da expressão infixa).\n", mensagemErro(erro.codigo), erro.posicao);
+    }
+    return saida != NULL ? saida : (char*)"";
 }
 
-void push(Stack *stack, float item) {
-    if (stack->top == stack->capacity - 1) {
-        fprintf(stderr, "Erro: Pilha de números cheia. Aumente a capacidade.\n");
-        exit(EXIT_FAILURE);
+// Escreve prog na forma pós-fixa (constantes com %.9g em float, %.17g nas outras precisões); retorna o comprimento, ou -1 se não couber
+int escreverProgramaPosFixa(const Programa *prog, char *saida, int tamanho, ErroCalc *erro) {
+    int len = 0;
+    char numero[32];
+    if (tamanho < 1) {
+        falhar(erro, CALC_ERRO_BUFFER_PEQUENO, -1);
+        return -1;
+    }
+    saida[0] = '\0';
+    for (int k = 0; k < prog->tamanho; k++) {
+        const Instrucao *ins = &prog->codigo[k];
+        const char *texto = numero;
+        if (ins->op == OP_NUM && prog->precisao == PRECISAO_FLOAT) snprintf(numero, sizeof(numero), "%.9g", (float)prog->constantes[ins->arg]);
+        else if (ins->op == OP_NUM) snprintf(numero, sizeof(numero), "%.17g", prog->constantes[ins->arg]);
+        else if (ins->op == OP_VAR) texto = prog->variaveis[ins->arg];
+        else texto = nomeOp[ins->op];
+        if (!anexarTexto(saida, &len, tamanho, texto, (int)strlen(texto), k + 1 < prog->tamanho)) {
+            falhar(erro, CALC_ERRO_BUFFER_PEQUENO, -1);
+            saida[0] = '\0';
+            return -1;
+        }
     }
-    stack->items[++stack->top] = item;
+    return len;
 }
 
-float pop(Stack *stack) {
-    if (isStackEmpty(stack)) {
-        fprintf(stderr, "Erro: Pilha de números vazia ao tentar pop.\n");
-        exit(EXIT_FAILURE);
+// Compila a infixa em [Str, Str + n), otimiza e escreve a pós-fixa resultante; retorna o comprimento, ou -1 se erro
+int getFormaPosFixaOtimizadaContexto(ContextoCalc *ctx, const char *Str, int n, char *saida, int tamanho, ErroCalc *erro) {
+    Programa prog;
+    int cod = compilarInFixaContexto(ctx, Str, n, &prog, erro);
+    if (cod != CALC_OK) {
+        if (tamanho > 0) saida[0] = '\0';
+        return -1;
     }
-    return stack->items[stack->top--];
+    if ((cod = otimizarPrograma(&prog)) != CALC_OK) {
+        falhar(erro, cod, -1);
+        liberarPrograma(&prog);
+        return -1;
+    }
+    int len = escreverProgramaPosFixa(&prog, saida, tamanho, erro);
+    liberarPrograma(&prog);
+    return len;
 }
 
-float peek(Stack *stack) {
-    if (isStackEmpty(stack)) {
-        fprintf(stderr, "Erro: Pilha de números vazia ao tentar peek.\n");
-        exit(EXIT_FAILURE);
+int getFormaPosFixaOtimizadaN(const char *Str, int n, char *saida, int tamanho, ErroCalc *erro) {
+    return getFormaPosFixaOtimizadaContexto(NULL, Str, n, saida, tamanho, erro);
+}
+
+int getFormaPosFixaOtimizada_r(const char *Str, char *saida, int tamanho, ErroCalc *erro) {
+    return getFormaPosFixaOtimizadaN(Str, (int)strlen(Str), saida, tamanho, erro);
+}
+
+// Nó da árvore montada por getFormaInFixa_r: folha (trecho do texto de entrada) ou operador com filhos
+typedef struct {
+    int op; // OpCode, ou -1 para folha
+    int inicio, tamanho; // Trecho do texto (folha)
+    int esq, dir; // Índices dos filhos (dir = -1 para funções)
+    long comprimento; // Bytes da forma infixa do nó, saturado logo acima do limite da saída
+} NoInFixa;
+
+// Escreve a forma infixa da árvore com raiz em raiz em saida a partir de *len; retorna 0 se não couber.
+// Percurso sem recursão: pilha (um lugar por nó) guarda (nó << 2) | etapa, onde a etapa diz o que falta
+// escrever do nó (abertura, operador do meio, fechamento), então a profundidade da árvore não tem limite.
+static int escreverInFixa(const NoInFixa *nos, int raiz, const char *texto, int *pilha, char *saida, int *len, int tamanho) {
+    char aux[8];
+    int top = 0;
+    pilha[0] = raiz << 2;
+    while (top >= 0) {
+        const NoInFixa *no = &nos[pilha[top] >> 2];
+        int etapa = pilha[top] & 3, funcao = no->op >= 0 && ehFuncaoOp(no->op);
+        const char *parte;
+        int n;
+        if (no->op < 0) {
+            parte = texto + no->inicio;
+            n = no->tamanho;
+            top--;
+        } else if (etapa == 0) {
+            if (funcao) snprintf(aux, sizeof(aux), "%s(", nomeOp[no->op]);
+            parte = funcao ? aux : "(";
+            n = (int)strlen(parte);
+            pilha[top]++;
+            pilha[++top] = no->esq << 2;
+        } else if (etapa == 1 && !funcao) {
+            snprintf(aux, sizeof(aux), " %s ", nomeOp[no->op]);
+            parte = aux;
+            n = (int)strlen(parte);
+            pilha[top]++;
+            pilha[++top] = no->dir << 2;
+        } else {
+            parte = ")";
+            n = 1;
+            top--;
+        }
+        if (*len + n >= tamanho) return 0;
+        memcpy(saida + *len, parte, n);
+        *len += n;
     }
-    return stack->items[stack->top];
+    return 1;
 }
 
-// Função para verificar se uma string é um número
-int isNumber(const char *str) {
-    char *endptr;
-    if (str == NULL || *str == '\0') return 0;
-    strtod(str, &endptr);
-    return endptr != str && *endptr == '\0' && !isspace((unsigned char)*str);
+// Maior infixa aceita para a pós-fixa [Str, Str + n): sem dup ela cabe em 4n + 16 bytes, e com dup a subexpressão
+// duplicada é escrita de novo a cada uso, então o tamanho pode dobrar a cada dup e é limitado a LIMITE_INFIXA
+static long limiteInFixa(int n) {
+    return 4L * n + 16 > LIMITE_INFIXA ? 4L * n + 16 : LIMITE_INFIXA;
 }
 
-// Função principal para avaliar expressão pós-fixada
-float getValorPosFixa(char *StrPosFixa) {
-    char *StrCopia = strdup(StrPosFixa);
-    if (StrCopia == NULL) {
-        fprintf(stderr, "Erro de alocação de memória para cópia da string.\n");
-        exit(EXIT_FAILURE);
+// Compila a pós-fixa em [Str, Str + n) e monta em *nos a árvore de nós que apontam para trechos da entrada, com o
+// comprimento exato de cada um. Retorna o comprimento da infixa (a raiz fica em (*pilha)[0]), ou -1 se erro; a
+// memória de *nos e *pilha (um lugar por nó, para o percurso de escreverInFixa) é do chamador mesmo com erro.
+static long montarInFixa(ContextoCalc *ctx, const char *Str, int n, NoInFixa **nos, int **pilha, ErroCalc *erro) {
+    Programa prog;
+    *nos = NULL;
+    *pilha = NULL;
+    if (compilarPosFixaContexto(ctx, Str, n, &prog, erro) != CALC_OK) return -1;
+
+    long len = -1, limite = limiteInFixa(n);
+    int top = -1;
+    *nos = (NoInFixa*)alocarContexto(ctx, prog.tamanho * sizeof(NoInFixa));
+    *pilha = (int*)alocarContexto(ctx, prog.tamanho * sizeof(int)); // Índices dos nós ainda sem pai
+    if (*nos == NULL || *pilha == NULL) {
+        falhar(erro, CALC_ERRO_MEMORIA, -1);
+        goto fim;
     }
 
-    Stack *stack = createStack(512);
-    char *token = strtok(StrCopia, " ");
-    
-    while (token != NULL) {
-        if (isNumber(token)) {
-            push(stack, atof(token));
+    // O programa já foi validado: toda instrução encontra seus operandos na pilha
+    for (int k = 0; k < prog.tamanho; k++) {
+        NoInFixa *no = &(*nos)[k];
+        no->op = prog.codigo[k].op;
+        if (no->op == OP_NUM || no->op == OP_VAR) {
+            const char *p = Str + prog.posicoes[k];
+            Token token;
+            lerTokenPosFixa(&p, Str + n, &token);
+            no->op = -1;
+            no->inicio = prog.posicoes[k];
+            no->comprimento = no->tamanho = token.texto.tamanho;
+        } else if (no->op == OP_DUP) {
+            *no = (*nos)[(*pilha)[top]]; // A infixa não tem como compartilhar: a subexpressão é escrita de novo
+        } else if (ehFuncaoOp(no->op)) {
+            no->esq = (*pilha)[top--];
+            no->dir = -1;
+            no->comprimento = (long)strlen(nomeOp[no->op]) + 2 + (*nos)[no->esq].comprimento; // "sen(" e ")"
         } else {
-            if (strcmp(token, "+") == 0 || strcmp(token, "-") == 0 || 
-                strcmp(token, "*") == 0 || strcmp(token, "/") == 0 || 
-                strcmp(token, "%") == 0 || strcmp(token, "^") == 0) {
-                
-                if (stack->top < 1) {
-                    fprintf(stderr, "Erro: Operação binária '%s' precisa de 2 operandos.\n", token);
-                    free(StrCopia); free(stack->items); free(stack);
-                    exit(EXIT_FAILURE);
-                }
-                
-                float b = pop(stack);
-                float a = pop(stack);
-                float result;
-                
-                if (strcmp(token, "+") == 0) result = a + b;
-                else if (strcmp(token, "-") == 0) result = a - b;
-                else if (strcmp(token, "*") == 0) result = a * b;
-                else if (strcmp(token, "/") == 0) {
-                    if (b == 0) { fprintf(stderr, "Erro: Divisão por zero.\n"); free(StrCopia); free(stack->items); free(stack); exit(EXIT_FAILURE); }
-                    result = a / b;
-                }
-                else if (strcmp(token, "%") == 0) { result = fmod(a, b); }
-                else if (strcmp(token, "^") == 0) result = pow(a, b);
-                
-                push(stack, result);
-            }
-            else if (strcmp(token, "raiz") == 0 || strcmp(token, "sen") == 0 || 
-                    strcmp(token, "cos") == 0 || strcmp(token, "tg") == 0 || 
-                    strcmp(token, "log") == 0) {
-                
-                if (isStackEmpty(stack)) {
-                    fprintf(stderr, "Erro: Operação unária '%s' precisa de 1 operando.\n", token);
-                    free(StrCopia); free(stack->items); free(stack);
-                    exit(EXIT_FAILURE);
-                }
-                
-                float a = pop(stack);
-                float result;
-                
-                if (strcmp(token, "raiz") == 0) { if (a < 0) { fprintf(stderr, "Erro: Raiz quadrada de número negativo.\n"); free(StrCopia); free(stack->items); free(stack); exit(EXIT_FAILURE); } result = sqrt(a); }
-                else if (strcmp(token, "sen") == 0) result = sin(a * PI / 180.0);
-                else if (strcmp(token, "cos") == 0) result = cos(a * PI / 180.0);
-                else if (strcmp(token, "tg") == 0) {
-                    double angle_mod_180 = fmod(fabs(a), 180.0);
-                    if (fabs(angle_mod_180 - 90.0) < 0.001 || fabs(angle_mod_180 - 270.0) < 0.001) { fprintf(stderr, "Erro: Tangente de ângulo invalido (90, 270 graus, etc.).\n"); free(StrCopia); free(stack->items); free(stack); exit(EXIT_FAILURE); }
-                    result = tan(a * PI / 180.0);
-                }
-                else if (strcmp(token, "log") == 0) { if (a <= 0) { fprintf(stderr, "Erro: Logaritmo de número não positivo.\n"); free(StrCopia); free(stack->items); free(stack); exit(EXIT_FAILURE); } result = log10(a); }
-                
-                push(stack, result);
-            } else {
-                fprintf(stderr, "Erro: Operador desconhecido ou expressão mal formada '%s'\n", token);
-                free(StrCopia); free(stack->items); free(stack);
-                exit(EXIT_FAILURE);
-            }
+            no->dir = (*pilha)[top--];
+            no->esq = (*pilha)[top--];
+            no->comprimento = (long)strlen(nomeOp[no->op]) + 4 + (*nos)[no->esq].comprimento + (*nos)[no->dir].comprimento; // "(", " + " e ")"
         }
-        token = strtok(NULL, " ");
+        if (no->comprimento > limite) no->comprimento = limite + 1; // Os filhos já saturados não estouram a soma
+        (*pilha)[++top] = k;
     }
-    
-    if (stack->top != 0) {
-        fprintf(stderr, "Erro: Expressão mal formada - operandos sobrando na pilha.\n");
-        free(StrCopia); free(stack->items); free(stack);
-        exit(EXIT_FAILURE);
+
+    len = (*nos)[(*pilha)[0]].comprimento;
+    if (len > limite) {
+        falhar(erro, CALC_ERRO_INFIXA_GRANDE, -1);
+        len = -1;
     }
-    
-    float finalResult = pop(stack);
-    free(StrCopia); free(stack->items); free(stack);
-    return finalResult; 
+
+fim:
+    liberarPrograma(&prog);
+    return len;
 }
 
-// ===== Pilha para strings (para conversão infixa/posfixa) =====
-typedef struct {
-    char items[512][512];
-    int top;
-} StackStr;
+// Converte a pós-fixa em [Str, Str + n) para infixa em saida (tamanho bytes); retorna o comprimento, ou -1 se erro.
+// Compila a pós-fixa, monta uma árvore de nós que apontam para trechos da entrada e só escreve o texto no final, uma
+// vez, depois de conferir que ele cabe: com CALC_ERRO_BUFFER_PEQUENO, getTamanhoInFixaContexto dá o tamanho exato.
+int getFormaInFixaContexto(ContextoCalc *ctx, const char *Str, int n, char *saida, int tamanho, ErroCalc *erro) {
+    if (tamanho < 1) {
+        falhar(erro, CALC_ERRO_BUFFER_PEQUENO, -1);
+        return -1;
+    }
+    saida[0] = '\0';
 
-void pushStr(StackStr* s, const char* item) {
-    if (s->top == 511) {
-        fprintf(stderr, "Erro: Pilha de strings cheia. Aumente a capacidade.\n");
-        exit(EXIT_FAILURE);
+    NoInFixa *nos;
+    int *pilha;
+    long comprimento = montarInFixa(ctx, Str, n, &nos, &pilha, erro);
+    int len = -1;
+    if (comprimento >= 0 && comprimento + 1 > tamanho) {
+        falhar(erro, CALC_ERRO_BUFFER_PEQUENO, -1);
+    } else if (comprimento >= 0) {
+        len = 0;
+        escreverInFixa(nos, pilha[0], Str, pilha, saida, &len, tamanho);
+        saida[len] = '\0';
     }
-    strcpy(s->items[++s->top], item);
+    liberarMemoria(ctx, nos); liberarMemoria(ctx, pilha);
+    return len;
 }
 
-char* popStr(StackStr* s) {
-    if (s->top == -1) {
-        fprintf(stderr, "Erro: Pilha de strings vazia ao tentar pop.\n");
-        exit(EXIT_FAILURE);
+// Comprimento exato (sem o '\0') da infixa da pós-fixa em [Str, Str + n), ou -1 se erro
+long getTamanhoInFixaContexto(ContextoCalc *ctx, const char *Str, int n, ErroCalc *erro) {
+    NoInFixa *nos;
+    int *pilha;
+    long comprimento = montarInFixa(ctx, Str, n, &nos, &pilha, erro);
+    liberarMemoria(ctx, nos); liberarMemoria(ctx, pilha);
+    return comprimento;
+}
+
+long getTamanhoInFixaN(const char *Str, int n, ErroCalc *erro) {
+    return getTamanhoInFixaContexto(NULL, Str, n, erro);
+}
+
+int getFormaInFixaN(const char *Str, int n, char *saida, int tamanho, ErroCalc *erro) {
+    return getFormaInFixaContexto(NULL, Str, n, saida, tamanho, erro);
+}
+
+// Implementação reentrante de getFormaInFixa: escreve em saida (tamanho bytes) e retorna o comprimento, ou -1 se erro
+int getFormaInFixa_r(const char *Str, char *saida, int tamanho, ErroCalc *erro) {
+    return getFormaInFixaN(Str, (int)strlen(Str), saida, tamanho, erro);
+}
+
+// Implementação da função getFormaInFixa (converter de pós-fixa para infixa); o buffer estático cresce
+// com a entrada: cada operador acrescenta no máximo "(", ")" e dois espaços
+char* getFormaInFixa(char* Str) {
+    static char *result_infixa = NULL;
+    static int capacidade = 0;
+    ErroCalc erro = { CALC_ERRO_MEMORIA, -1 };
+    int n = (int)strlen(Str), len = -1;
+    if (reservarBufferEstatico(&result_infixa, &capacidade, 4 * n + 16)) {
+        len = getFormaInFixa_r(Str, result_infixa, capacidade, &erro);
+        // Com dup, a subexpressão duplicada é escrita de novo e a infixa pode passar da estimativa
+        long exato = len < 0 && erro.codigo == CALC_ERRO_BUFFER_PEQUENO ? getTamanhoInFixaN(Str, n, &erro) : -1;
+        if (exato >= 0) {
+            erro.codigo = CALC_ERRO_MEMORIA;
+            if (reservarBufferEstatico(&result_infixa, &capacidade, (int)exato + 1)) len = getFormaInFixa_r(Str, result_infixa, capacidade, &erro);
+        }
     }
-    return s->items[s->top--];
+    if (len < 0) {
+        fprintf(stderr, "Erro: %s (posição %d da expressão pos-fixa).\n", mensagemErro(erro.codigo), erro.posicao);
+        if (result_infixa != NULL) result_infixa[0] = '\0';
+    }
+    return result_infixa != NULL ? result_infixa : (char*)"";
 }
 
-char* peekStr(StackStr* s) {
-    if (s->top == -1) {
-        fprintf(stderr, "Erro: Pilha de strings vazia ao tentar peek.\n");
-        exit(EXIT_FAILURE);
+// ===== Avaliação =====
+
+// Avalia a infixa em [Str, Str + n) sem compilar, no motor da precisão; retorna 0 se ela não segue a gramática
+// (o chamador usa o caminho compilado), ou 1 com o código (e o valor em resultado, ou o erro em erro) em *cod
+static int avaliarInFixaDireta(const char *Str, int n, Precisao precisao, ModoMatematica matematica, double *resultado, ErroCalc *erro, int *cod) {
+    AvaliadorDireto a = { Str, Str, Str + n, { { NULL, 0 }, TOKEN_DESCONHECIDO, 0, 0 }, 0, 0, matematica == MATEMATICA_RAPIDA, CALC_OK, -1 };
+    double r = 0;
+    int ok;
+    avancarDireto(&a);
+    if (precisao == PRECISAO_DOUBLE) {
+        ok = avaliarExpressaoDiretaDouble(&a, 0, &r);
+    } else if (precisao == PRECISAO_LONG_DOUBLE) {
+        long double v = 0;
+        ok = avaliarExpressaoDiretaLongDouble(&a, 0, &v);
+        r = (double)v;
+    } else {
+        float v = 0;
+        ok = avaliarExpressaoDiretaFloat(&a, 0, &v);
+        r = v;
     }
-    return s->items[s->top];
+    if (!ok || a.temToken) return 0;
+    PERFIL_AVALIACAO_DIRETA();
+    if (a.codigo != CALC_OK) *cod = falhar(erro, a.codigo, a.posicao);
+    else {
+        *resultado = r;
+        *cod = CALC_OK;
+    }
+    return 1;
 }
 
-int isEmptyStr(StackStr* s) {
-    return s->top == -1;
+// Compila [Str, Str + n) (infixa se posFixa = 0) no contexto e calcula na precisão e no modo escolhidos
+static int avaliarContexto(ContextoCalc *ctx, int posFixa, const char *Str, int n, Precisao precisao, ModoMatematica matematica, double *resultado, ErroCalc *erro) {
+    Programa prog;
+    int cod;
+    if (!posFixa && avaliarInFixaDireta(Str, n, precisao, matematica, resultado, erro, &cod)) return cod;
+    cod = posFixa ? compilarPosFixaContexto(ctx, Str, n, &prog, erro) : compilarInFixaContexto(ctx, Str, n, &prog, erro);
+    if (cod != CALC_OK) return cod;
+    prog.precisao = precisao;
+    prog.matematica = matematica;
+    cod = executarProgramaDouble(&prog, NULL, resultado, erro);
+    liberarPrograma(&prog);
+    return cod;
 }
 
-// Prioridade dos operadores
-int prioridade(const char* op) {
-    if (strcmp(op, "+") == 0 || strcmp(op, "-") == 0) return 1;
-    if (strcmp(op, "*") == 0 || strcmp(op, "/") == 0 || strcmp(op, "%") == 0) return 2;
-    if (strcmp(op, "^") == 0) return 3;
-    if (strcmp(op, "raiz") == 0 || strcmp(op, "sen") == 0 || strcmp(op, "cos") == 0 ||
-        strcmp(op, "tg") == 0 || strcmp(op, "log") == 0) return 4;
-    return 0; // Para parênteses ou tokens desconhecidos, prioridade 0
+int avaliarInFixaPrecisaoContexto(ContextoCalc *ctx, const char *Str, int n, Precisao precisao, ModoMatematica matematica, double *resultado, ErroCalc *erro) {
+    return avaliarContexto(ctx, 0, Str, n, precisao, matematica, resultado, erro);
 }
 
-// Verifica se é um operador binário
-int ehOperador(const char* token) {
-    return strcmp(token, "+") == 0 || strcmp(token, "-") == 0 ||
-           strcmp(token, "*") == 0 || strcmp(token, "/") == 0 ||
-           strcmp(token, "%") == 0 || strcmp(token, "^") == 0;
+int avaliarPosFixaPrecisaoContexto(ContextoCalc *ctx, const char *Str, int n, Precisao precisao, ModoMatematica matematica, double *resultado, ErroCalc *erro) {
+    return avaliarContexto(ctx, 1, Str, n, precisao, matematica, resultado, erro);
 }
 
-// Verifica se é uma função (operador unário)
-int ehFuncao(const char* token) {
-    return strcmp(token, "sen") == 0 || strcmp(token, "cos") == 0 ||
-           strcmp(token, "tg") == 0 || strcmp(token, "log") == 0 ||
-           strcmp(token, "raiz") == 0;
+// Na precisão float, o valor em double é exatamente o float calculado
+int avaliarInFixaContexto(ContextoCalc *ctx, const char *Str, int n, float *resultado, ErroCalc *erro) {
+    double r;
+    int cod = avaliarContexto(ctx, 0, Str, n, PRECISAO_FLOAT, MATEMATICA_EXATA, &r, erro);
+    if (cod == CALC_OK) *resultado = (float)r;
+    return cod;
 }
 
-// Função para extrair o próximo token de uma string de expressão (sem espaços exigidos)
-char* getNextToken(char **expr_ptr, char *token_buffer) {
-    char *expr = *expr_ptr;
-    int i = 0;
+int avaliarPosFixaContexto(ContextoCalc *ctx, const char *Str, int n, float *resultado, ErroCalc *erro) {
+    double r;
+    int cod = avaliarContexto(ctx, 1, Str, n, PRECISAO_FLOAT, MATEMATICA_EXATA, &r, erro);
+    if (cod == CALC_OK) *resultado = (float)r;
+    return cod;
+}
+
+// Calcula o valor da infixa em [Str, Str + n); retorna CALC_OK ou o código do erro
+int avaliarInFixaN(const char *Str, int n, float *resultado, ErroCalc *erro) {
+    return avaliarInFixaContexto(NULL, Str, n, resultado, erro);
+}
 
-    while (isspace((unsigned char)*expr)) {
-        expr++;
+// Calcula o valor da pós-fixa em [Str, Str + n); retorna CALC_OK ou o código do erro
+int avaliarPosFixaN(const char *Str, int n, float *resultado, ErroCalc *erro) {
+    return avaliarPosFixaContexto(NULL, Str, n, resultado, erro);
+}
+
+// Calcula o valor da infixa em [Str, Str + n) na precisão e no modo escolhidos; retorna CALC_OK ou o código do erro
+int avaliarInFixaPrecisaoN(const char *Str, int n, Precisao precisao, ModoMatematica matematica, double *resultado, ErroCalc *erro) {
+    return avaliarInFixaPrecisaoContexto(NULL, Str, n, precisao, matematica, resultado, erro);
+}
+
+// Calcula o valor da pós-fixa em [Str, Str + n) na precisão e no modo escolhidos; retorna CALC_OK ou o código do erro
+int avaliarPosFixaPrecisaoN(const char *Str, int n, Precisao precisao, ModoMatematica matematica, double *resultado, ErroCalc *erro) {
+    return avaliarPosFixaPrecisaoContexto(NULL, Str, n, precisao, matematica, resultado, erro);
+}
+
+// Calcula o valor de Str (na forma infixa); retorna CALC_OK ou o código do erro
+int avaliarInFixa(const char *StrInFixa, float *resultado, ErroCalc *erro) {
+    return avaliarInFixaN(StrInFixa, (int)strlen(StrInFixa), resultado, erro);
+}
+
+// Calcula o valor de Str (na forma pós-fixa); retorna CALC_OK ou o código do erro
+int avaliarPosFixa(const char *StrPosFixa, float *resultado, ErroCalc *erro) {
+    return avaliarPosFixaN(StrPosFixa, (int)strlen(StrPosFixa), resultado, erro);
+}
+
+// Calcula o valor de Str (na forma infixa); encerra o programa em caso de erro
+float getValorInFixa(char *StrInFixa) {
+    float resultado;
+    ErroCalc erro;
+    if (avaliarInFixaCache(cacheGlobal, StrInFixa, (int)strlen(StrInFixa), &resultado, &erro) != CALC_OK) {
+        fprintf(stderr, "Erro: %s (posição %d da expressão infixa).\n", mensagemErro(erro.codigo), erro.posicao);
+        exit(EXIT_FAILURE);
     }
+    return resultado;
+}
 
-    if (*expr == '\0') {
-        *expr_ptr = expr;
-        return NULL;
+// Função principal para avaliar expressão pós-fixada; encerra o programa em caso de erro
+float getValorPosFixa(char *StrPosFixa) {
+    float resultado;
+    ErroCalc erro;
+    if (avaliarPosFixaCache(cacheGlobal, StrPosFixa, (int)strlen(StrPosFixa), &resultado, &erro) != CALC_OK) {
+        fprintf(stderr, "Erro: %s (posição %d da expressão pos-fixa).\n", mensagemErro(erro.codigo), erro.posicao);
+        exit(EXIT_FAILURE);
     }
+    return resultado;
+}
+
+// ===== Avaliação em lote =====
+// O programa é convertido em registradores (DAG), então subexpressões repetidas são calculadas uma vez
+// por bloco. Cada instrução é aplicada a um bloco de até LOTE_BLOCO linhas, sobre vetores de registradores.
+// + - * / e raiz são IEEE com arredondamento correto tanto em SSE/AVX quanto no C escalar
+// (sqrt em double arredondado para float coincide com sqrtf), então os dois caminhos
+// produzem exatamente os mesmos bits que executarPrograma.
 
-    if (strncmp(expr, "raiz", 4) == 0) {
-        strcpy(token_buffer, "raiz");
-        *expr_ptr = expr + 4;
-        return token_buffer;
-    }
-    else if (strncmp(expr, "sen", 3) == 0) {
-        strcpy(token_buffer, "sen");
-        *expr_ptr = expr + 3;
-        return token_buffer;
-    }
-    else if (strncmp(expr, "cos", 3) == 0) {
-        strcpy(token_buffer, "cos");
-        *expr_ptr = expr + 3;
-        return token_buffer;
-    }
-    else if (strncmp(expr, "tg", 2) == 0) {
-        strcpy(token_buffer, "tg");
-        *expr_ptr = expr + 2;
-        return token_buffer;
-    }
-    else if (strncmp(expr, "log", 3) == 0) {
-        strcpy(token_buffer, "log");
-        *expr_ptr = expr + 3;
-        return token_buffer;
-    }
-    else if (strchr("+-*/%^()", *expr) != NULL) {
-        token_buffer[0] = *expr;
-        token_buffer[1] = '\0';
-        *expr_ptr = expr + 1;
-        return token_buffer;
-    }
-    else if (isdigit((unsigned char)*expr) || (*expr == '.' && isdigit((unsigned char)*(expr + 1))) ||
-             (*expr == '-' && (isdigit((unsigned char)*(expr + 1)) || (*(expr + 1) == '.' && isdigit((unsigned char)*(expr + 2))))) ) {
-        
-        if (*expr == '-') {
-            token_buffer[i++] = *expr;
-            expr++;
-        }
-        while (isdigit((unsigned char)*expr) || *expr == '.') {
-            token_buffer[i++] = *expr;
-            expr++;
-        }
-        token_buffer[i] = '\0';
-        *expr_ptr = expr;
-        return token_buffer;
+// Aplica um operador binário: a[i] = a[i] op b[i]
+static void loteBinario(OpCode op, float *a, const float *b, int n, unsigned char *erro) {
+    int i = 0;
+#if LOTE_LARGURA > 1
+    switch (op) {
+        case OP_SOMA: for (; i + LOTE_LARGURA <= n; i += LOTE_LARGURA) VET_GRAVA(a + i, VET_SOMA(VET_CARREGA(a + i), VET_CARREGA(b + i))); break;
+        case OP_SUB: for (; i + LOTE_LARGURA <= n; i += LOTE_LARGURA) VET_GRAVA(a + i, VET_SUB(VET_CARREGA(a + i), VET_CARREGA(b + i))); break;
+        case OP_MUL: for (; i + LOTE_LARGURA <= n; i += LOTE_LARGURA) VET_GRAVA(a + i, VET_MUL(VET_CARREGA(a + i), VET_CARREGA(b + i))); break;
+        case OP_DIV: for (; i + LOTE_LARGURA <= n; i += LOTE_LARGURA) VET_GRAVA(a + i, VET_DIV(VET_CARREGA(a + i), VET_CARREGA(b + i))); break;
+        default: break;
     }
-    else {
-        token_buffer[0] = *expr;
-        token_buffer[1] = '\0';
-        *expr_ptr = expr + 1;
-        return token_buffer;
+#endif
+    switch (op) {
+        case OP_SOMA: for (; i < n; i++) a[i] = a[i] + b[i]; break;
+        case OP_SUB: for (; i < n; i++) a[i] = a[i] - b[i]; break;
+        case OP_MUL: for (; i < n; i++) a[i] = a[i] * b[i]; break;
+        case OP_DIV: for (; i < n; i++) a[i] = a[i] / b[i]; break;
+        case OP_MOD: for (; i < n; i++) a[i] = fmod(a[i], b[i]); break;
+        case OP_POT: for (; i < n; i++) a[i] = pow(a[i], b[i]); break;
+        default: break;
+    }
+    if (op == OP_DIV) {
+        for (i = 0; i < n; i++) if (!erro[i] && b[i] == 0) erro[i] = CALC_ERRO_DIVISAO_ZERO;
     }
 }
 
-// Função: Pre-processa a string para substituir vírgulas por pontos
-void replaceCommasWithDots(char *str) {
-    if (str == NULL) return;
-    for (int i = 0; str[i] != '\0'; i++) {
-        if (str[i] == ',') {
-            str[i] = '.';
-        }
+// sen, cos, tg e log pelos núcleos rápidos. Se todo o bloco está no domínio dos núcleos, os laços não têm
+// desvios nem chamadas e podem ser vetorizados; senão, cada linha passa pela versão com o caso geral.
+static void loteRapido(OpCode op, float *a, int n, unsigned char *erro) {
+    int i, reduziveis = 1;
+    if (op == OP_TG) {
+        for (i = 0; i < n; i++) if (!erro[i] && tangenteInvalidaRapida(a[i])) erro[i] = CALC_ERRO_TANGENTE;
+    } else if (op == OP_LOG) {
+        for (i = 0; i < n; i++) if (!erro[i] && a[i] <= 0) erro[i] = CALC_ERRO_LOG;
+        for (i = 0; i < n; i++) a[i] = (float)nucleoLog10(a[i]);
+        return;
+    }
+    for (i = 0; i < n; i++) reduziveis &= fabsf(a[i]) <= GRAUS_RAPIDO_MAX;
+    switch (op) {
+        case OP_SEN:
+            if (reduziveis) for (i = 0; i < n; i++) a[i] = (float)nucleoSenGraus(a[i]);
+            else for (i = 0; i < n; i++) a[i] = (float)senGrausRapido(a[i]);
+            break;
+        case OP_COS:
+            if (reduziveis) for (i = 0; i < n; i++) a[i] = (float)nucleoCosGraus(a[i]);
+            else for (i = 0; i < n; i++) a[i] = (float)cosGrausRapido(a[i]);
+            break;
+        case OP_TG:
+            if (reduziveis) for (i = 0; i < n; i++) a[i] = (float)nucleoTgGraus(a[i]);
+            else for (i = 0; i < n; i++) a[i] = (float)tgGrausRapido(a[i]);
+            break;
+        default: break;
     }
 }
 
-// Função para aplicar um operador aos operandos e empilhar o resultado (para getValorInFixa)
-void applyOperator(Stack *operandStack, StackStr *operatorStack) {
-    char *op = popStr(operatorStack);
+// Aplica uma função: a[i] = f(a[i])
+static void loteUnario(OpCode op, float *a, int n, int rapido, unsigned char *erro) {
+    int i = 0;
+    if (rapido && op != OP_RAIZ) {
+        loteRapido(op, a, n, erro);
+        return;
+    }
+    switch (op) {
+        case OP_RAIZ:
+            for (i = 0; i < n; i++) if (!erro[i] && a[i] < 0) erro[i] = CALC_ERRO_RAIZ_NEGATIVA;
+            i = 0;
+#if LOTE_LARGURA > 1
+            for (; i + LOTE_LARGURA <= n; i += LOTE_LARGURA) VET_GRAVA(a + i, VET_RAIZ(VET_CARREGA(a + i)));
+#endif
+            for (; i < n; i++) a[i] = sqrt(a[i]);
+            break;
+        case OP_SEN: for (; i < n; i++) a[i] = sin(a[i] * PI / 180.0); break;
+        case OP_COS: for (; i < n; i++) a[i] = cos(a[i] * PI / 180.0); break;
+        case OP_TG:
+            for (; i < n; i++) {
+                double angle_mod_180 = fmod(fabs(a[i]), 180.0);
+                if (!erro[i] && (fabs(angle_mod_180 - 90.0) < 0.001 || fabs(angle_mod_180 - 270.0) < 0.001)) erro[i] = CALC_ERRO_TANGENTE;
+                a[i] = tan(a[i] * PI / 180.0);
+            }
+            break;
+        case OP_LOG:
+            for (; i < n; i++) {
+                if (!erro[i] && a[i] <= 0) erro[i] = CALC_ERRO_LOG;
+                a[i] = log10(a[i]);
+            }
+            break;
+        default: break;
+    }
+}
 
-    if (ehOperador(op)) {
-        if (isStackEmpty(operandStack) || operandStack->top < 1) {
-            fprintf(stderr, "Erro: Poucos operandos para operador binário '%s'.\n", op);
-            exit(EXIT_FAILURE);
-        }
-        float b = pop(operandStack);
-        float a = pop(operandStack);
-        float result;
+// Avalia as linhas [inicio, inicio + n) com n <= LOTE_BLOCO; erro recebe o código de cada linha
+static long avaliarBloco(const ProgramaReg *reg, const float *const *colunas, long inicio, int n,
+                         float (*r)[LOTE_BLOCO], unsigned char *erro, float *saida) {
+    long totalErros = 0;
+    memset(erro, CALC_OK, n);
 
-        if (strcmp(op, "+") == 0) result = a + b;
-        else if (strcmp(op, "-") == 0) result = a - b;
-        else if (strcmp(op, "*") == 0) result = a * b;
-        else if (strcmp(op, "/") == 0) {
-            if (b == 0) { fprintf(stderr, "Erro: Divisão por zero.\n"); exit(EXIT_FAILURE); }
-            result = a / b;
+    if (reg->precisao != PRECISAO_FLOAT) {
+        // Precisão maior: linha a linha no motor escalar; os registradores guardam os valores em double
+        double *valores = (double*)r;
+        for (int i = 0; i < n; i++) {
+            double resultado;
+            ErroCalc e;
+            for (int v = 0; v < reg->numVariaveis; v++) valores[v] = colunas[v][inicio + i];
+            if (executarRegistrosPrecisao(reg, valores, &resultado, &e) != CALC_OK) {
+                erro[i] = (unsigned char)e.codigo;
+                saida[inicio + i] = NAN;
+                totalErros++;
+            } else {
+                saida[inicio + i] = (float)resultado;
+            }
         }
-        else if (strcmp(op, "%") == 0) result = fmod(a, b);
-        else if (strcmp(op, "^") == 0) result = pow(a, b);
-        push(operandStack, result);
+        return totalErros;
     }
-    else if (ehFuncao(op)) {
-        if (isStackEmpty(operandStack)) {
-            fprintf(stderr, "Erro: Poucos operandos para função '%s'.\n", op);
-            exit(EXIT_FAILURE);
+
+    for (int k = 0; k < reg->tamanho; k++) {
+        const InstrucaoReg *ins = &reg->codigo[k];
+        float *destino = r[ins->destino];
+        PERFIL_INICIO(inicioPerfil);
+        switch (ins->op) {
+            case OP_NUM: {
+                float c = (float)reg->constantes[ins->a];
+                for (int i = 0; i < n; i++) destino[i] = c;
+                break;
+            }
+            case OP_VAR:
+                memcpy(destino, colunas[ins->a] + inicio, n * sizeof(float));
+                break;
+            case OP_SOMA: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD: case OP_POT:
+                if (ins->destino != ins->a) memcpy(destino, r[ins->a], n * sizeof(float));
+                loteBinario(ins->op, destino, r[ins->b], n, erro);
+                break;
+            default:
+                if (ins->destino != ins->a) memcpy(destino, r[ins->a], n * sizeof(float));
+                loteUnario(ins->op, destino, n, reg->matematica == MATEMATICA_RAPIDA, erro);
+                break;
         }
-        float a = pop(operandStack);
-        float result;
+        PERFIL_OPERACAO(ins->op, n, inicioPerfil);
+    }
 
-        if (strcmp(op, "raiz") == 0) { if (a < 0) { fprintf(stderr, "Erro: Raiz quadrada de número negativo.\n"); exit(EXIT_FAILURE); } result = sqrt(a); }
-        else if (strcmp(op, "sen") == 0) result = sin(a * PI / 180.0);
-        else if (strcmp(op, "cos") == 0) result = cos(a * PI / 180.0);
-        else if (strcmp(op, "tg") == 0) {
-            double angle_mod_180 = fmod(fabs(a), 180.0);
-            if (fabs(angle_mod_180 - 90.0) < 0.001 || fabs(angle_mod_180 - 270.0) < 0.001) { fprintf(stderr, "Erro: Tangente de ângulo invalido (90, 270 graus, etc.).\n"); exit(EXIT_FAILURE); }
-            result = tan(a * PI / 180.0);
+    const float *resultado = r[reg->resultado];
+    for (int i = 0; i < n; i++) {
+        if (erro[i] != CALC_OK) {
+            saida[inicio + i] = NAN;
+            totalErros++;
+        } else {
+            saida[inicio + i] = resultado[i];
         }
-        else if (strcmp(op, "log") == 0) { if (a <= 0) { fprintf(stderr, "Erro: Logaritmo de número não positivo.\n"); exit(EXIT_FAILURE); } result = log10(a); }
-        push(operandStack, result);
     }
+    return totalErros;
 }
 
+// Aloca os registradores (um vetor de LOTE_BLOCO por registrador) usados por um avaliador de lote
+// (fora da precisão float, o espaço guarda os valores das variáveis de uma linha, em double); NULL se faltar memória
+static float (*criarPilhaLote(const ProgramaReg *reg))[LOTE_BLOCO] {
+    int linhas = reg->numRegistros > 0 ? reg->numRegistros : 1;
+    int linhasValores = (int)((reg->numVariaveis * sizeof(double) + sizeof(float[LOTE_BLOCO]) - 1) / sizeof(float[LOTE_BLOCO]));
+    if (reg->precisao != PRECISAO_FLOAT && linhasValores > linhas) linhas = linhasValores;
+    return (float(*)[LOTE_BLOCO])malloc(linhas * sizeof(float[LOTE_BLOCO]));
+}
 
-// Implementação da função getFormaPosFixa
-char* getFormaPosFixa(char *Str) {
-    static char saida[512];
-    saida[0] = '\0';
+long avaliarLote(const Programa *prog, const float *const *colunas, long linhas, float *saida, unsigned char *status, ErroCalc *erro) {
+    ProgramaReg reg;
+    if (compilarRegistros(prog, &reg, erro) != CALC_OK) return -1;
+    float (*r)[LOTE_BLOCO] = criarPilhaLote(&reg);
+    if (r == NULL) {
+        liberarRegistros(&reg);
+        falhar(erro, CALC_ERRO_MEMORIA, -1);
+        return -1;
+    }
+    unsigned char erroBloco[LOTE_BLOCO];
+    long totalErros = 0;
 
-    StackStr pilha;
-    pilha.top = -1;
+    for (long inicio = 0; inicio < linhas; inicio += LOTE_BLOCO) {
+        int n = (linhas - inicio < LOTE_BLOCO) ? (int)(linhas - inicio) : LOTE_BLOCO;
+        totalErros += avaliarBloco(&reg, colunas, inicio, n, r, status ? status + inicio : erroBloco, saida);
+    }
 
-    char *expressao_copia = strdup(Str);
-    if (expressao_copia == NULL) {
-        fprintf(stderr, "Erro de alocação de memória para cópia da expressão.\n");
-        saida[0] = '\0';
-        return saida;
+    free(r);
+    liberarRegistros(&reg);
+    return totalErros;
+}
+
+// ===== Várias expressões numa passada =====
+// As expressões em float viram um DAG só, com hash-consing entre elas: o nó de cada variável (pelo nome),
+// de cada constante e de cada subexpressão comum é calculado uma vez por bloco. Cada registrador guarda,
+// além dos valores, o código de erro de cada linha, herdado do primeiro operando, depois do segundo e por
+// fim da própria operação: é a ordem em que a expressão sozinha acharia o erro. Por isso aqui + e * não
+// trocam os operandos (a + b e b + a são nós distintos, já que cada um acha primeiro o erro de um lado), e
+// sen, cos, tg e log guardam o modo em b, já que os dois modos dão valores diferentes. O resultado de cada
+// expressão vai para a saída logo depois da instrução que o calcula, e o registrador é reaproveitado.
+
+#define MULTI_ORCAMENTO_CACHE (192 * 1024) // Bytes de registradores (valores e erros) de um bloco, para caber no L2
+#define MULTI_LINHAS_MINIMO 16
+
+typedef struct {
+    OpCode op;
+    int destino, a, b; // Como em InstrucaoReg; nas funções, b é 1 se a matemática é rápida
+} InstrucaoMulti;
+
+typedef struct {
+    int instrucao; // Depois dela, o resultado está pronto
+    int registro;
+    int expressao;
+} SaidaMulti;
+
+// Expressão em double ou long double: avaliada linha a linha no seu próprio programa em registradores
+typedef struct {
+    int expressao;
+    ProgramaReg reg;
+    int *colunas; // Coluna do ProgramaMulti de cada slot de reg
+} EscalarMulti;
+
+struct ProgramaMulti {
+    int numExpressoes;
+    InstrucaoMulti *codigo;
+    int tamanho;
+    float *constantes;
+    int numConstantes;
+    int numRegistros;
+    SaidaMulti *saidas; // Em ordem de instrução
+    int numSaidas;
+    EscalarMulti *escalares;
+    int numEscalares;
+    char (*variaveis)[TAM_NOME_VARIAVEL];
+    int numVariaveis;
+    int instrucoes; // Soma das instruções das expressões em float
+    int linhasPorBloco;
+};
+
+void liberarMulti(ProgramaMulti *multi) {
+    if (multi == NULL) return;
+    for (int k = 0; k < multi->numEscalares; k++) {
+        liberarRegistros(&multi->escalares[k].reg);
+        free(multi->escalares[k].colunas);
+    }
+    free(multi->escalares);
+    free(multi->codigo);
+    free(multi->constantes);
+    free(multi->saidas);
+    free(multi->variaveis);
+    free(multi);
+}
+
+// Coluna da variável nome, criando-a se for nova; tabela é o índice dos nomes (endereçamento aberto)
+static int colunaMulti(ProgramaMulti *multi, int *tabela, int mascara, const char *nome) {
+    unsigned i = hashNome(nome) & mascara;
+    while (tabela[i] >= 0 && strcmp(multi->variaveis[tabela[i]], nome) != 0) i = (i + 1) & mascara;
+    if (tabela[i] < 0) {
+        strcpy(multi->variaveis[multi->numVariaveis], nome);
+        tabela[i] = multi->numVariaveis++;
     }
-    replaceCommasWithDots(expressao_copia);
+    return tabela[i];
+}
+
+ProgramaMulti *compilarMulti(const Programa *programas, int n, ErroCalc *erro) {
+    int total = 0, totalVariaveis = 0, numNos = 0, mascara = 1, mascaraNomes = 1;
+    for (int f = 0; f < n; f++) {
+        total += programas[f].tamanho;
+        totalVariaveis += programas[f].numVariaveis;
+    }
+    while (mascara < 2 * total) mascara *= 2;
+    while (mascaraNomes < 2 * totalVariaveis) mascaraNomes *= 2;
 
-    char *expressao_ptr = expressao_copia;
-    char token_buffer[32];
-    char* token;
+    ProgramaMulti *multi = (ProgramaMulti*)calloc(1, sizeof(ProgramaMulti));
+    NoDag *nos = (NoDag*)malloc((total + 1) * sizeof(NoDag));
+    int *tabela = (int*)malloc(mascara * sizeof(int));
+    int *tabelaNomes = (int*)malloc(mascaraNomes * sizeof(int));
+    int *pilha = (int*)malloc((total + 1) * sizeof(int));
+    int *colunas = (int*)malloc((totalVariaveis + 1) * sizeof(int)); // Coluna de cada slot da expressão atual
+    int *resultados = (int*)malloc((n + 1) * sizeof(int)); // Nó de cada expressão em float (-1 nas outras)
+    int *usos = (int*)calloc(total + 1, sizeof(int));
+    int *registro = (int*)malloc((total + 1) * sizeof(int));
+    int *livres = (int*)malloc((total + 1) * sizeof(int));
+    int *inicioSaidas = (int*)calloc(total + 2, sizeof(int));
+    if (multi == NULL || nos == NULL || tabela == NULL || tabelaNomes == NULL || pilha == NULL || colunas == NULL ||
+        resultados == NULL || usos == NULL || registro == NULL || livres == NULL || inicioSaidas == NULL ||
+        (multi->variaveis = (char(*)[TAM_NOME_VARIAVEL])malloc((totalVariaveis + 1) * TAM_NOME_VARIAVEL)) == NULL ||
+        (multi->escalares = (EscalarMulti*)calloc(n + 1, sizeof(EscalarMulti))) == NULL) {
+        goto semMemoria;
+    }
+    for (int i = 0; i < mascara; i++) tabela[i] = -1;
+    for (int i = 0; i < mascaraNomes; i++) tabelaNomes[i] = -1;
+    mascara--;
+    mascaraNomes--;
+    multi->numExpressoes = n;
 
-    while ((token = getNextToken(&expressao_ptr, token_buffer)) != NULL) {
-        if (strcmp(token, "") == 0) continue;
-        
-        if (isNumber(token)) {
-            strcat(saida, token);
-            strcat(saida, " ");
+    // Monta o DAG fundido simulando a pilha de cada programa
+    for (int f = 0; f < n; f++) {
+        const Programa *prog = &programas[f];
+        int top = -1;
+        for (int v = 0; v < prog->numVariaveis; v++) colunas[v] = colunaMulti(multi, tabelaNomes, mascaraNomes, prog->variaveis[v]);
+        resultados[f] = -1;
+        if (prog->precisao != PRECISAO_FLOAT) {
+            EscalarMulti *e = &multi->escalares[multi->numEscalares++];
+            e->expressao = f;
+            if ((e->colunas = (int*)malloc((prog->numVariaveis + 1) * sizeof(int))) == NULL) goto semMemoria;
+            memcpy(e->colunas, colunas, prog->numVariaveis * sizeof(int));
+            if (compilarRegistros(prog, &e->reg, erro) != CALC_OK) goto semMemoria;
+            continue;
         }
-        else if (ehFuncao(token)) {
-            pushStr(&pilha, token);
+        multi->instrucoes += prog->tamanho;
+        for (int k = 0; k < prog->tamanho; k++) {
+            const Instrucao *ins = &prog->codigo[k];
+            int id;
+            if (ins->op == OP_NUM) {
+                int bits[2];
+                memcpy(bits, &prog->constantes[ins->arg], sizeof(bits));
+                id = nodoDag(nos, &numNos, tabela, mascara, NULL, 0, OP_NUM, bits[0], bits[1], 0);
+            } else if (ins->op == OP_VAR) {
+                id = nodoDag(nos, &numNos, tabela, mascara, NULL, 0, OP_VAR, colunas[ins->arg], -1, 0);
+            } else if (ins->op == OP_DUP) {
+                id = pilha[top];
+            } else if (ehFuncaoOp(ins->op)) {
+                int modo = ins->op != OP_RAIZ && prog->matematica == MATEMATICA_RAPIDA ? -2 : -1;
+                id = nodoDag(nos, &numNos, tabela, mascara, NULL, 0, ins->op, pilha[top--], modo, 0);
+            } else {
+                int b = pilha[top--], a = pilha[top--];
+                id = nodoDag(nos, &numNos, tabela, mascara, NULL, 0, ins->op, a, b, 0);
+            }
+            pilha[++top] = id;
+        }
+        resultados[f] = pilha[0];
+        inicioSaidas[pilha[0] + 1]++;
+        multi->numSaidas++;
+    }
+
+    multi->codigo = (InstrucaoMulti*)malloc((numNos + 1) * sizeof(InstrucaoMulti));
+    multi->constantes = (float*)malloc((numNos + 1) * sizeof(float));
+    multi->saidas = (SaidaMulti*)malloc((multi->numSaidas + 1) * sizeof(SaidaMulti));
+    if (multi->codigo == NULL || multi->constantes == NULL || multi->saidas == NULL) goto semMemoria;
+    for (int i = 0; i < numNos; i++) {
+        if (nos[i].op == OP_NUM || nos[i].op == OP_VAR) continue;
+        usos[nos[i].a]++;
+        if (nos[i].b >= 0) usos[nos[i].b]++;
+    }
+
+    // Escalona como compilarRegistros; um nó que só é resultado libera o registrador logo depois de copiado
+    int numLivres = 0;
+    for (int i = 0; i < numNos; i++) {
+        InstrucaoMulti *ins = &multi->codigo[i];
+        ins->op = (OpCode)nos[i].op;
+        ins->a = ins->b = -1;
+        if (nos[i].op == OP_NUM) {
+            double valor;
+            int bits[2] = { nos[i].a, nos[i].b };
+            memcpy(&valor, bits, sizeof(double));
+            multi->constantes[multi->numConstantes] = (float)valor;
+            ins->a = multi->numConstantes++;
+        } else if (nos[i].op == OP_VAR) {
+            ins->a = nos[i].a;
+        } else {
+            ins->a = registro[nos[i].a];
+            if (--usos[nos[i].a] == 0) livres[numLivres++] = ins->a;
         }
-        else if (strcmp(token, "(") == 0) {
-            pushStr(&pilha, token);
+        ins->destino = numLivres > 0 ? livres[--numLivres] : multi->numRegistros++;
+        if (nos[i].op != OP_NUM && nos[i].b >= 0) {
+            ins->b = registro[nos[i].b];
+            if (--usos[nos[i].b] == 0) livres[numLivres++] = ins->b;
+        } else if (ehFuncaoOp(nos[i].op)) {
+            ins->b = nos[i].b == -2;
         }
-        else if (strcmp(token, ")") == 0) {
-            while (!isEmptyStr(&pilha) && strcmp(peekStr(&pilha), "(") != 0) {
-                strcat(saida, popStr(&pilha));
-                strcat(saida, " ");
-            }
-            if (!isEmptyStr(&pilha) && strcmp(peekStr(&pilha), "(") == 0) {
-                popStr(&pilha);
+        registro[i] = ins->destino;
+        if (usos[i] == 0) livres[numLivres++] = ins->destino;
+    }
+    multi->tamanho = numNos;
+
+    // Saídas agrupadas pela instrução que calcula o resultado (contagem por nó)
+    for (int i = 0; i < numNos; i++) inicioSaidas[i + 1] += inicioSaidas[i];
+    for (int f = 0; f < n; f++) {
+        if (resultados[f] < 0) continue;
+        SaidaMulti *s = &multi->saidas[inicioSaidas[resultados[f]]++];
+        s->instrucao = resultados[f];
+        s->registro = registro[resultados[f]];
+        s->expressao = f;
+    }
+
+    long bytesPorLinha = (long)(multi->numRegistros > 0 ? multi->numRegistros : 1) * (sizeof(float) + 1);
+    long linhasPorBloco = MULTI_ORCAMENTO_CACHE / bytesPorLinha / MULTI_LINHAS_MINIMO * MULTI_LINHAS_MINIMO;
+    multi->linhasPorBloco = (int)(linhasPorBloco < MULTI_LINHAS_MINIMO ? MULTI_LINHAS_MINIMO : linhasPorBloco > LOTE_BLOCO ? LOTE_BLOCO : linhasPorBloco);
+    goto fim;
+
+semMemoria:
+    liberarMulti(multi);
+    multi = NULL;
+    falhar(erro, CALC_ERRO_MEMORIA, -1);
+fim:
+    free(nos); free(tabela); free(tabelaNomes); free(pilha); free(colunas); free(resultados);
+    free(usos); free(registro); free(livres); free(inicioSaidas);
+    return multi;
+}
+
+int getIndiceVariavelMulti(const ProgramaMulti *multi, const char *nome) {
+    for (int v = 0; v < multi->numVariaveis; v++) {
+        if (strcmp(multi->variaveis[v], nome) == 0) return v;
+    }
+    return -1;
+}
+
+void getEstatisticasMulti(const ProgramaMulti *multi, EstatisticasMulti *estatisticas) {
+    estatisticas->expressoes = multi->numExpressoes;
+    estatisticas->variaveis = multi->numVariaveis;
+    estatisticas->instrucoes = multi->instrucoes;
+    estatisticas->nos = multi->tamanho;
+    estatisticas->registradores = multi->numRegistros;
+    estatisticas->linhasPorBloco = multi->linhasPorBloco;
+}
+
+// Operações que podem achar erro de domínio no lote (as outras nunca leem nem escrevem erro)
+static int podeFalharLote(OpCode op) {
+    return op == OP_DIV || op == OP_RAIZ || op == OP_TG || op == OP_LOG;
+}
+
+// Copia as n linhas do registrador r para a saída da expressão; e são os erros, ou NULL se o bloco não
+// teve nenhum. Retorna quantas linhas tiveram erro.
+static long copiarSaidaMulti(const float *r, const unsigned char *e, long inicio, int n, float *saida, unsigned char *status) {
+    long erros = 0;
+    if (e == NULL) {
+        memcpy(saida + inicio, r, n * sizeof(float));
+        if (status != NULL) memset(status + inicio, CALC_OK, n);
+        return 0;
+    }
+    for (int i = 0; i < n; i++) {
+        saida[inicio + i] = e[i] != CALC_OK ? NAN : r[i];
+        erros += e[i] != CALC_OK;
+    }
+    if (status != NULL) memcpy(status + inicio, e, n);
+    return erros;
+}
+
+long avaliarLoteMulti(const ProgramaMulti *multi, const float *const *colunas, long linhas, float *const *saidas,
+                      unsigned char *const *status, ErroCalc *erro) {
+    int numRegistros = multi->numRegistros > 0 ? multi->numRegistros : 1, maxVariaveis = 1;
+    for (int k = 0; k < multi->numEscalares; k++) {
+        if (multi->escalares[k].reg.numVariaveis > maxVariaveis) maxVariaveis = multi->escalares[k].reg.numVariaveis;
+    }
+    float (*r)[LOTE_BLOCO] = (float(*)[LOTE_BLOCO])malloc(numRegistros * sizeof(*r));
+    unsigned char (*e)[LOTE_BLOCO] = (unsigned char(*)[LOTE_BLOCO])malloc(numRegistros * sizeof(*e));
+    unsigned char *comErro = (unsigned char*)malloc(numRegistros); // Se 0, o bloco não tem erros no registrador e e não vale
+    double *valores = (double*)malloc(maxVariaveis * sizeof(double));
+    long totalErros = 0;
+    if (r == NULL || e == NULL || comErro == NULL || valores == NULL) {
+        falhar(erro, CALC_ERRO_MEMORIA, -1);
+        totalErros = -1;
+        goto fim;
+    }
+
+    for (long inicio = 0; inicio < linhas; inicio += multi->linhasPorBloco) {
+        int n = (linhas - inicio < multi->linhasPorBloco) ? (int)(linhas - inicio) : multi->linhasPorBloco;
+        const SaidaMulti *saida = multi->saidas, *fimSaidas = multi->saidas + multi->numSaidas;
+        for (int k = 0; k < multi->tamanho; k++) {
+            const InstrucaoMulti *ins = &multi->codigo[k];
+            float *destino = r[ins->destino];
+            unsigned char *erro = e[ins->destino];
+            PERFIL_INICIO(inicioPerfil);
+            if (ins->op == OP_NUM) {
+                float c = multi->constantes[ins->a];
+                for (int i = 0; i < n; i++) destino[i] = c;
+                comErro[ins->destino] = 0;
+            } else if (ins->op == OP_VAR) {
+                memcpy(destino, colunas[ins->a] + inicio, n * sizeof(float));
+                comErro[ins->destino] = 0;
             } else {
-                fprintf(stderr, "Erro: Parênteses desbalanceados na expressão infixa.\n");
-                saida[0] = '\0';
-                free(expressao_copia);
-                return saida;
+                // Erros herdados: os de a e, onde a não tem, os de b
+                int binario = !ehFuncaoOp(ins->op), erroA = comErro[ins->a], erroB = binario && comErro[ins->b];
+                if (ins->destino != ins->a) memcpy(destino, r[ins->a], n * sizeof(float));
+                if (erroA) {
+                    if (ins->destino != ins->a) memcpy(erro, e[ins->a], n);
+                    if (erroB) for (int i = 0; i < n; i++) erro[i] = erro[i] != CALC_OK ? erro[i] : e[ins->b][i];
+                } else if (erroB) {
+                    memcpy(erro, e[ins->b], n);
+                } else if (podeFalharLote(ins->op)) {
+                    memset(erro, CALC_OK, n);
+                }
+                if (binario) loteBinario(ins->op, destino, r[ins->b], n, erro);
+                else loteUnario(ins->op, destino, n, ins->b, erro);
+                if (!erroA && !erroB && podeFalharLote(ins->op)) {
+                    unsigned char algum = 0;
+                    for (int i = 0; i < n; i++) algum |= erro[i];
+                    comErro[ins->destino] = algum != CALC_OK;
+                } else {
+                    comErro[ins->destino] = (unsigned char)(erroA || erroB);
+                }
             }
-            if (!isEmptyStr(&pilha) && ehFuncao(peekStr(&pilha))) {
-                strcat(saida, popStr(&pilha));
-                strcat(saida, " ");
+            PERFIL_OPERACAO(ins->op, n, inicioPerfil);
+            for (; saida < fimSaidas && saida->instrucao == k; saida++) {
+                totalErros += copiarSaidaMulti(r[saida->registro], comErro[saida->registro] ? e[saida->registro] : NULL, inicio, n,
+                                               saidas[saida->expressao], status != NULL ? status[saida->expressao] : NULL);
             }
         }
-        else if (ehOperador(token)) {
-            while (!isEmptyStr(&pilha) &&
-                   (ehFuncao(peekStr(&pilha)) || ehOperador(peekStr(&pilha))) &&
-                   (prioridade(peekStr(&pilha)) > prioridade(token) ||
-                    (prioridade(peekStr(&pilha)) == prioridade(token) && strcmp(token, "^") != 0))) {
-                strcat(saida, popStr(&pilha));
-                strcat(saida, " ");
+
+        // Expressões em double e long double, com as colunas do bloco ainda no cache
+        for (int k = 0; k < multi->numEscalares; k++) {
+            const EscalarMulti *es = &multi->escalares[k];
+            for (int i = 0; i < n; i++) {
+                double resultado;
+                ErroCalc erroLinha;
+                int cod;
+                for (int v = 0; v < es->reg.numVariaveis; v++) valores[v] = colunas[es->colunas[v]][inicio + i];
+                if ((cod = executarRegistrosPrecisao(&es->reg, valores, &resultado, &erroLinha)) != CALC_OK) {
+                    saidas[es->expressao][inicio + i] = NAN;
+                    totalErros++;
+                } else {
+                    saidas[es->expressao][inicio + i] = (float)resultado;
+                }
+                if (status != NULL) status[es->expressao][inicio + i] = (unsigned char)cod;
             }
-            pushStr(&pilha, token);
         }
-        else {
-            fprintf(stderr, "Erro: Token desconhecido na expressão infixa: '%s'\n", token);
-            saida[0] = '\0';
-            free(expressao_copia);
-            return saida;
+    }
+
+fim:
+    free(r);
+    free(e);
+    free(comErro);
+    free(valores);
+    return totalErros;
+}
+
+// ===== Avaliação em lote paralela =====
+// As linhas são divididas em pedaços de LOTE_PEDACO linhas. Cada trabalhador começa com uma faixa
+// contígua de pedaços, consome do início dela e, quando esvazia, rouba do fim da faixa de outro.
+// A faixa [proximo, fim) de cada trabalhador fica num único inteiro atômico, então dono e ladrão
+// disputam apenas um compare-and-swap.
+
+typedef struct {
+    _Atomic unsigned long long faixa; // (proximo << 32) | fim
+    char preenchimento[64 - sizeof(unsigned long long)]; // Evita falso compartilhamento entre trabalhadores
+} FaixaPedacos;
+
+typedef struct {
+    const ProgramaReg *reg;
+    const float *const *colunas;
+    long linhas;
+    float *saida;
+    unsigned char *status;
+    FaixaPedacos *faixas;
+    int numTrabalhadores;
+    int id;
+    float (*r)[LOTE_BLOCO]; // Registradores próprios, alocados pela thread chamadora
+    long erros;
+} Trabalhador;
+
+// Retira um pedaço da faixa: do início se for o dono, do fim se for ladrão; -1 se vazia
+static long retirarPedaco(FaixaPedacos *f, int doInicio) {
+    unsigned long long atual = atomic_load(&f->faixa);
+    for (;;) {
+        unsigned long long proximo = atual >> 32, fim = atual & 0xFFFFFFFFull;
+        if (proximo >= fim) return -1;
+        unsigned long long novo = doInicio ? (((proximo + 1) << 32) | fim) : ((proximo << 32) | (fim - 1));
+        if (atomic_compare_exchange_weak(&f->faixa, &atual, novo)) {
+            return (long)(doInicio ? proximo : fim - 1);
         }
     }
+}
 
-    while (!isEmptyStr(&pilha)) {
-        if (strcmp(peekStr(&pilha), "(") == 0) {
-            fprintf(stderr, "Erro: Parênteses desbalanceados na expressão infixa ( '(' sem ')').\n");
-            saida[0] = '\0';
-            free(expressao_copia);
-            return saida;
+static void *executarTrabalhador(void *arg) {
+    Trabalhador *t = (Trabalhador*)arg;
+    unsigned char erro[LOTE_BLOCO];
+    int vitima = t->id;
+
+    for (;;) {
+        long pedaco = retirarPedaco(&t->faixas[t->id], 1);
+        // Faixa própria vazia: procura outra com trabalho, começando pela última vítima
+        for (int tentativa = 0; pedaco < 0 && tentativa < t->numTrabalhadores; tentativa++) {
+            if (vitima != t->id) pedaco = retirarPedaco(&t->faixas[vitima], 0);
+            if (pedaco < 0) vitima = (vitima + 1) % t->numTrabalhadores;
+        }
+        if (pedaco < 0) break;
+
+        long fimPedaco = (pedaco + 1) * LOTE_PEDACO < t->linhas ? (pedaco + 1) * LOTE_PEDACO : t->linhas;
+        for (long inicio = pedaco * LOTE_PEDACO; inicio < fimPedaco; inicio += LOTE_BLOCO) {
+            int n = (fimPedaco - inicio < LOTE_BLOCO) ? (int)(fimPedaco - inicio) : LOTE_BLOCO;
+            t->erros += avaliarBloco(t->reg, t->colunas, inicio, n, t->r, t->status ? t->status + inicio : erro, t->saida);
         }
-        strcat(saida, popStr(&pilha));
-        strcat(saida, " ");
     }
+    return NULL;
+}
+
+// Número de processadores disponíveis
+int getNumeroNucleos(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+long avaliarLoteParalelo(const Programa *prog, const float *const *colunas, long linhas, float *saida,
+                         unsigned char *status, int numThreads, ErroCalc *erro) {
+    if (numThreads <= 0) numThreads = getNumeroNucleos();
+    long numPedacos = (linhas + LOTE_PEDACO - 1) / LOTE_PEDACO;
+    if (numThreads > numPedacos) numThreads = numPedacos > 0 ? (int)numPedacos : 1;
+    if (numThreads == 1) return avaliarLote(prog, colunas, linhas, saida, status, erro);
+
+    ProgramaReg reg;
+    if (compilarRegistros(prog, &reg, erro) != CALC_OK) return -1;
+    FaixaPedacos *faixas = (FaixaPedacos*)malloc(numThreads * sizeof(FaixaPedacos));
+    Trabalhador *trabalhadores = (Trabalhador*)calloc(numThreads, sizeof(Trabalhador));
+    pthread_t *threads = (pthread_t*)malloc(numThreads * sizeof(pthread_t));
+    unsigned char *criada = (unsigned char*)calloc(numThreads, 1);
+    long totalErros = -1;
+    if (faixas == NULL || trabalhadores == NULL || threads == NULL || criada == NULL) goto fim;
+
+    for (int w = 0; w < numThreads; w++) {
+        unsigned long long inicio = numPedacos * w / numThreads;
+        unsigned long long fim = numPedacos * (w + 1) / numThreads;
+        atomic_init(&faixas[w].faixa, (inicio << 32) | fim);
+        trabalhadores[w] = (Trabalhador){ &reg, colunas, linhas, saida, status, faixas, numThreads, w, criarPilhaLote(&reg), 0 };
+        if (trabalhadores[w].r == NULL) goto fim;
+    }
+    // A thread chamadora trabalha como trabalhador 0. Se uma thread não for criada, os outros roubam a faixa dela.
+    for (int w = 1; w < numThreads; w++) {
+        criada[w] = pthread_create(&threads[w], NULL, executarTrabalhador, &trabalhadores[w]) == 0;
+    }
+    executarTrabalhador(&trabalhadores[0]);
 
-    if (strlen(saida) > 0 && saida[strlen(saida) - 1] == ' ') {
-        saida[strlen(saida) - 1] = '\0';
+    totalErros = trabalhadores[0].erros;
+    for (int w = 1; w < numThreads; w++) {
+        if (criada[w]) pthread_join(threads[w], NULL);
+        totalErros += trabalhadores[w].erros;
     }
 
-    free(expressao_copia);
-    return saida;
+fim:
+    if (totalErros < 0) falhar(erro, CALC_ERRO_MEMORIA, -1);
+    for (int w = 0; trabalhadores != NULL && w < numThreads; w++) free(trabalhadores[w].r);
+    free(faixas); free(trabalhadores); free(threads); free(criada);
+    liberarRegistros(&reg);
+    return totalErros;
 }
 
-// Implementação da função getFormaInFixa (converter de pós-fixa para infixa)
-char* getFormaInFixa(char* Str) {
-    static char result_infixa[512];
-    result_infixa[0] = '\0';
+// ===== Pacote de programas compilados =====
+// Formato (versão 1), com todos os blocos começando em múltiplos de 8 bytes:
+//   cabeçalho   CabecalhoPacote (32 bytes)
+//   diretório   numProgramas deslocamentos (uint64), do início do pacote até o registro de cada programa
+//   registros   RegistroPacote (32 bytes), codigo (tamanho x {int32 op, int32 arg}), constantes (numConstantes
+//               x double), posicoes (tamanho x int32), variaveis (numVariaveis x TAM_NOME_VARIAVEL) e o texto
+//               de origem com '\0'; posicoes e o texto são completados com zeros até múltiplo de 8
+// As instruções no arquivo têm o leiaute de Instrucao, então o programa carregado aponta direto para elas.
+
+#define PACOTE_MAGICA "CALCPAC" // 8 bytes, com o '\0'
+#define PACOTE_VERSAO 1
+#define PACOTE_MARCA_ORDEM 0x01020304u // Lida com outro valor numa máquina de outra ordem de bytes
+#define PACOTE_CONTEXTO_INICIAL 4096 // Arena dos programas carregados, que só é usada se forem otimizados
+#define ALINHAR8(n) (((n) + 7) & ~(uint64_t)7)
+
+_Static_assert(sizeof(Instrucao) == 2 * sizeof(int32_t) && offsetof(Instrucao, arg) == sizeof(int32_t),
+               "o pacote grava as instrucoes com o leiaute de Instrucao");
+
+typedef struct {
+    char magica[8];
+    uint32_t versao;
+    uint32_t marcaOrdem;
+    uint32_t numProgramas;
+    uint32_t reservado;
+    uint64_t tamanho; // Bytes do pacote inteiro
+} CabecalhoPacote;
+
+typedef struct {
+    int32_t tamanho, numConstantes, numVariaveis, profundidade;
+    int32_t precisao, matematica;
+    int32_t tamanhoTexto; // Sem o '\0'
+    int32_t reservado;
+} RegistroPacote;
+
+struct PacoteProgramas {
+    const char *dados;
+    long long tamanho;
+    int numProgramas;
+    int mapeado; // 1 se dados veio de abrirPacote e é desmapeado ao fechar
+    ContextoCalc *contexto; // Dono dos programas carregados: liberarPrograma não faz nada neles
+};
+
+static const char *textoPacote(const char *const *textos, int i) {
+    return textos != NULL && textos[i] != NULL ? textos[i] : "";
+}
+
+// Bytes do registro de um programa com essas contagens
+static uint64_t tamanhoRegistro(uint64_t tamanho, uint64_t numConstantes, uint64_t numVariaveis, uint64_t tamanhoTexto) {
+    return sizeof(RegistroPacote) + tamanho * sizeof(Instrucao) + numConstantes * sizeof(double) +
+           ALINHAR8(tamanho * sizeof(int32_t)) + ALINHAR8(numVariaveis * TAM_NOME_VARIAVEL + tamanhoTexto + 1);
+}
 
-    StackStr pilha; // Pilha para armazenar sub-expressões infixas
-    pilha.top = -1;
+long tamanhoPacote(const Programa *programas, const char *const *textos, int n) {
+    uint64_t total = sizeof(CabecalhoPacote) + (uint64_t)n * sizeof(uint64_t);
+    for (int i = 0; i < n; i++) {
+        total += tamanhoRegistro(programas[i].tamanho, programas[i].numConstantes, programas[i].numVariaveis, strlen(textoPacote(textos, i)));
+    }
+    return (long)total;
+}
 
-    // Fazer uma cópia de Str porque strtok modifica a string
-    char *StrCopia = strdup(Str);
-    if (StrCopia == NULL) {
-        fprintf(stderr, "Erro de alocação de memória para cópia da string.\n");
-        return result_infixa;
+long escreverPacote(const Programa *programas, const char *const *textos, int n, void *saida, long tamanho, ErroCalc *erro) {
+    long total = tamanhoPacote(programas, textos, n);
+    if (total > tamanho) {
+        falhar(erro, CALC_ERRO_BUFFER_PEQUENO, -1);
+        return -1;
     }
+    char *base = (char*)saida;
+    memset(base, 0, total); // Preenchimentos zerados: os mesmos programas dão sempre os mesmos bytes
+    CabecalhoPacote cabecalho = { PACOTE_MAGICA, PACOTE_VERSAO, PACOTE_MARCA_ORDEM, (uint32_t)n, 0, (uint64_t)total };
+    memcpy(base, &cabecalho, sizeof(cabecalho));
 
-    char *token = strtok(StrCopia, " ");
+    uint64_t deslocamento = sizeof(CabecalhoPacote) + (uint64_t)n * sizeof(uint64_t);
+    for (int i = 0; i < n; i++) {
+        const Programa *prog = &programas[i];
+        const char *texto = textoPacote(textos, i);
+        RegistroPacote registro = { prog->tamanho, prog->numConstantes, prog->numVariaveis, prog->profundidade,
+                                    prog->precisao, prog->matematica, (int32_t)strlen(texto), 0 };
+        memcpy(base + sizeof(CabecalhoPacote) + i * sizeof(uint64_t), &deslocamento, sizeof(uint64_t));
 
-    while (token != NULL) {
-        if (isNumber(token)) {
-            pushStr(&pilha, token);
-        } else if (ehFuncao(token)) {
-            if (isEmptyStr(&pilha)) {
-                fprintf(stderr, "Erro: Poucos operandos para função '%s' em expressao pos-fixa.\n", token);
-                free(StrCopia);
-                return result_infixa;
-            }
-            char *operand = popStr(&pilha);
-            snprintf(result_infixa, sizeof(result_infixa), "%s(%s)", token, operand);
-            pushStr(&pilha, result_infixa);
-        } else if (ehOperador(token)) {
-            if (isEmptyStr(&pilha) || pilha.top < 1) {
-                fprintf(stderr, "Erro: Poucos operandos para operador binário '%s' em expressao pos-fixa.\n", token);
-                free(StrCopia);
-                return result_infixa;
-            }
-            char *operand2 = popStr(&pilha);
-            char *operand1 = popStr(&pilha);
+        char *p = base + deslocamento;
+        memcpy(p, &registro, sizeof(registro));
+        p += sizeof(registro);
+        memcpy(p, prog->codigo, prog->tamanho * sizeof(Instrucao));
+        p += prog->tamanho * sizeof(Instrucao);
+        if (prog->numConstantes > 0) memcpy(p, prog->constantes, prog->numConstantes * sizeof(double));
+        p += prog->numConstantes * sizeof(double);
+        memcpy(p, prog->posicoes, prog->tamanho * sizeof(int32_t));
+        p += ALINHAR8(prog->tamanho * sizeof(int32_t));
+        for (int v = 0; v < prog->numVariaveis; v++, p += TAM_NOME_VARIAVEL) {
+            memcpy(p, prog->variaveis[v], strlen(prog->variaveis[v]) + 1); // Sem o lixo depois do '\0'
+        }
+        memcpy(p, texto, registro.tamanhoTexto + 1);
+        deslocamento += tamanhoRegistro(prog->tamanho, prog->numConstantes, prog->numVariaveis, registro.tamanhoTexto);
+    }
+    return total;
+}
 
-            snprintf(result_infixa, sizeof(result_infixa), "(%s %s %s)", operand1, token, operand2);
-            pushStr(&pilha, result_infixa);
+int salvarPacote(const char *nomeArquivo, const Programa *programas, const char *const *textos, int n, ErroCalc *erro) {
+    long tamanho = tamanhoPacote(programas, textos, n);
+    char *dados = (char*)malloc(tamanho);
+    if (dados == NULL) return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    escreverPacote(programas, textos, n, dados, tamanho, erro);
+    FILE *arquivo = fopen(nomeArquivo, "wb");
+    int gravado = arquivo != NULL && fwrite(dados, 1, tamanho, arquivo) == (size_t)tamanho;
+    if (arquivo != NULL && fclose(arquivo) != 0) gravado = 0;
+    free(dados);
+    return gravado ? CALC_OK : falhar(erro, CALC_ERRO_ARQUIVO, -1);
+}
 
-        } else {
-            fprintf(stderr, "Erro: Token desconhecido na expressao pos-fixa: '%s'\n", token);
-            free(StrCopia);
-            return result_infixa;
+// CALC_ERRO_PACOTE_INVALIDO com a posição do byte do problema (-1 se não couber num int)
+static int falharPacote(ErroCalc *erro, uint64_t byte) {
+    return falhar(erro, CALC_ERRO_PACOTE_INVALIDO, byte <= INT32_MAX ? (int)byte : -1);
+}
+
+// Confere o registro em deslocamento: limites, contagens, nomes e texto terminados em '\0', e cada instrução
+// (opcode, índice da constante ou do slot e operandos na pilha), como a compilação garantiria
+static int validarRegistro(const char *dados, uint64_t tamanho, uint64_t inicio, uint64_t deslocamento, ErroCalc *erro) {
+    if (deslocamento % 8 != 0 || deslocamento < inicio || deslocamento > tamanho || tamanho - deslocamento < sizeof(RegistroPacote)) {
+        return falharPacote(erro, deslocamento);
+    }
+    const RegistroPacote *r = (const RegistroPacote*)(dados + deslocamento);
+    if (r->tamanho < 1 || r->numConstantes < 0 || r->numVariaveis < 0 || r->tamanhoTexto < 0 ||
+        r->profundidade < 1 || r->profundidade > r->tamanho ||
+        r->precisao < PRECISAO_FLOAT || r->precisao > PRECISAO_LONG_DOUBLE ||
+        r->matematica < MATEMATICA_EXATA || r->matematica > MATEMATICA_RAPIDA ||
+        tamanhoRegistro(r->tamanho, r->numConstantes, r->numVariaveis, r->tamanhoTexto) > tamanho - deslocamento) {
+        return falharPacote(erro, deslocamento);
+    }
+
+    const Instrucao *codigo = (const Instrucao*)(r + 1);
+    int altura = 0, maximo = 0;
+    for (int k = 0; k < r->tamanho; k++) {
+        int op = (int)codigo[k].op, arg = codigo[k].arg, valida;
+        if (op == OP_NUM) valida = arg >= 0 && arg < r->numConstantes;
+        else if (op == OP_VAR) valida = arg >= 0 && arg < r->numVariaveis;
+        else if (op == OP_DUP || ehFuncaoOp(op)) valida = altura >= 1;
+        else valida = op >= OP_SOMA && op <= OP_POT && altura >= 2;
+        if (!valida) return falharPacote(erro, (const char*)&codigo[k] - dados);
+        if (op == OP_NUM || op == OP_VAR || op == OP_DUP) altura++;
+        else if (!ehFuncaoOp(op)) altura--;
+        if (altura > maximo) maximo = altura;
+    }
+    if (altura != 1 || maximo > r->profundidade) return falharPacote(erro, deslocamento);
+
+    const char *variaveis = (const char*)(codigo + r->tamanho) + r->numConstantes * sizeof(double) + ALINHAR8(r->tamanho * sizeof(int32_t));
+    for (int v = 0; v < r->numVariaveis; v++) {
+        if (memchr(variaveis + v * TAM_NOME_VARIAVEL, '\0', TAM_NOME_VARIAVEL) == NULL) {
+            return falharPacote(erro, variaveis + v * TAM_NOME_VARIAVEL - dados);
         }
-        token = strtok(NULL, " ");
     }
+    const char *texto = variaveis + (long)r->numVariaveis * TAM_NOME_VARIAVEL;
+    if (texto[r->tamanhoTexto] != '\0') return falharPacote(erro, texto - dados);
+    return CALC_OK;
+}
 
-    if (pilha.top != 0) {
-        fprintf(stderr, "Erro: Expressão pos-fixa mal formada - operandos sobrando na pilha.\n");
-        free(StrCopia);
-        return result_infixa;
+// Confere o cabeçalho, o diretório e todos os registros; não aloca nada
+static int validarPacote(const char *dados, uint64_t tamanho, ErroCalc *erro) {
+    const CabecalhoPacote *cabecalho = (const CabecalhoPacote*)dados;
+    if (tamanho < sizeof(CabecalhoPacote) || memcmp(cabecalho->magica, PACOTE_MAGICA, sizeof(cabecalho->magica)) != 0) {
+        return falharPacote(erro, 0);
+    }
+    if (cabecalho->versao != PACOTE_VERSAO || cabecalho->marcaOrdem != PACOTE_MARCA_ORDEM) {
+        return falharPacote(erro, offsetof(CabecalhoPacote, versao));
+    }
+    if (cabecalho->tamanho != tamanho || cabecalho->numProgramas > INT32_MAX ||
+        (tamanho - sizeof(CabecalhoPacote)) / sizeof(uint64_t) < cabecalho->numProgramas) {
+        return falharPacote(erro, offsetof(CabecalhoPacote, numProgramas));
     }
+    const uint64_t *diretorio = (const uint64_t*)(cabecalho + 1);
+    uint64_t inicio = sizeof(CabecalhoPacote) + (uint64_t)cabecalho->numProgramas * sizeof(uint64_t);
+    for (uint32_t i = 0; i < cabecalho->numProgramas; i++) {
+        int cod = validarRegistro(dados, tamanho, inicio, diretorio[i], erro);
+        if (cod != CALC_OK) return cod;
+    }
+    return CALC_OK;
+}
 
-    strcpy(result_infixa, popStr(&pilha));
-    free(StrCopia);
-    return result_infixa;
+static void desmapearPacote(const char *dados, long long tamanho) {
+#ifdef _WIN32
+    (void)tamanho;
+    UnmapViewOfFile(dados);
+#else
+    munmap((void*)dados, tamanho);
+#endif
 }
 
-// Calcula o valor de Str (na forma infixa)
-float getValorInFixa(char *StrInFixa) {
-    char *expressao_copia = strdup(StrInFixa);
-    if (expressao_copia == NULL) {
-        fprintf(stderr, "Erro de alocação de memória para cópia da expressão.\n");
-        return 0.0;
-    }
-    replaceCommasWithDots(expressao_copia);
-
-    Stack *operandStack = createStack(512);
-    StackStr operatorStack;
-    operatorStack.top = -1;
-
-    char *expr_ptr = expressao_copia;
-    char token_buffer[32];
-    char *token;
-
-    while ((token = getNextToken(&expr_ptr, token_buffer)) != NULL) {
-        if (strcmp(token, "") == 0) continue;
-
-        if (isNumber(token)) {
-            push(operandStack, atof(token));
-        } else if (ehFuncao(token)) {
-            pushStr(&operatorStack, token);
-        } else if (strcmp(token, "(") == 0) {
-            pushStr(&operatorStack, token);
-        } else if (strcmp(token, ")") == 0) {
-            while (!isEmptyStr(&operatorStack) && strcmp(peekStr(&operatorStack), "(") != 0) {
-                applyOperator(operandStack, &operatorStack);
-            }
-            if (!isEmptyStr(&operatorStack) && strcmp(peekStr(&operatorStack), "(") == 0) {
-                popStr(&operatorStack);
-            } else {
-                fprintf(stderr, "Erro: Parênteses desbalanceados na expressão infixa.\n");
-                free(expressao_copia); free(operandStack->items); free(operandStack); exit(EXIT_FAILURE);
-            }
-            if (!isEmptyStr(&operatorStack) && ehFuncao(peekStr(&operatorStack))) {
-                applyOperator(operandStack, &operatorStack);
-            }
-        } else if (ehOperador(token)) {
-            while (!isEmptyStr(&operatorStack) &&
-                   (ehFuncao(peekStr(&operatorStack)) || ehOperador(peekStr(&operatorStack))) &&
-                   (prioridade(peekStr(&operatorStack)) > prioridade(token) ||
-                    (prioridade(peekStr(&operatorStack)) == prioridade(token) && strcmp(token, "^") != 0))) {
-                applyOperator(operandStack, &operatorStack);
+static PacoteProgramas *criarPacote(const char *dados, long long tamanho, ErroCalc *erro) {
+    if (tamanho < 0 || ((uintptr_t)dados & 7) != 0) {
+        falharPacote(erro, 0);
+        return NULL;
+    }
+    if (validarPacote(dados, (uint64_t)tamanho, erro) != CALC_OK) return NULL;
+    PacoteProgramas *pacote = (PacoteProgramas*)calloc(1, sizeof(PacoteProgramas));
+    if (pacote == NULL || (pacote->contexto = criarContexto(PACOTE_CONTEXTO_INICIAL)) == NULL) {
+        free(pacote);
+        falhar(erro, CALC_ERRO_MEMORIA, -1);
+        return NULL;
+    }
+    pacote->dados = dados;
+    pacote->tamanho = tamanho;
+    pacote->numProgramas = (int)((const CabecalhoPacote*)dados)->numProgramas;
+    return pacote;
+}
+
+PacoteProgramas *abrirPacoteMemoria(const void *dados, long tamanho, ErroCalc *erro) {
+    return criarPacote((const char*)dados, tamanho, erro);
+}
+
+PacoteProgramas *abrirPacote(const char *nomeArquivo, ErroCalc *erro) {
+    long long tamanho = -1;
+    const char *dados = NULL;
+#ifdef _WIN32
+    HANDLE arquivo = CreateFileA(nomeArquivo, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER tamanhoArquivo;
+    if (arquivo != INVALID_HANDLE_VALUE) {
+        if (GetFileSizeEx(arquivo, &tamanhoArquivo) && (tamanho = tamanhoArquivo.QuadPart) > 0) {
+            HANDLE mapeamento = CreateFileMappingA(arquivo, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapeamento != NULL) {
+                dados = (const char*)MapViewOfFile(mapeamento, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapeamento); // A visão mantém o mapeamento
             }
-            pushStr(&operatorStack, token);
-        } else {
-            fprintf(stderr, "Erro: Token desconhecido na expressão infixa: '%s'.\n", token);
-            free(expressao_copia); free(operandStack->items); free(operandStack); exit(EXIT_FAILURE);
         }
+        CloseHandle(arquivo);
     }
-
-    while (!isEmptyStr(&operatorStack)) {
-        if (strcmp(peekStr(&operatorStack), "(") == 0) {
-            fprintf(stderr, "Erro: Parênteses desbalanceados na expressão infixa ( '(' sem ')').\n");
-            free(expressao_copia); free(operandStack->items); free(operandStack); exit(EXIT_FAILURE);
+#else
+    int arquivo = open(nomeArquivo, O_RDONLY);
+    struct stat info;
+    if (arquivo >= 0) {
+        if (fstat(arquivo, &info) == 0 && (tamanho = info.st_size) > 0) {
+            void *mapeamento = mmap(NULL, tamanho, PROT_READ, MAP_PRIVATE, arquivo, 0);
+            if (mapeamento != MAP_FAILED) dados = (const char*)mapeamento;
         }
-        applyOperator(operandStack, &operatorStack);
+        close(arquivo); // O mapeamento continua valendo
+    }
+#endif
+    if (dados == NULL) {
+        // Arquivo vazio é um pacote inválido; os outros casos são falhas de abertura ou mapeamento
+        if (tamanho == 0) falharPacote(erro, 0);
+        else falhar(erro, CALC_ERRO_ARQUIVO, -1);
+        return NULL;
     }
+    PacoteProgramas *pacote = criarPacote(dados, tamanho, erro);
+    if (pacote == NULL) desmapearPacote(dados, tamanho);
+    else pacote->mapeado = 1;
+    return pacote;
+}
+
+void fecharPacote(PacoteProgramas *pacote) {
+    if (pacote == NULL) return;
+    if (pacote->mapeado) desmapearPacote(pacote->dados, pacote->tamanho);
+    liberarContexto(pacote->contexto);
+    free(pacote);
+}
+
+int getNumeroProgramasPacote(const PacoteProgramas *pacote) {
+    return pacote->numProgramas;
+}
+
+static const RegistroPacote *registroPacote(const PacoteProgramas *pacote, int indice) {
+    const uint64_t *diretorio = (const uint64_t*)(pacote->dados + sizeof(CabecalhoPacote));
+    return (const RegistroPacote*)(pacote->dados + diretorio[indice]);
+}
+
+int carregarPrograma(PacoteProgramas *pacote, int indice, Programa *prog, ErroCalc *erro) {
+    if (indice < 0 || indice >= pacote->numProgramas) return falhar(erro, CALC_ERRO_PACOTE_INVALIDO, -1);
+    const RegistroPacote *r = registroPacote(pacote, indice);
+    // Os ponteiros de Programa não são const, mas nada escreve neles depois da compilação
+    char *p = (char*)(r + 1);
+    prog->codigo = (Instrucao*)p;
+    p += r->tamanho * sizeof(Instrucao);
+    prog->constantes = (double*)p;
+    p += r->numConstantes * sizeof(double);
+    prog->posicoes = (int*)p;
+    p += ALINHAR8(r->tamanho * sizeof(int32_t));
+    prog->variaveis = (char(*)[TAM_NOME_VARIAVEL])p;
+    prog->tamanho = r->tamanho;
+    prog->numConstantes = r->numConstantes;
+    prog->numVariaveis = r->numVariaveis;
+    prog->profundidade = r->profundidade;
+    prog->precisao = (Precisao)r->precisao;
+    prog->matematica = (ModoMatematica)r->matematica;
+    prog->contexto = pacote->contexto;
+    return CALC_OK;
+}
 
-    if (operandStack->top != 0) {
-        fprintf(stderr, "Erro: Expressão mal formada - mais de um operando restante na pilha.\n");
-        free(expressao_copia); free(operandStack->items); free(operandStack); exit(EXIT_FAILURE);
+const char *getTextoProgramaPacote(const PacoteProgramas *pacote, int indice) {
+    if (indice < 0 || indice >= pacote->numProgramas) return "";
+    const RegistroPacote *r = registroPacote(pacote, indice);
+    return (const char*)(r + 1) + r->tamanho * sizeof(Instrucao) + r->numConstantes * sizeof(double) +
+           ALINHAR8(r->tamanho * sizeof(int32_t)) + (long)r->numVariaveis * TAM_NOME_VARIAVEL;
+}
+
+// ===== Perfil: soma dos contadores e relatório =====
+
+void getPerfil(PerfilCalc *perfil) {
+    memset(perfil, 0, sizeof(PerfilCalc));
+#ifdef CALC_PERFIL
+    perfil->ativo = 1;
+    perfil->unidadeTempo = PERFIL_UNIDADE;
+    pthread_mutex_lock(&travaPerfil);
+    for (const BlocoPerfil *b = blocosPerfil; b != NULL; b = b->proximo) {
+        const PerfilCalc *c = &b->contadores;
+        perfil->tokens += c->tokens;
+        perfil->tempoTokens += c->tempoTokens;
+        perfil->compilacoes += c->compilacoes;
+        perfil->tempoCompilacao += c->tempoCompilacao;
+        if (c->picoPilhaOp > perfil->picoPilhaOp) perfil->picoPilhaOp = c->picoPilhaOp;
+        if (c->picoPilhaExecucao > perfil->picoPilhaExecucao) perfil->picoPilhaExecucao = c->picoPilhaExecucao;
+        perfil->execucoes += c->execucoes;
+        perfil->avaliacoesDiretas += c->avaliacoesDiretas;
+        perfil->tokensDiretos += c->tokensDiretos;
+        perfil->tempoTokensDiretos += c->tempoTokensDiretos;
+        for (int op = 0; op <= OP_DUP; op++) {
+            perfil->operacoes[op] += c->operacoes[op];
+            perfil->tempoOperacoes[op] += c->tempoOperacoes[op];
+        }
     }
+    pthread_mutex_unlock(&travaPerfil);
+#else
+    perfil->unidadeTempo = "ciclos";
+#endif
+}
+
+void zerarPerfil(void) {
+#ifdef CALC_PERFIL
+    pthread_mutex_lock(&travaPerfil);
+    for (BlocoPerfil *b = blocosPerfil; b != NULL; b = b->proximo) memset(&b->contadores, 0, sizeof(PerfilCalc));
+    pthread_mutex_unlock(&travaPerfil);
+#endif
+}
+
+// Anexa o texto formatado ao relatório; retorna 0 se não couber em tamanho bytes
+static int anexarRelatorio(char *saida, int *len, int tamanho, const char *formato, ...) {
+    va_list argumentos;
+    va_start(argumentos, formato);
+    int n = vsnprintf(saida + *len, tamanho - *len, formato, argumentos);
+    va_end(argumentos);
+    if (n < 0 || *len + n >= tamanho) return 0;
+    *len += n;
+    return 1;
+}
+
+int escreverRelatorioPerfil(const PerfilCalc *perfil, char *saida, int tamanho) {
+    int len = 0, ok;
+    if (tamanho < 1) return -1;
+    saida[0] = '\0';
 
-    float finalResult = pop(operandStack);
-    free(expressao_copia); free(operandStack->items); free(operandStack);
-    return finalResult;
-}
\ No newline at end of file
+    if (!perfil->ativo) {
+        ok = anexarRelatorio(saida, &len, tamanho, "Perfil indisponivel: compile calculadora.c com -DCALC_PERFIL.\n");
+    } else {
+        const char *u = perfil->unidadeTempo;
+        long long tempoConversao = perfil->tempoCompilacao - perfil->tempoTokens, tempoOperacoes = 0;
+        for (int op = 0; op <= OP_DUP; op++) tempoOperacoes += perfil->tempoOperacoes[op];
+        ok = anexarRelatorio(saida, &len, tamanho, "Perfil (tempos em %s):\n", u) &&
+             anexarRelatorio(saida, &len, tamanho, "  tokens:    %lld lidos, %lld %s (%.1f por token)\n", perfil->tokens,
+                             perfil->tempoTokens, u, perfil->tokens ? (double)perfil->tempoTokens / perfil->tokens : 0.0) &&
+             anexarRelatorio(saida, &len, tamanho, "  conversao: %lld compilacoes, %lld %s sem os tokens (%.1f por compilacao)\n",
+                             perfil->compilacoes, tempoConversao, u, perfil->compilacoes ? (double)tempoConversao / perfil->compilacoes : 0.0) &&
+             anexarRelatorio(saida, &len, tamanho, "  pilhas:    pico de %d operadores na conversao e de %d valores na execucao\n",
+                             perfil->picoPilhaOp, perfil->picoPilhaExecucao) &&
+             anexarRelatorio(saida, &len, tamanho, "  execucao:  %lld programas no motor escalar, %lld %s nas instrucoes\n",
+                             perfil->execucoes, tempoOperacoes, u) &&
+             anexarRelatorio(saida, &len, tamanho, "  direta:    %lld infixas sem compilar, %lld tokens lidos em %lld %s\n",
+                             perfil->avaliacoesDiretas, perfil->tokensDiretos, perfil->tempoTokensDiretos, u) &&
+             anexarRelatorio(saida, &len, tamanho, "  %-9s %14s %16s %12s %6s\n", "operador", "chamadas", u, "por chamada", "%");
+        for (int op = 0; ok && op <= OP_DUP; op++) {
+            if (perfil->operacoes[op] == 0) continue;
+            const char *nome = op == OP_NUM ? "numero" : op == OP_VAR ? "variavel" : nomeOp[op];
+            ok = anexarRelatorio(saida, &len, tamanho, "  %-9s %14lld %16lld %12.1f %5.1f%%\n", nome, perfil->operacoes[op],
+                                 perfil->tempoOperacoes[op], (double)perfil->tempoOperacoes[op] / perfil->operacoes[op],
+                                 tempoOperacoes ? 100.0 * perfil->tempoOperacoes[op] / tempoOperacoes : 0.0);
+        }
+    }
+    if (!ok) {
+        saida[0] = '\0';
+        return -1;
+    }
+    return len;
+}
@@ -3,13 +3,366 @@
 #define EXPRESSAO_H
 
 typedef struct {
-char posFixa[512]; // Expressão na forma pos-fixa, como 3 12 4 + *
-char inFixa[512]; // Expressão na forma infixa, como 3 * (12 + 4)
+char *posFixa; // Expressão na forma pos-fixa, como 3 12 4 + * (sem limite de tamanho: aponta para um buffer de quem a preenche)
+char *inFixa; // Expressão na forma infixa, como 3 * (12 + 4) (idem)
 float Valor; // Valor numérico da expressão 
 } Expressao;
 
+// Código de erro de uma conversão ou avaliação
+typedef enum {
+    CALC_OK = 0,
+    CALC_ERRO_DIVISAO_ZERO,
+    CALC_ERRO_RAIZ_NEGATIVA,
+    CALC_ERRO_TANGENTE, // Tangente de 90, 270 graus, etc.
+    CALC_ERRO_LOG, // Logaritmo de número não positivo
+    CALC_ERRO_TOKEN_DESCONHECIDO,
+    CALC_ERRO_PARENTESES, // Parênteses desbalanceados
+    CALC_ERRO_FALTA_OPERANDO, // Operador sem operandos suficientes
+    CALC_ERRO_SOBRA_OPERANDO, // Operandos sobrando ao final
+    CALC_ERRO_EXPRESSAO_VAZIA,
+    CALC_ERRO_VARIAVEL_SEM_VALOR,
+    CALC_ERRO_PILHA_CHEIA, // Não ocorre mais: as pilhas crescem com a entrada (mantido pela numeração)
+    CALC_ERRO_BUFFER_PEQUENO, // Saída não cabe no buffer do chamador
+    CALC_ERRO_MEMORIA,
+    CALC_ERRO_JIT_INDISPONIVEL, // Só há JIT em x86-64 (System V), em float, até 65536 registradores e 2^23 instruções
+    CALC_ERRO_ARQUIVO, // Falha ao abrir, mapear ou gravar um arquivo
+    CALC_ERRO_PACOTE_INVALIDO, // Pacote de programas com cabeçalho, versão ou conteúdo inconsistente
+    CALC_ERRO_NOME_LONGO, // Nome de variável com mais de TAM_NOME_VARIAVEL - 1 caracteres
+    CALC_ERRO_INFIXA_GRANDE // Infixa de uma pós-fixa com dup acima de LIMITE_INFIXA bytes
+} CodigoErro;
+
+typedef struct {
+    CodigoErro codigo;
+    int posicao; // Índice, na string de entrada, do token que causou o erro (-1 se não se aplica; num pacote, o byte do problema)
+} ErroCalc;
+
+const char *mensagemErro(int codigo); // Texto que descreve um CodigoErro
+
 char *getFormaInFixa(char *Str); // Retorna a forma inFixa de Str (posFixa)
 char *getFormaPosFixa(char *Str); // Retorna a forma posFixa de Str (inFixa)
-float getValorInFixa(char *StrInFixa); // Calcula o valor de Str (na forma inFixa)
-float getValorPosFixa(char *StrPosFixa); // Calcula o valor de Str (na forma posFixa)
+float getValorInFixa(char *StrInFixa); // Calcula o valor de Str (na forma inFixa); encerra o programa se houver erro
+float getValorPosFixa(char *StrPosFixa); // Calcula o valor de Str (na forma posFixa); encerra o programa se houver erro
+
+// Versões reentrantes das conversões: escrevem em saida (tamanho bytes) e retornam o comprimento,
+// ou -1 se erro (detalhado em erro, que pode ser NULL)
+int getFormaInFixa_r(const char *Str, char *saida, int tamanho, ErroCalc *erro);
+int getFormaPosFixa_r(const char *Str, char *saida, int tamanho, ErroCalc *erro);
+
+// Avaliação sem encerrar o programa: retornam CALC_OK e o valor em resultado, ou o código do erro (detalhado em erro)
+int avaliarInFixa(const char *StrInFixa, float *resultado, ErroCalc *erro);
+int avaliarPosFixa(const char *StrPosFixa, float *resultado, ErroCalc *erro);
+
+// Variantes sobre um trecho [Str, Str + n) que não precisa terminar em '\0' (ex.: uma linha de um arquivo mapeado)
+int getFormaInFixaN(const char *Str, int n, char *saida, int tamanho, ErroCalc *erro);
+int getFormaPosFixaN(const char *Str, int n, char *saida, int tamanho, ErroCalc *erro);
+int avaliarInFixaN(const char *Str, int n, float *resultado, ErroCalc *erro);
+int avaliarPosFixaN(const char *Str, int n, float *resultado, ErroCalc *erro);
+// Número de tokens de [Str, Str + n) na forma infixa (posFixa = 0) ou pós-fixa (posFixa = 1); -1 no primeiro token desconhecido
+int contarTokensN(const char *Str, int n, int posFixa, ErroCalc *erro);
+
+// ===== Programa compilado (compila uma vez, avalia muitas) =====
+// Tipo numérico usado na execução de um programa. float é o mais rápido e o único dos caminhos vetorizado e JIT;
+// double e long double calculam funções e intermediários com mais precisão.
+typedef enum {
+    PRECISAO_FLOAT,
+    PRECISAO_DOUBLE,
+    PRECISAO_LONG_DOUBLE // As constantes continuam em double; só os cálculos usam long double
+} Precisao;
+
+// Como sen, cos, tg e log são calculados. MATEMATICA_RAPIDA usa núcleos em graus com tabela, sem desvios e
+// vetorizáveis no lote; vale nas precisões float e double (long double usa sempre a libm). Erro medido em
+// 4 milhões de amostras: em float, sempre o valor corretamente arredondado (os núcleos calculam em double);
+// em double, até 4 ulp em sen, cos e log e até 25 ulp em tg perto dos polos. Múltiplos de 15 graus
+// (30, 45, 90...) dão o valor exato arredondado, ex.: sen(180) = 0 e tg(45) = 1. raiz já é exata em
+// hardware nos dois modos, e os erros de domínio são os mesmos.
+typedef enum {
+    MATEMATICA_EXATA, // libm, como sempre
+    MATEMATICA_RAPIDA
+} ModoMatematica;
+
+#define PROGRAMA_PILHA_LOCAL 512 // Altura da pilha de execução que cabe no stack frame; acima disso, ela é alocada
+#define TAM_NOME_VARIAVEL 32 // Tamanho máximo do nome de uma variável (com '\0')
+
+typedef enum {
+    OP_NUM, // Empilha constantes[arg]
+    OP_VAR, // Empilha valores[arg] (slot da variável)
+    OP_SOMA, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_POT, // Binários
+    OP_RAIZ, OP_SEN, OP_COS, OP_TG, OP_LOG, // Unários
+    OP_DUP // Duplica o topo da pilha (gerado pela otimização; na pós-fixa é o token dup, que não pode ser nome de variável)
+} OpCode;
+
+typedef struct {
+    OpCode op;
+    int arg; // Índice em constantes (OP_NUM) ou slot da variável (OP_VAR)
+} Instrucao;
+
+typedef struct ContextoCalc ContextoCalc; // Arena de memória de trabalho (ver "Contexto de avaliação" abaixo)
+
+typedef struct {
+    Instrucao *codigo; // Instruções na ordem pós-fixa
+    double *constantes; // Constantes já convertidas (strtod)
+    int tamanho; // Número de instruções
+    int numConstantes;
+    char (*variaveis)[TAM_NOME_VARIAVEL]; // Nome de cada slot, na ordem em que aparece na expressão
+    int numVariaveis;
+    int *posicoes; // Posição, no texto de origem, do token de cada instrução (para mensagens de erro)
+    int profundidade; // Altura máxima que a pilha atinge durante a execução
+    Precisao precisao; // PRECISAO_FLOAT ao compilar; pode ser trocada antes de otimizar e executar
+    ModoMatematica matematica; // MATEMATICA_EXATA ao compilar; idem
+    ContextoCalc *contexto; // Arena de onde veio a memória (NULL: malloc, devolvida por liberarPrograma)
+} Programa;
+
+int compilarPosFixa(const char *StrPosFixa, Programa *prog, ErroCalc *erro); // Compila Str (posFixa) em prog; retorna CALC_OK ou o código do erro
+int compilarInFixa(const char *StrInFixa, Programa *prog, ErroCalc *erro); // Compila Str (inFixa) em prog; retorna CALC_OK ou o código do erro
+int compilarPosFixaN(const char *Str, int n, Programa *prog, ErroCalc *erro); // Idem, sobre o trecho [Str, Str + n)
+int compilarInFixaN(const char *Str, int n, Programa *prog, ErroCalc *erro); // Idem, sobre o trecho [Str, Str + n)
+int getIndiceVariavel(const Programa *prog, const char *nome); // Slot da variável nome, ou -1 se não existir
+// Calcula prog com valores[slot] para cada variável; retorna CALC_OK e o valor em resultado, ou o código do erro
+int executarPrograma(const Programa *prog, const float *valores, float *resultado, ErroCalc *erro);
+// Igual a executarPrograma, com valores e resultado em double (calculado na precisão de prog)
+int executarProgramaDouble(const Programa *prog, const double *valores, double *resultado, ErroCalc *erro);
+void liberarPrograma(Programa *prog); // Libera a memória de prog
+// Dobra subexpressões constantes (inclusive funções de literais, calculadas na precisão de prog), remove x*1, x/1, x^1, x+0, x-0, 1*x e 0+x e
+// troca x^2 e x^3 por multiplicações. Constantes com erro de domínio não são dobradas, para o erro aparecer
+// na execução com a posição do token. Retorna CALC_OK, ou o código do erro (prog fica inalterado).
+int otimizarPrograma(Programa *prog);
+// Escreve prog na forma pós-fixa, com as constantes já calculadas e "dup" para OP_DUP; retorna o comprimento, ou -1
+int escreverProgramaPosFixa(const Programa *prog, char *saida, int tamanho, ErroCalc *erro);
+// Forma pós-fixa otimizada da infixa Str, para inspecionar o que a otimização fez; retorna o comprimento, ou -1
+int getFormaPosFixaOtimizada_r(const char *Str, char *saida, int tamanho, ErroCalc *erro);
+int getFormaPosFixaOtimizadaN(const char *Str, int n, char *saida, int tamanho, ErroCalc *erro);
+
+// Avaliação na precisão e no modo de sen, cos, tg e log escolhidos, com o resultado em double
+int avaliarInFixaPrecisaoN(const char *Str, int n, Precisao precisao, ModoMatematica matematica, double *resultado, ErroCalc *erro);
+int avaliarPosFixaPrecisaoN(const char *Str, int n, Precisao precisao, ModoMatematica matematica, double *resultado, ErroCalc *erro);
+
+// ===== Contexto de avaliação (arena) =====
+// Memória de trabalho reaproveitada entre expressões: programas, pilhas e nós das conversões saem de um
+// bloco por incremento de ponteiro, sem malloc nem free. Crie um contexto por thread (não é thread-safe) e
+// chame reiniciarContexto entre expressões, o que descarta de uma vez tudo o que veio dele. O bloco cresce
+// até o pico de uso entre duas reinicializações, então em regime as avaliações não alocam nada.
+typedef struct {
+    long alocacoes; // Pedidos de memória ao sistema desde a criação (a criação conta 2)
+    long capacidade; // Tamanho do bloco principal, em bytes
+    long pico; // Maior uso entre duas reinicializações, em bytes
+} EstatisticasContexto;
+
+ContextoCalc *criarContexto(long capacidade); // Bloco inicial de capacidade bytes (<= 0 usa 64 KiB); NULL se faltar memória
+void liberarContexto(ContextoCalc *ctx);
+void reiniciarContexto(ContextoCalc *ctx); // Invalida tudo o que foi alocado ou compilado no contexto
+void *alocarContexto(ContextoCalc *ctx, long bytes); // Memória alinhada a 16 bytes até a reinicialização (ctx NULL: malloc)
+void getEstatisticasContexto(const ContextoCalc *ctx, EstatisticasContexto *estatisticas);
+
+// Como as variantes N, com a memória de trabalho tirada de ctx (NULL: malloc e free, como nas variantes N).
+// Um programa compilado no contexto vale até a reinicialização; liberarPrograma não faz nada com ele.
+int compilarInFixaContexto(ContextoCalc *ctx, const char *Str, int n, Programa *prog, ErroCalc *erro);
+int compilarPosFixaContexto(ContextoCalc *ctx, const char *Str, int n, Programa *prog, ErroCalc *erro);
+int avaliarInFixaContexto(ContextoCalc *ctx, const char *Str, int n, float *resultado, ErroCalc *erro);
+int avaliarPosFixaContexto(ContextoCalc *ctx, const char *Str, int n, float *resultado, ErroCalc *erro);
+int avaliarInFixaPrecisaoContexto(ContextoCalc *ctx, const char *Str, int n, Precisao precisao, ModoMatematica matematica, double *resultado, ErroCalc *erro);
+int avaliarPosFixaPrecisaoContexto(ContextoCalc *ctx, const char *Str, int n, Precisao precisao, ModoMatematica matematica, double *resultado, ErroCalc *erro);
+int getFormaInFixaContexto(ContextoCalc *ctx, const char *Str, int n, char *saida, int tamanho, ErroCalc *erro);
+int getFormaPosFixaContexto(ContextoCalc *ctx, const char *Str, int n, char *saida, int tamanho, ErroCalc *erro);
+int getFormaPosFixaOtimizadaContexto(ContextoCalc *ctx, const char *Str, int n, char *saida, int tamanho, ErroCalc *erro);
+// Comprimento exato (sem o '\0') da infixa da pós-fixa [Str, Str + n), ou -1 se erro. Sem dup ele não passa de
+// 4n + 16; cada dup repete a subexpressão, e acima de 4n + 16 e de LIMITE_INFIXA a conversão dá CALC_ERRO_INFIXA_GRANDE.
+// Use-o para dimensionar a saída quando getFormaInFixa* dá CALC_ERRO_BUFFER_PEQUENO.
+#define LIMITE_INFIXA (16L * 1024 * 1024)
+long getTamanhoInFixaN(const char *Str, int n, ErroCalc *erro);
+long getTamanhoInFixaContexto(ContextoCalc *ctx, const char *Str, int n, ErroCalc *erro);
+
+// ===== Programa em registradores (DAG com subexpressões comuns compartilhadas) =====
+typedef struct {
+    OpCode op;
+    int destino; // Registrador que recebe o resultado
+    int a, b; // Registradores dos operandos (b = -1 nas funções); em OP_NUM, a é a constante; em OP_VAR, o slot
+} InstrucaoReg;
+
+typedef struct {
+    InstrucaoReg *codigo; // Um nó do DAG por instrução, em ordem topológica
+    int tamanho;
+    double *constantes;
+    int numConstantes;
+    int numRegistros;
+    int numVariaveis;
+    Precisao precisao; // A mesma do Programa de origem
+    ModoMatematica matematica; // Idem
+    int resultado; // Registrador com o valor final
+    int *posicoes; // Posição, no texto de origem, da primeira ocorrência de cada nó
+} ProgramaReg;
+
+// Converte prog num DAG (subexpressões idênticas viram um nó só) escalonado em registradores reaproveitados
+int compilarRegistros(const Programa *prog, ProgramaReg *reg, ErroCalc *erro);
+// Igual a executarPrograma, calculando cada subexpressão comum uma vez
+int executarRegistros(const ProgramaReg *reg, const float *valores, float *resultado, ErroCalc *erro);
+void liberarRegistros(ProgramaReg *reg);
+
+// ===== Avaliação incremental (só as partes que dependem das variáveis alteradas) =====
+// Guarda o valor de cada nó da expressão e, para cada variável, as folhas que a usam. Depois de trocar
+// algumas variáveis, getValorIncremental recalcula só os nós acima dessas folhas, de baixo para cima, e não
+// propaga além de um nó cujo valor não mudou: o custo acompanha o tamanho da parte suja, não o da expressão.
+// Os resultados e erros (código e posição) são os mesmos de executarProgramaDouble, na precisão e no modo de prog.
+typedef struct AvaliacaoIncremental AvaliacaoIncremental;
+
+typedef struct {
+    int nos; // Nós da expressão (instruções de prog, sem contar OP_DUP)
+    long atualizacoes; // Chamadas de getValorIncremental que tinham variáveis alteradas
+    long recalculados; // Nós recalculados nessas chamadas
+} EstatisticasIncremental;
+
+// Avalia prog inteiro com valores[slot] (pode ser NULL se prog não tem variáveis); prog pode ser liberado depois.
+// Retorna NULL se faltar memória ou valores faltar (detalhado em erro); erros de domínio só aparecem em getValorIncremental.
+AvaliacaoIncremental *criarAvaliacaoIncremental(const Programa *prog, const double *valores, ErroCalc *erro);
+void liberarAvaliacaoIncremental(AvaliacaoIncremental *av);
+// Troca o valor da variável do slot, sem recalcular nada ainda; retorna CALC_OK, ou CALC_ERRO_VARIAVEL_SEM_VALOR se o slot não existe
+int definirVariavelIncremental(AvaliacaoIncremental *av, int slot, double valor);
+// Recalcula o que depende das variáveis trocadas; retorna CALC_OK e o valor em resultado, ou o código do erro (detalhado em erro)
+int getValorIncremental(AvaliacaoIncremental *av, double *resultado, ErroCalc *erro);
+void getEstatisticasIncremental(const AvaliacaoIncremental *av, EstatisticasIncremental *estatisticas);
+
+// ===== JIT x86-64 (opcional) =====
+typedef struct {
+    void *codigo; // Página executável obtida com mmap
+    long tamanhoCodigo;
+    int (*funcao)(const float *valores, float *resultado); // Retorna 0, ou (instrução << 8) | CodigoErro
+    int *posicoes; // Posição no texto de cada instrução, para as mensagens de erro
+} ProgramaJit;
+
+// Gera código de máquina para prog (depois de compilarRegistros); retorna CALC_OK, ou o código do erro
+// (CALC_ERRO_JIT_INDISPONIVEL fora de x86-64 System V ou com registradores ou instruções demais, para o chamador usar o interpretador)
+int compilarJit(const Programa *prog, ProgramaJit *jit, ErroCalc *erro);
+// Igual a executarPrograma, com os mesmos resultados bit a bit (só precisão float)
+int executarJit(const ProgramaJit *jit, const float *valores, float *resultado, ErroCalc *erro);
+void liberarJit(ProgramaJit *jit);
+
+// ===== Avaliação em lote (colunas de entrada) =====
+#define LOTE_BLOCO 256 // Linhas processadas por vez em cada instrução do programa
+#define LOTE_PEDACO 4096 // Linhas por unidade de trabalho na avaliação paralela
+
+// Avalia prog para cada linha (pelo programa em registradores, vetorizado em float; nas outras precisões,
+// linha a linha no motor escalar): colunas[slot][linha] é o valor da variável do slot e o resultado vai para saida[linha].
+// Linhas com erro de domínio recebem NAN e, se status não for NULL, status[linha] recebe o CodigoErro.
+// Retorna quantas linhas tiveram erro, ou -1 se faltar memória (CALC_ERRO_MEMORIA em erro, que pode ser NULL).
+long avaliarLote(const Programa *prog, const float *const *colunas, long linhas, float *saida, unsigned char *status, ErroCalc *erro);
+// Igual a avaliarLote, dividindo as linhas entre numThreads threads (<= 0 usa todos os núcleos). Se alguma
+// thread não puder ser criada, as outras fazem a parte dela.
+long avaliarLoteParalelo(const Programa *prog, const float *const *colunas, long linhas, float *saida,
+                         unsigned char *status, int numThreads, ErroCalc *erro);
+int getNumeroNucleos(void); // Número de processadores disponíveis
+
+// ===== Várias expressões na mesma passada sobre as linhas =====
+// As expressões são fundidas num DAG só: cada variável (pelo nome) é lida uma vez por bloco e as
+// subexpressões comuns a várias expressões são calculadas uma vez. Os blocos têm tantas linhas quanto
+// cabem no cache (L1/L2) com todos os registradores. Cada expressão dá os mesmos resultados e códigos de
+// erro que avaliarLote daria sozinha; as que não são float são avaliadas linha a linha no mesmo bloco.
+typedef struct ProgramaMulti ProgramaMulti;
+
+typedef struct {
+    int expressoes;
+    int variaveis; // Variáveis distintas (colunas de entrada)
+    int instrucoes; // Soma das instruções das expressões em float
+    int nos; // Nós do DAG fundido (instruções executadas por bloco)
+    int registradores;
+    int linhasPorBloco;
+} EstatisticasMulti;
+
+// Funde os n programas; eles podem ser liberados depois. Retorna NULL se faltar memória (detalhado em erro).
+ProgramaMulti *compilarMulti(const Programa *programas, int n, ErroCalc *erro);
+void liberarMulti(ProgramaMulti *multi);
+// Coluna da variável nome em avaliarLoteMulti, ou -1 se nenhuma expressão a usa
+int getIndiceVariavelMulti(const ProgramaMulti *multi, const char *nome);
+// Como avaliarLote para cada expressão f: colunas[getIndiceVariavelMulti(nome)][linha] é o valor da variável,
+// o resultado vai para saidas[f][linha] e, se status não for NULL, o CodigoErro para status[f][linha].
+// Retorna o total de linhas com erro, somado entre as expressões, ou -1 se faltar memória (CALC_ERRO_MEMORIA em erro).
+long avaliarLoteMulti(const ProgramaMulti *multi, const float *const *colunas, long linhas, float *const *saidas,
+                      unsigned char *const *status, ErroCalc *erro);
+void getEstatisticasMulti(const ProgramaMulti *multi, EstatisticasMulti *estatisticas);
+
+// ===== Cache de expressões (LRU) =====
+// Guarda, por expressão, o programa compilado, o valor e a forma pós-fixa. A chave é o hash da sequência
+// normalizada de tokens, então espaços e ',' / '.' nos números não mudam a entrada. Expressões com erro
+// não entram no cache. Um CacheCalc não é thread-safe: use um por thread.
+typedef struct CacheCalc CacheCalc;
+
+typedef struct {
+    long acertos; // Resultados servidos pelo cache
+    long falhas; // Resultados que precisaram ser calculados
+    int entradas;
+    int capacidade;
+} EstatisticasCache;
+
+CacheCalc *criarCache(int capacidade); // Cache com até capacidade expressões; NULL se capacidade < 1 ou faltar memória
+void liberarCache(CacheCalc *cache);
+void getEstatisticasCache(const CacheCalc *cache, EstatisticasCache *estatisticas);
+// Cache usado por getValorInFixa, getValorPosFixa e getFormaPosFixa; capacidade 0 desativa
+void ativarCacheGlobal(int capacidade);
+CacheCalc *getCacheGlobal(void);
+
+// Como avaliarInFixaN, avaliarPosFixaN e getFormaPosFixaN, consultando o cache antes (cache NULL calcula direto)
+int avaliarInFixaCache(CacheCalc *cache, const char *Str, int n, float *resultado, ErroCalc *erro);
+int avaliarPosFixaCache(CacheCalc *cache, const char *Str, int n, float *resultado, ErroCalc *erro);
+int getFormaPosFixaCache(CacheCalc *cache, const char *Str, int n, char *saida, int tamanho, ErroCalc *erro);
+// Compilam pelo cache; *prog pertence ao cache e vale até a entrada ser descartada (outra chamada com o mesmo cache).
+// As posições do programa se referem ao texto que criou a entrada.
+int compilarInFixaCache(CacheCalc *cache, const char *Str, int n, const Programa **prog, ErroCalc *erro);
+int compilarPosFixaCache(CacheCalc *cache, const char *Str, int n, const Programa **prog, ErroCalc *erro);
+
+// ===== Pacote de programas compilados (formato binário) =====
+// Vários programas gravados num arquivo que é carregado por mmap, sem ler texto nem alocar por programa:
+// cada Programa carregado aponta direto para o mapeamento. O formato é versionado e usa só deslocamentos
+// (nenhum ponteiro), na ordem de bytes e com o double IEEE da máquina que gravou; um pacote de outra ordem
+// de bytes ou versão é recusado. Ao abrir, o pacote inteiro é validado numa passada sem alocações (limites,
+// opcodes, índices de constantes e variáveis e a altura da pilha de cada programa), então um arquivo
+// truncado ou corrompido dá CALC_ERRO_PACOTE_INVALIDO em vez de um acesso fora do mapeamento.
+typedef struct PacoteProgramas PacoteProgramas;
+
+// Bytes que escreverPacote precisa para os n programas; textos (pode ser NULL, assim como cada textos[i])
+// guarda o texto de origem de cada programa, ao qual se referem as posições dos erros
+long tamanhoPacote(const Programa *programas, const char *const *textos, int n);
+// Escreve o pacote em saida (tamanho bytes); retorna o comprimento, ou -1 se não couber (detalhado em erro)
+long escreverPacote(const Programa *programas, const char *const *textos, int n, void *saida, long tamanho, ErroCalc *erro);
+// Grava o pacote no arquivo nomeArquivo; retorna CALC_OK ou o código do erro
+int salvarPacote(const char *nomeArquivo, const Programa *programas, const char *const *textos, int n, ErroCalc *erro);
+
+// Mapeia e valida o pacote do arquivo; NULL se não abrir ou for inválido (detalhado em erro)
+PacoteProgramas *abrirPacote(const char *nomeArquivo, ErroCalc *erro);
+// Idem, sobre tamanho bytes já na memória (alinhados a 8), que devem durar até fecharPacote
+PacoteProgramas *abrirPacoteMemoria(const void *dados, long tamanho, ErroCalc *erro);
+void fecharPacote(PacoteProgramas *pacote); // Invalida todos os programas carregados dele
+int getNumeroProgramasPacote(const PacoteProgramas *pacote);
+// Preenche prog com o programa de número indice, apontando para o pacote (nada é copiado). liberarPrograma não
+// faz nada nele. otimizarPrograma funciona: o mapeamento não é alterado, e o código e as constantes novos vão
+// para a memória do pacote, que só volta em fecharPacote (cada otimização ocupa o tamanho do programa
+// otimizado). Por isso ela não deve rodar em duas threads ao mesmo tempo no mesmo pacote; executar é só
+// leitura. Retorna CALC_OK, ou CALC_ERRO_PACOTE_INVALIDO se indice não existe.
+int carregarPrograma(PacoteProgramas *pacote, int indice, Programa *prog, ErroCalc *erro);
+const char *getTextoProgramaPacote(const PacoteProgramas *pacote, int indice); // Texto de origem ("" se não foi gravado)
+
+// ===== Perfil (instrumentação opcional) =====
+// Só existe se calculadora.c for compilado com -DCALC_PERFIL; sem a macro, o caminho quente não tem nenhuma
+// medição e getPerfil devolve tudo zerado com ativo = 0. Com ela, cada thread conta nos seus próprios
+// contadores (sem travas nem atômicos por token ou instrução) e getPerfil soma os de todas as threads.
+// Os tempos são ciclos do TSC em x86 (ns nas outras arquiteturas), já sem o custo da própria leitura do
+// relógio. O código gerado pelo JIT não é medido.
+typedef struct {
+    int ativo; // 1 se a biblioteca foi compilada com CALC_PERFIL
+    const char *unidadeTempo; // "ciclos" ou "ns"
+    long long tokens; // Tokens lidos pelos lexers ao compilar
+    long long tempoTokens;
+    long long compilacoes; // Programas compilados (infixa pelo shunting-yard, ou pós-fixa)
+    long long tempoCompilacao; // Inclui tempoTokens
+    int picoPilhaOp; // Maior altura da pilha de operadores do shunting-yard
+    int picoPilhaExecucao; // Maior altura da pilha de execução (ou número de registradores)
+    long long execucoes; // Execuções de programas no motor escalar
+    long long avaliacoesDiretas; // Infixas avaliadas sem compilar (as suas operações entram em operacoes)
+    long long tokensDiretos; // Tokens lidos por essas avaliações (fora de tokens e da compilação)
+    long long tempoTokensDiretos;
+    long long operacoes[OP_DUP + 1]; // Instruções executadas, por OpCode (no lote, uma por linha)
+    long long tempoOperacoes[OP_DUP + 1];
+} PerfilCalc;
+
+void getPerfil(PerfilCalc *perfil); // Soma dos contadores de todas as threads
+void zerarPerfil(void); // Zera os contadores; chame sem avaliações em andamento
+// Relatório em texto dos contadores (tokens, conversão, pilhas e cada operador); retorna o comprimento, ou -1 se não couber
+int escreverRelatorioPerfil(const PerfilCalc *perfil, char *saida, int tamanho);
 #endif
\ No newline at end of file
@@ -0,0 +1,223 @@
+//calculadora_motor.h
+// Motor de execução gerado para um tipo numérico. calculadora.c inclui este arquivo uma vez por precisão,
+// depois de definir:
+//   MOTOR_SUFIXO   sufixo dos nomes gerados (Float, Double, LongDouble)
+//   MOTOR_TIPO     tipo dos valores na pilha e nos registradores
+//   MOTOR_ENTRADA  tipo do vetor de valores das variáveis
+//   MOTOR_CALC     tipo em que as funções são calculadas (double no motor float, como no código original)
+//   MOTOR_PI, MOTOR_SQRT, MOTOR_SIN, MOTOR_COS, MOTOR_TAN, MOTOR_POW, MOTOR_FMOD, MOTOR_LOG10, MOTOR_FABS
+//   MOTOR_RAPIDO   1 se o motor atende MATEMATICA_RAPIDA (os núcleos rápidos calculam em double)
+// Os nomes são desfeitos no final, para a próxima inclusão.
+
+#define MOTOR_CONCATENA2(a, b) a##b
+#define MOTOR_CONCATENA(a, b) MOTOR_CONCATENA2(a, b)
+#define MOTOR_NOME(base) MOTOR_CONCATENA(base, MOTOR_SUFIXO)
+
+// Aplica o operador op a a e b (b é ignorado pelas funções); retorna CALC_OK e o valor em resultado, ou o código do erro.
+// rapido escolhe os núcleos rápidos de sen, cos, tg e log, se o motor os atende.
+static inline int MOTOR_NOME(aplicarOperacao)(int op, MOTOR_TIPO a, MOTOR_TIPO b, int rapido, MOTOR_TIPO *resultado) {
+    if (MOTOR_RAPIDO && rapido) {
+        switch (op) {
+            case OP_SEN: *resultado = senGrausRapido(a); return CALC_OK;
+            case OP_COS: *resultado = cosGrausRapido(a); return CALC_OK;
+            case OP_TG:
+                if (tangenteInvalidaRapida(a)) return CALC_ERRO_TANGENTE;
+                *resultado = tgGrausRapido(a);
+                return CALC_OK;
+            case OP_LOG:
+                if (a <= 0) return CALC_ERRO_LOG;
+                *resultado = log10Rapido(a);
+                return CALC_OK;
+        }
+    }
+    switch (op) {
+        case OP_SOMA: *resultado = a + b; break;
+        case OP_SUB: *resultado = a - b; break;
+        case OP_MUL: *resultado = a * b; break;
+        case OP_DIV:
+            if (b == 0) return CALC_ERRO_DIVISAO_ZERO;
+            *resultado = a / b;
+            break;
+        case OP_MOD: *resultado = MOTOR_FMOD((MOTOR_CALC)a, b); break;
+        case OP_POT: *resultado = MOTOR_POW((MOTOR_CALC)a, b); break;
+        case OP_RAIZ:
+            if (a < 0) return CALC_ERRO_RAIZ_NEGATIVA;
+            *resultado = MOTOR_SQRT((MOTOR_CALC)a);
+            break;
+        case OP_SEN: *resultado = MOTOR_SIN(a * MOTOR_PI / 180.0); break;
+        case OP_COS: *resultado = MOTOR_COS(a * MOTOR_PI / 180.0); break;
+        case OP_TG: {
+            MOTOR_CALC angle_mod_180 = MOTOR_FMOD(MOTOR_FABS((MOTOR_CALC)a), 180.0);
+            if (MOTOR_FABS(angle_mod_180 - 90.0) < 0.001 || MOTOR_FABS(angle_mod_180 - 270.0) < 0.001) return CALC_ERRO_TANGENTE;
+            *resultado = MOTOR_TAN(a * MOTOR_PI / 180.0);
+            break;
+        }
+        case OP_LOG:
+            if (a <= 0) return CALC_ERRO_LOG;
+            *resultado = MOTOR_LOG10((MOTOR_CALC)a);
+            break;
+    }
+    return CALC_OK;
+}
+
+// Executa o programa de pilha sobre pilha (com espaço para prog->profundidade valores).
+// Os testes de domínio já existiam no caminho de sucesso; em caso de erro só se grava o código e a posição.
+static inline int MOTOR_NOME(executarPilhaEm)(const Programa *prog, const MOTOR_ENTRADA *valores, MOTOR_TIPO *pilha, MOTOR_TIPO *resultado, ErroCalc *erro) {
+    int top = -1, rapido = prog->matematica == MATEMATICA_RAPIDA;
+    PERFIL_EXECUCAO(prog->profundidade);
+
+    for (int k = 0; k < prog->tamanho; k++) {
+        const Instrucao *ins = &prog->codigo[k];
+        int cod;
+        PERFIL_INICIO(inicioPerfil);
+        switch (ins->op) {
+            case OP_NUM: pilha[++top] = (MOTOR_TIPO)prog->constantes[ins->arg]; break;
+            case OP_VAR:
+                if (valores == NULL) return falhar(erro, CALC_ERRO_VARIAVEL_SEM_VALOR, prog->posicoes[k]);
+                pilha[++top] = valores[ins->arg];
+                break;
+            case OP_DUP: pilha[top + 1] = pilha[top]; top++; break;
+            case OP_RAIZ: case OP_SEN: case OP_COS: case OP_TG: case OP_LOG:
+                cod = MOTOR_NOME(aplicarOperacao)(ins->op, pilha[top], 0, rapido, &pilha[top]);
+                if (cod != CALC_OK) return falhar(erro, cod, prog->posicoes[k]);
+                break;
+            default:
+                top--;
+                cod = MOTOR_NOME(aplicarOperacao)(ins->op, pilha[top], pilha[top + 1], rapido, &pilha[top]);
+                if (cod != CALC_OK) return falhar(erro, cod, prog->posicoes[k]);
+                break;
+        }
+        PERFIL_OPERACAO(ins->op, 1, inicioPerfil);
+    }
+    *resultado = pilha[top];
+    return CALC_OK;
+}
+
+// Executa o programa de pilha; a pilha fica no stack frame, e só programas mais profundos que
+// PROGRAMA_PILHA_LOCAL alocam a sua
+static int MOTOR_NOME(executarPilha)(const Programa *prog, const MOTOR_ENTRADA *valores, MOTOR_TIPO *resultado, ErroCalc *erro) {
+    MOTOR_TIPO local[PROGRAMA_PILHA_LOCAL];
+    if (prog->profundidade <= PROGRAMA_PILHA_LOCAL) return MOTOR_NOME(executarPilhaEm)(prog, valores, local, resultado, erro);
+    MOTOR_TIPO *pilha = (MOTOR_TIPO*)malloc(prog->profundidade * sizeof(MOTOR_TIPO));
+    if (pilha == NULL) return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    int cod = MOTOR_NOME(executarPilhaEm)(prog, valores, pilha, resultado, erro);
+    free(pilha);
+    return cod;
+}
+
+// Executa o programa em registradores sobre r (com espaço para reg->numRegistros valores),
+// calculando cada subexpressão comum uma vez
+static inline int MOTOR_NOME(executarRegistrosEm)(const ProgramaReg *reg, const MOTOR_ENTRADA *valores, MOTOR_TIPO *r, MOTOR_TIPO *resultado, ErroCalc *erro) {
+    int rapido = reg->matematica == MATEMATICA_RAPIDA;
+    PERFIL_EXECUCAO(reg->numRegistros);
+
+    for (int k = 0; k < reg->tamanho; k++) {
+        const InstrucaoReg *ins = &reg->codigo[k];
+        int cod;
+        PERFIL_INICIO(inicioPerfil);
+        switch (ins->op) {
+            case OP_NUM: r[ins->destino] = (MOTOR_TIPO)reg->constantes[ins->a]; break;
+            case OP_VAR:
+                if (valores == NULL) return falhar(erro, CALC_ERRO_VARIAVEL_SEM_VALOR, reg->posicoes[k]);
+                r[ins->destino] = valores[ins->a];
+                break;
+            default:
+                cod = MOTOR_NOME(aplicarOperacao)(ins->op, r[ins->a], ins->b >= 0 ? r[ins->b] : 0, rapido, &r[ins->destino]);
+                if (cod != CALC_OK) return falhar(erro, cod, reg->posicoes[k]);
+                break;
+        }
+        PERFIL_OPERACAO(ins->op, 1, inicioPerfil);
+    }
+    *resultado = r[reg->resultado];
+    return CALC_OK;
+}
+
+// Idem para os registradores
+static int MOTOR_NOME(executarRegistros)(const ProgramaReg *reg, const MOTOR_ENTRADA *valores, MOTOR_TIPO *resultado, ErroCalc *erro) {
+    MOTOR_TIPO local[PROGRAMA_PILHA_LOCAL];
+    if (reg->numRegistros <= PROGRAMA_PILHA_LOCAL) return MOTOR_NOME(executarRegistrosEm)(reg, valores, local, resultado, erro);
+    MOTOR_TIPO *r = (MOTOR_TIPO*)malloc(reg->numRegistros * sizeof(MOTOR_TIPO));
+    if (r == NULL) return falhar(erro, CALC_ERRO_MEMORIA, -1);
+    int cod = MOTOR_NOME(executarRegistrosEm)(reg, valores, r, resultado, erro);
+    free(r);
+    return cod;
+}
+
+// Avaliação direta da infixa (ver "Avaliação direta da infixa" em calculadora.c); as duas funções retornam 0
+// se a entrada sai da gramática
+static int MOTOR_NOME(avaliarExpressaoDireta)(AvaliadorDireto *a, int prioridadeMinima, MOTOR_TIPO *valor);
+
+static int MOTOR_NOME(avaliarUnarioDireto)(AvaliadorDireto *a, MOTOR_TIPO *valor) {
+    if (!a->temToken || ++a->profundidade > AVALIACAO_DIRETA_PROFUNDIDADE) return 0;
+    const Token t = a->token;
+    int posicao = (int)(t.texto.inicio - a->texto);
+    avancarDireto(a);
+    if (t.tipo == TOKEN_NUMERO) {
+        PERFIL_INICIO(inicioPerfil);
+        *valor = (MOTOR_TIPO)t.valor;
+        PERFIL_OPERACAO(OP_NUM, 1, inicioPerfil);
+    } else if (t.tipo == TOKEN_VARIAVEL) {
+        if (t.texto.tamanho > TAM_NOME_VARIAVEL - 1) return 0; // A compilação dá o erro de nome longo
+        *valor = 0;
+        registrarErroDireto(a, CALC_ERRO_VARIAVEL_SEM_VALOR, posicao);
+    } else if (t.tipo == TOKEN_ABRE) {
+        if (!MOTOR_NOME(avaliarExpressaoDireta)(a, 0, valor) || !a->temToken || a->token.tipo != TOKEN_FECHA) return 0;
+        avancarDireto(a);
+    } else if (t.tipo == TOKEN_OPERADOR && ehFuncaoOp(t.op)) {
+        MOTOR_TIPO x;
+        if (!MOTOR_NOME(avaliarUnarioDireto)(a, &x)) return 0;
+        if (a->codigo == CALC_OK) {
+            PERFIL_INICIO(inicioPerfil);
+            int cod = MOTOR_NOME(aplicarOperacao)(t.op, x, 0, a->rapido, valor);
+            if (cod != CALC_OK) {
+                registrarErroDireto(a, cod, posicao);
+            } else {
+                PERFIL_OPERACAO(t.op, 1, inicioPerfil);
+            }
+        }
+    } else {
+        return 0;
+    }
+    a->profundidade--;
+    return 1;
+}
+
+// Operandos unidos por binários de prioridade >= prioridadeMinima
+static int MOTOR_NOME(avaliarExpressaoDireta)(AvaliadorDireto *a, int prioridadeMinima, MOTOR_TIPO *valor) {
+    if (++a->profundidade > AVALIACAO_DIRETA_PROFUNDIDADE || !MOTOR_NOME(avaliarUnarioDireto)(a, valor)) return 0;
+    while (a->temToken && a->token.tipo == TOKEN_OPERADOR && !ehFuncaoOp(a->token.op) && prioridadeOp[a->token.op] >= prioridadeMinima) {
+        int op = a->token.op, posicao = (int)(a->token.texto.inicio - a->texto);
+        MOTOR_TIPO direito;
+        avancarDireto(a);
+        if (!MOTOR_NOME(avaliarExpressaoDireta)(a, op == OP_POT ? prioridadeOp[op] : prioridadeOp[op] + 1, &direito)) return 0;
+        if (a->codigo == CALC_OK) {
+            PERFIL_INICIO(inicioPerfil);
+            int cod = MOTOR_NOME(aplicarOperacao)(op, *valor, direito, a->rapido, valor);
+            if (cod != CALC_OK) {
+                registrarErroDireto(a, cod, posicao);
+            } else {
+                PERFIL_OPERACAO(op, 1, inicioPerfil);
+            }
+        }
+    }
+    a->profundidade--;
+    return 1;
+}
+
+#undef MOTOR_CONCATENA2
+#undef MOTOR_CONCATENA
+#undef MOTOR_NOME
+#undef MOTOR_SUFIXO
+#undef MOTOR_TIPO
+#undef MOTOR_ENTRADA
+#undef MOTOR_CALC
+#undef MOTOR_PI
+#undef MOTOR_SQRT
+#undef MOTOR_SIN
+#undef MOTOR_COS
+#undef MOTOR_TAN
+#undef MOTOR_POW
+#undef MOTOR_FMOD
+#undef MOTOR_LOG10
+#undef MOTOR_FABS
+#undef MOTOR_RAPIDO
@@ -2,6 +2,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h> // Para CreateFileMapping/MapViewOfFile
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "calculadora.h"
 
 // Função auxiliar para exibir o menu
@@ -11,14 +20,580 @@ void mostrarMenu() {
     printf("2. Converter Posfixa para Infixa\n");
     printf("3. Calcular valor da expressao Infixa\n");
     printf("4. Calcular valor da expressao Posfixa\n");
+    printf("5. Calcular valor da expressao Infixa com variaveis\n");
     printf("0. Sair\n");
     printf("Escolha uma opcao: ");
 }
 
-int main() {
+// Mostra o erro e aponta o token onde ele ocorreu
+void mostrarErro(const char *entrada, const ErroCalc *erro) {
+    printf("Erro: %s.\n", mensagemErro(erro->codigo));
+    if (erro->posicao >= 0) {
+        printf("  %s\n  %*s^\n", entrada, erro->posicao, "");
+    }
+    printf("\n");
+}
+
+// ===== Modo lote (não interativo) =====
+// Uso: programa <operacao> [--csv] [--mmap [--threads N]] [--cache N] [--precisao P] [--rapida] [--perfil] [arquivo]
+// Lê uma expressão por linha do arquivo (ou da entrada padrão) e escreve um resultado por linha.
+#define TAM_BUFFER_ES (1 << 20) // Buffer de leitura e escrita do modo lote
+#define TAM_FATIA_MMAP (16L << 20) // Bytes do arquivo mapeado entregues a cada thread por rodada
+
+typedef enum { LOTE_POSFIXA, LOTE_INFIXA, LOTE_VALOR_INFIXA, LOTE_VALOR_POSFIXA, LOTE_POSFIXA_OTIMIZADA } OperacaoLote;
+
+void mostrarUso(const char *programa) {
+    fprintf(stderr, "Uso: %s [operacao] [--csv] [--mmap [--threads N]] [--cache N] [--precisao P] [--rapida] [--perfil] [arquivo]\n", programa);
+    fprintf(stderr, "Sem argumentos, abre o menu interativo. Operacoes (uma expressao por linha):\n");
+    fprintf(stderr, "  --posfixa            converte infixa para posfixa\n");
+    fprintf(stderr, "  --posfixa-otimizada  pos-fixa apos dobrar constantes e simplificar\n");
+    fprintf(stderr, "  --infixa             converte posfixa para infixa\n");
+    fprintf(stderr, "  --valor-infixa       calcula o valor da expressao infixa\n");
+    fprintf(stderr, "  --valor-posfixa      calcula o valor da expressao posfixa\n");
+    fprintf(stderr, "  --compilar-pacote S  compila as expressoes infixas no pacote binario S (com --precisao e --rapida)\n");
+    fprintf(stderr, "  --valor-pacote       calcula os programas do pacote [arquivo], sem ler texto\n");
+    fprintf(stderr, "  --csv                saida em CSV: expressao,resultado,erro,posicao\n");
+    fprintf(stderr, "  --mmap               mapeia o arquivo na memoria e divide as linhas entre threads\n");
+    fprintf(stderr, "  --threads N          numero de threads do modo --mmap (padrao: todos os nucleos)\n");
+    fprintf(stderr, "  --cache N            guarda ate N expressoes repetidas (LRU; por thread no modo --mmap)\n");
+    fprintf(stderr, "  --precisao P         tipo do calculo dos valores: float (padrao), double ou long\n");
+    fprintf(stderr, "  --rapida             sen, cos, tg e log pelos nucleos rapidos em graus, em vez da libm\n");
+    fprintf(stderr, "  --perfil             ao final, mostra tokens, conversao e tempo de cada operador\n");
+    fprintf(stderr, "                       (so se calculadora.c for compilado com -DCALC_PERFIL)\n");
+}
+
+// Mostra em stderr os contadores do cache do modo lote
+void mostrarEstatisticasCache(const EstatisticasCache *e) {
+    long total = e->acertos + e->falhas;
+    fprintf(stderr, "Cache: %ld acertos, %ld falhas (%.1f%%), %d/%d entradas\n",
+            e->acertos, e->falhas, total ? 100.0 * e->acertos / total : 0.0, e->entradas, e->capacidade);
+}
+
+// Mostra em stderr o relatório do perfil (contadores de todas as threads)
+void mostrarPerfil() {
+    PerfilCalc perfil;
+    char relatorio[4096];
+    getPerfil(&perfil);
+    if (escreverRelatorioPerfil(&perfil, relatorio, sizeof(relatorio)) >= 0) fputs(relatorio, stderr);
+}
+
+// Saída acumulada em memória, escrita no arquivo em blocos grandes
+typedef struct {
+    char *dados;
+    long tamanho;
+    long capacidade;
+} BufferSaida;
+
+// Garante espaço para mais n bytes
+void reservarSaida(BufferSaida *b, long n) {
+    if (b->tamanho + n <= b->capacidade) return;
+    long capacidade = b->capacidade ? b->capacidade : 4096;
+    while (capacidade < b->tamanho + n) capacidade *= 2;
+    b->dados = (char*)realloc(b->dados, capacidade);
+    if (b->dados == NULL) {
+        fprintf(stderr, "Erro de alocação de memória para a saida.\n");
+        exit(EXIT_FAILURE);
+    }
+    b->capacidade = capacidade;
+}
+
+void anexarSaida(BufferSaida *b, const char *texto, long n) {
+    reservarSaida(b, n);
+    memcpy(b->dados + b->tamanho, texto, n);
+    b->tamanho += n;
+}
+
+// Escreve um campo CSV entre aspas, dobrando as aspas internas
+void anexarCampoCsv(BufferSaida *b, const char *texto, long n) {
+    reservarSaida(b, 2 * n + 2);
+    b->dados[b->tamanho++] = '"';
+    for (long i = 0; i < n; i++) {
+        if (texto[i] == '"') b->dados[b->tamanho++] = '"';
+        b->dados[b->tamanho++] = texto[i];
+    }
+    b->dados[b->tamanho++] = '"';
+}
+
+// Começa o resultado da expressão [linha, linha + len) e devolve onde escrevê-lo, com espaco bytes livres
+char *iniciarResultado(BufferSaida *saida, int csv, const char *linha, long len, long espaco) {
+    if (csv) {
+        anexarCampoCsv(saida, linha, len);
+        anexarSaida(saida, ",\"", 2);
+    }
+    reservarSaida(saida, espaco);
+    return saida->dados + saida->tamanho;
+}
+
+// Fecha o resultado: os n bytes escritos, ou a mensagem de erro de cod; retorna 1 se houve erro
+int concluirResultado(BufferSaida *saida, int csv, int cod, int n, const ErroCalc *erro) {
+    char texto[128];
+    if (cod == CALC_OK) {
+        saida->tamanho += n;
+        anexarSaida(saida, csv ? "\",,\n" : "\n", csv ? 4 : 1);
+    } else if (csv) {
+        saida->tamanho--; // Resultado vazio, sem aspas
+        anexarSaida(saida, ",", 1);
+        anexarCampoCsv(saida, mensagemErro(cod), (long)strlen(mensagemErro(cod)));
+        anexarSaida(saida, texto, snprintf(texto, sizeof(texto), ",%d\n", erro->posicao));
+    } else {
+        anexarSaida(saida, texto, snprintf(texto, sizeof(texto), "Erro: %s (posicao %d)\n", mensagemErro(cod), erro->posicao));
+    }
+    return cod != CALC_OK;
+}
+
+// Processa uma linha [linha, linha + len) e acrescenta o resultado a saida; retorna 1 se a linha teve erro.
+// cache (pode ser NULL) guarda os resultados de expressões repetidas; só é usado na precisão float com a libm.
+// contexto (pode ser NULL) fornece a memória de trabalho de quem não passa pelo cache e é reiniciado a cada linha.
+int processarLinha(OperacaoLote operacao, int csv, Precisao precisao, ModoMatematica matematica, CacheCalc *cache, ContextoCalc *contexto, const char *linha, long len, BufferSaida *saida) {
+    ErroCalc erro;
+    int cod = CALC_OK;
+    float valor;
+    double valorDouble;
+
+    reiniciarContexto(contexto);
+    // O resultado é escrito direto no buffer de saída.
+    // Sem dup, a conversão para infixa acrescenta no máximo "(", ")" e dois espaços por operador.
+    long espaco = 4 * len + 16;
+    char *destino = iniciarResultado(saida, csv, linha, len, espaco);
+    int n = 0;
+    switch (operacao) {
+        case LOTE_POSFIXA:
+            if (cache == NULL) n = getFormaPosFixaContexto(contexto, linha, (int)len, destino, (int)espaco, &erro);
+            else n = getFormaPosFixaCache(cache, linha, (int)len, destino, (int)espaco, &erro);
+            if (n < 0) cod = erro.codigo;
+            break;
+        case LOTE_POSFIXA_OTIMIZADA:
+            if ((n = getFormaPosFixaOtimizadaContexto(contexto, linha, (int)len, destino, (int)espaco, &erro)) < 0) cod = erro.codigo;
+            break;
+        case LOTE_INFIXA:
+            n = getFormaInFixaContexto(contexto, linha, (int)len, destino, (int)espaco, &erro);
+            // Cada dup repete a subexpressão e a infixa pode passar da estimativa: a saída cresce para o tamanho exato
+            if (n < 0 && erro.codigo == CALC_ERRO_BUFFER_PEQUENO && (espaco = getTamanhoInFixaContexto(contexto, linha, (int)len, &erro) + 1) > 0) {
+                reservarSaida(saida, espaco);
+                destino = saida->dados + saida->tamanho;
+                n = getFormaInFixaContexto(contexto, linha, (int)len, destino, (int)espaco, &erro);
+            }
+            if (n < 0) cod = erro.codigo;
+            break;
+        case LOTE_VALOR_INFIXA:
+            if (cache == NULL || precisao != PRECISAO_FLOAT || matematica != MATEMATICA_EXATA) {
+                if ((cod = avaliarInFixaPrecisaoContexto(contexto, linha, (int)len, precisao, matematica, &valorDouble, &erro)) == CALC_OK) n = snprintf(destino, espaco, precisao == PRECISAO_FLOAT ? "%.9g" : "%.17g", valorDouble);
+            } else if ((cod = avaliarInFixaCache(cache, linha, (int)len, &valor, &erro)) == CALC_OK) n = snprintf(destino, espaco, "%.9g", valor);
+            break;
+        case LOTE_VALOR_POSFIXA:
+            if (cache == NULL || precisao != PRECISAO_FLOAT || matematica != MATEMATICA_EXATA) {
+                if ((cod = avaliarPosFixaPrecisaoContexto(contexto, linha, (int)len, precisao, matematica, &valorDouble, &erro)) == CALC_OK) n = snprintf(destino, espaco, precisao == PRECISAO_FLOAT ? "%.9g" : "%.17g", valorDouble);
+            } else if ((cod = avaliarPosFixaCache(cache, linha, (int)len, &valor, &erro)) == CALC_OK) n = snprintf(destino, espaco, "%.9g", valor);
+            break;
+    }
+
+    return concluirResultado(saida, csv, cod, n, &erro);
+}
+
+// Lê uma linha inteira (sem o '\n'), aumentando *buffer quando preciso; retorna o comprimento ou -1 no fim
+long lerLinha(FILE *arquivo, char **buffer, long *capacidade) {
+    long len = 0;
+    for (;;) {
+        if (len + 2 > *capacidade) {
+            *capacidade *= 2;
+            *buffer = (char*)realloc(*buffer, *capacidade);
+            if (*buffer == NULL) {
+                fprintf(stderr, "Erro de alocação de memória para a linha de entrada.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (fgets(*buffer + len, (int)(*capacidade - len), arquivo) == NULL) {
+            return len > 0 ? len : -1;
+        }
+        len += (long)strlen(*buffer + len);
+        if ((*buffer)[len - 1] == '\n') {
+            (*buffer)[--len] = '\0';
+            if (len > 0 && (*buffer)[len - 1] == '\r') (*buffer)[--len] = '\0';
+            return len;
+        }
+    }
+}
+
+// Lê a expressão digitada, de qualquer tamanho; no fim da entrada, fica vazia
+void lerExpressao(char **entrada, long *capacidade) {
+    if (lerLinha(stdin, entrada, capacidade) < 0) (*entrada)[0] = '\0';
+}
+
+// Garante necessario bytes em *buffer e o retorna; encerra o programa se faltar memória
+char *reservarBuffer(char **buffer, long *capacidade, long necessario) {
+    if (necessario > *capacidade) {
+        *buffer = (char*)realloc(*buffer, necessario);
+        if (*buffer == NULL) {
+            fprintf(stderr, "Erro de alocação de memória para a expressão convertida.\n");
+            exit(EXIT_FAILURE);
+        }
+        *capacidade = necessario;
+    }
+    return *buffer;
+}
+
+// Espaço para a conversão de expressao (sem dup, no pior caso a infixa: "(", ")" e dois espaços por operador)
+char *reservarConversao(char **buffer, long *capacidade, const char *expressao) {
+    return reservarBuffer(buffer, capacidade, 4 * (long)strlen(expressao) + 16);
+}
+
+int executarModoLote(OperacaoLote operacao, int csv, Precisao precisao, ModoMatematica matematica, CacheCalc *cache, FILE *entrada, FILE *saida) {
+    static char bufferEntrada[TAM_BUFFER_ES];
+    setvbuf(entrada, bufferEntrada, _IOFBF, sizeof(bufferEntrada));
+
+    long capacidade = 4096;
+    char *linha = (char*)malloc(capacidade);
+    BufferSaida resultado = { NULL, 0, 0 };
+    ContextoCalc *contexto = criarContexto(0); // Sem memória, as linhas usam malloc
+    long len, linhasComErro = 0;
+    if (linha == NULL) {
+        fprintf(stderr, "Erro de alocação de memória para a linha de entrada.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (csv) fputs("expressao,resultado,erro,posicao\n", saida);
+
+    while ((len = lerLinha(entrada, &linha, &capacidade)) >= 0) {
+        linhasComErro += processarLinha(operacao, csv, precisao, matematica, cache, contexto, linha, len, &resultado);
+        if (resultado.tamanho >= TAM_BUFFER_ES) {
+            fwrite(resultado.dados, 1, resultado.tamanho, saida);
+            resultado.tamanho = 0;
+        }
+    }
+    fwrite(resultado.dados, 1, resultado.tamanho, saida);
+
+    free(linha);
+    free(resultado.dados);
+    liberarContexto(contexto);
+    fflush(saida);
+    return linhasComErro > 0 ? 2 : EXIT_SUCCESS;
+}
+
+// ===== Modo lote sobre arquivo mapeado na memória =====
+// As linhas são lidas direto do mapeamento, sem cópia: cada uma é passada como (ponteiro, comprimento).
+
+typedef struct {
+    OperacaoLote operacao;
+    int csv;
+    Precisao precisao;
+    ModoMatematica matematica;
+    CacheCalc *cache; // Próprio de cada thread
+    ContextoCalc *contexto; // Idem
+    const char *inicio, *fim; // Linhas completas desta thread
+    BufferSaida saida;
+    long linhasComErro;
+    int emThread; // 1 se a fatia da rodada atual roda numa thread criada
+} FatiaArquivo;
+
+void *processarFatia(void *arg) {
+    FatiaArquivo *f = (FatiaArquivo*)arg;
+    const char *linha = f->inicio;
+    while (linha < f->fim) {
+        const char *quebra = (const char*)memchr(linha, '\n', f->fim - linha);
+        const char *fimLinha = quebra ? quebra : f->fim;
+        long len = (long)(fimLinha - linha);
+        if (len > 0 && linha[len - 1] == '\r') len--;
+        f->linhasComErro += processarLinha(f->operacao, f->csv, f->precisao, f->matematica, f->cache, f->contexto, linha, len, &f->saida);
+        linha = fimLinha + 1;
+    }
+    return NULL;
+}
+
+// Avança p até logo depois da próxima quebra de linha (ou até fim)
+const char *inicioProximaLinha(const char *p, const char *fim) {
+    const char *quebra = (const char*)memchr(p, '\n', fim - p);
+    return quebra ? quebra + 1 : fim;
+}
+
+int executarModoMmap(OperacaoLote operacao, int csv, Precisao precisao, ModoMatematica matematica, int capacidadeCache, const char *nomeArquivo, int numThreads, FILE *saida) {
+    long long tamanho = 0;
+    const char *dados = NULL;
+    FatiaArquivo *fatias = NULL;
+    pthread_t *threads = NULL;
+    long linhasComErro = 0;
+    int status = EXIT_FAILURE;
+#ifdef _WIN32
+    HANDLE arquivo = CreateFileA(nomeArquivo, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    HANDLE mapeamento = NULL;
+    LARGE_INTEGER tamanhoArquivo;
+    if (arquivo == INVALID_HANDLE_VALUE || !GetFileSizeEx(arquivo, &tamanhoArquivo)) {
+        fprintf(stderr, "Erro: nao foi possivel abrir '%s'.\n", nomeArquivo);
+        goto fim;
+    }
+    tamanho = tamanhoArquivo.QuadPart;
+    mapeamento = tamanho > 0 ? CreateFileMappingA(arquivo, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    dados = mapeamento ? (const char*)MapViewOfFile(mapeamento, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+    int arquivo = open(nomeArquivo, O_RDONLY);
+    struct stat info;
+    if (arquivo < 0 || fstat(arquivo, &info) != 0) {
+        fprintf(stderr, "Erro: nao foi possivel abrir '%s'.\n", nomeArquivo);
+        goto fim;
+    }
+    tamanho = info.st_size;
+    dados = tamanho > 0 ? (const char*)mmap(NULL, tamanho, PROT_READ, MAP_PRIVATE, arquivo, 0) : NULL;
+    if (dados == (const char*)MAP_FAILED) dados = NULL;
+    else if (dados != NULL) madvise((void*)dados, tamanho, MADV_SEQUENTIAL);
+#endif
+    if (tamanho > 0 && dados == NULL) {
+        fprintf(stderr, "Erro: nao foi possivel mapear '%s' na memoria.\n", nomeArquivo);
+        goto fim;
+    }
+
+    if (numThreads <= 0) numThreads = getNumeroNucleos();
+    fatias = (FatiaArquivo*)calloc(numThreads, sizeof(FatiaArquivo));
+    threads = (pthread_t*)malloc(numThreads * sizeof(pthread_t));
+    if (fatias == NULL || threads == NULL) {
+        fprintf(stderr, "Erro de alocação de memória para as threads.\n");
+        goto fim;
+    }
+    for (int t = 0; t < numThreads; t++) {
+        fatias[t].operacao = operacao;
+        fatias[t].csv = csv;
+        fatias[t].precisao = precisao;
+        fatias[t].matematica = matematica;
+        fatias[t].cache = criarCache(capacidadeCache);
+        fatias[t].contexto = criarContexto(0);
+    }
+
+    if (csv) fputs("expressao,resultado,erro,posicao\n", saida);
+
+    // Em cada rodada, cada thread recebe até TAM_FATIA_MMAP bytes, cortados em quebras de linha.
+    // As saídas são escritas na ordem das fatias, o que preserva a ordem das linhas.
+    const char *fimArquivo = dados + tamanho;
+    const char *cursor = dados;
+    while (cursor < fimArquivo) {
+        for (int t = 0; t < numThreads; t++) {
+            const char *fimFatia = (fimArquivo - cursor > TAM_FATIA_MMAP) ? inicioProximaLinha(cursor + TAM_FATIA_MMAP, fimArquivo) : fimArquivo;
+            fatias[t].inicio = cursor;
+            fatias[t].fim = fimFatia;
+            fatias[t].saida.tamanho = 0;
+            cursor = fimFatia;
+        }
+        // Uma fatia cuja thread não pôde ser criada é processada aqui mesmo, depois da primeira
+        for (int t = 1; t < numThreads; t++) {
+            fatias[t].emThread = pthread_create(&threads[t], NULL, processarFatia, &fatias[t]) == 0;
+        }
+        for (int t = 0; t < numThreads; t++) {
+            if (t == 0 || !fatias[t].emThread) processarFatia(&fatias[t]);
+        }
+        for (int t = 1; t < numThreads; t++) {
+            if (fatias[t].emThread) pthread_join(threads[t], NULL);
+        }
+        for (int t = 0; t < numThreads; t++) {
+            fwrite(fatias[t].saida.dados, 1, fatias[t].saida.tamanho, saida);
+        }
+    }
+
+    EstatisticasCache total = { 0, 0, 0, 0 };
+    for (int t = 0; t < numThreads; t++) {
+        EstatisticasCache estatisticas;
+        getEstatisticasCache(fatias[t].cache, &estatisticas);
+        total.acertos += estatisticas.acertos;
+        total.falhas += estatisticas.falhas;
+        total.entradas += estatisticas.entradas;
+        total.capacidade += estatisticas.capacidade;
+        linhasComErro += fatias[t].linhasComErro;
+        liberarCache(fatias[t].cache);
+        liberarContexto(fatias[t].contexto);
+        free(fatias[t].saida.dados);
+    }
+    if (capacidadeCache > 0) mostrarEstatisticasCache(&total);
+    fflush(saida);
+    status = linhasComErro > 0 ? 2 : EXIT_SUCCESS;
+
+fim:
+    free(fatias);
+    free(threads);
+#ifdef _WIN32
+    if (dados != NULL) UnmapViewOfFile(dados);
+    if (mapeamento != NULL) CloseHandle(mapeamento);
+    if (arquivo != INVALID_HANDLE_VALUE) CloseHandle(arquivo);
+#else
+    if (dados != NULL) munmap((void*)dados, tamanho);
+    if (arquivo >= 0) close(arquivo);
+#endif
+    return status;
+}
+
+// ===== Pacote de programas pré-compilados =====
+// --compilar-pacote compila cada linha (infixa) da entrada e grava todos os programas num pacote binário;
+// --valor-pacote carrega o pacote por mmap, sem ler texto, e escreve o que --valor-infixa daria para as linhas.
+
+int executarCompilarPacote(Precisao precisao, ModoMatematica matematica, FILE *entrada, const char *nomePacote) {
+    long capacidade = 4096, len;
+    char *linha = (char*)malloc(capacidade);
+    ContextoCalc *contexto = criarContexto(0); // Guarda todos os programas e textos até a gravação
+    Programa *programas = NULL;
+    const char **textos = NULL;
+    int n = 0, capacidadeProgramas = 0, numLinha = 0, linhasComErro = 0;
+    if (linha == NULL) {
+        fprintf(stderr, "Erro de alocação de memória para a linha de entrada.\n");
+        return EXIT_FAILURE;
+    }
+
+    while ((len = lerLinha(entrada, &linha, &capacidade)) >= 0) {
+        ErroCalc erro;
+        numLinha++;
+        if (n == capacidadeProgramas) {
+            capacidadeProgramas = capacidadeProgramas ? 2 * capacidadeProgramas : 1024;
+            programas = (Programa*)realloc(programas, capacidadeProgramas * sizeof(Programa));
+            textos = (const char**)realloc(textos, capacidadeProgramas * sizeof(char*));
+            if (programas == NULL || textos == NULL) {
+                fprintf(stderr, "Erro de alocação de memória para os programas.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        // Com erro, a linha não entra no pacote, e ao final nada é gravado: o índice de cada programa é o da sua linha
+        if (compilarInFixaContexto(contexto, linha, (int)len, &programas[n], &erro) != CALC_OK) {
+            fprintf(stderr, "Linha %d: Erro: %s (posicao %d)\n", numLinha, mensagemErro(erro.codigo), erro.posicao);
+            linhasComErro++;
+            continue;
+        }
+        char *texto = (char*)alocarContexto(contexto, len + 1);
+        if (texto == NULL) {
+            fprintf(stderr, "Erro de alocação de memória para os programas.\n");
+            return EXIT_FAILURE;
+        }
+        memcpy(texto, linha, len);
+        texto[len] = '\0';
+        programas[n].precisao = precisao;
+        programas[n].matematica = matematica;
+        textos[n++] = texto;
+    }
+
+    int status = EXIT_SUCCESS;
+    ErroCalc erro;
+    if (linhasComErro > 0) {
+        fprintf(stderr, "%d linhas com erro; o pacote '%s' nao foi gravado.\n", linhasComErro, nomePacote);
+        status = 2;
+    } else if (salvarPacote(nomePacote, programas, textos, n, &erro) != CALC_OK) {
+        fprintf(stderr, "Erro: %s ('%s').\n", mensagemErro(erro.codigo), nomePacote);
+        status = EXIT_FAILURE;
+    } else {
+        fprintf(stderr, "Pacote '%s': %d programas, %ld bytes\n", nomePacote, n, tamanhoPacote(programas, textos, n));
+    }
+    free(linha);
+    free(programas);
+    free(textos);
+    liberarContexto(contexto);
+    return status;
+}
+
+int executarValorPacote(int csv, const char *nomePacote, FILE *saida) {
+    ErroCalc erro;
+    PacoteProgramas *pacote = abrirPacote(nomePacote, &erro);
+    if (pacote == NULL) {
+        fprintf(stderr, "Erro: %s ('%s', byte %d).\n", mensagemErro(erro.codigo), nomePacote, erro.posicao);
+        return EXIT_FAILURE;
+    }
+    BufferSaida resultado = { NULL, 0, 0 };
+    long linhasComErro = 0;
+    if (csv) fputs("expressao,resultado,erro,posicao\n", saida);
+
+    for (int i = 0; i < getNumeroProgramasPacote(pacote); i++) {
+        Programa prog;
+        double valor;
+        const char *texto = getTextoProgramaPacote(pacote, i);
+        char *destino = iniciarResultado(&resultado, csv, texto, (long)strlen(texto), 32);
+        int cod = carregarPrograma(pacote, i, &prog, &erro), n = 0;
+        if (cod == CALC_OK && (cod = executarProgramaDouble(&prog, NULL, &valor, &erro)) == CALC_OK) {
+            n = snprintf(destino, 32, prog.precisao == PRECISAO_FLOAT ? "%.9g" : "%.17g", valor);
+        }
+        linhasComErro += concluirResultado(&resultado, csv, cod, n, &erro);
+        if (resultado.tamanho >= TAM_BUFFER_ES) {
+            fwrite(resultado.dados, 1, resultado.tamanho, saida);
+            resultado.tamanho = 0;
+        }
+    }
+    fwrite(resultado.dados, 1, resultado.tamanho, saida);
+
+    free(resultado.dados);
+    fecharPacote(pacote);
+    fflush(saida);
+    return linhasComErro > 0 ? 2 : EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        int operacao = -1, csv = 0, usarMmap = 0, numThreads = 0, capacidadeCache = 0, perfil = 0, valorPacote = 0;
+        Precisao precisao = PRECISAO_FLOAT;
+        ModoMatematica matematica = MATEMATICA_EXATA;
+        const char *nomeArquivo = NULL, *nomePacote = NULL;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--compilar-pacote") == 0 && i + 1 < argc) nomePacote = argv[++i];
+            else if (strcmp(argv[i], "--valor-pacote") == 0) valorPacote = 1;
+            else if (strcmp(argv[i], "--posfixa") == 0) operacao = LOTE_POSFIXA;
+            else if (strcmp(argv[i], "--posfixa-otimizada") == 0) operacao = LOTE_POSFIXA_OTIMIZADA;
+            else if (strcmp(argv[i], "--infixa") == 0) operacao = LOTE_INFIXA;
+            else if (strcmp(argv[i], "--valor-infixa") == 0) operacao = LOTE_VALOR_INFIXA;
+            else if (strcmp(argv[i], "--valor-posfixa") == 0) operacao = LOTE_VALOR_POSFIXA;
+            else if (strcmp(argv[i], "--csv") == 0) csv = 1;
+            else if (strcmp(argv[i], "--mmap") == 0) usarMmap = 1;
+            else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) numThreads = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) capacidadeCache = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--rapida") == 0) matematica = MATEMATICA_RAPIDA;
+            else if (strcmp(argv[i], "--perfil") == 0) perfil = 1;
+            else if (strcmp(argv[i], "--precisao") == 0 && i + 1 < argc) {
+                i++;
+                if (strcmp(argv[i], "float") == 0) precisao = PRECISAO_FLOAT;
+                else if (strcmp(argv[i], "double") == 0) precisao = PRECISAO_DOUBLE;
+                else if (strcmp(argv[i], "long") == 0) precisao = PRECISAO_LONG_DOUBLE;
+                else {
+                    mostrarUso(argv[0]);
+                    return EXIT_FAILURE;
+                }
+            } else if (argv[i][0] != '-' && nomeArquivo == NULL) nomeArquivo = argv[i];
+            else {
+                mostrarUso(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        int numOperacoes = (operacao >= 0) + (nomePacote != NULL) + valorPacote;
+        if (numOperacoes != 1 || (usarMmap && (nomeArquivo == NULL || operacao < 0)) || (valorPacote && nomeArquivo == NULL)) {
+            mostrarUso(argv[0]);
+            return EXIT_FAILURE;
+        }
+        static char bufferSaida[TAM_BUFFER_ES];
+        setvbuf(stdout, bufferSaida, _IOFBF, sizeof(bufferSaida));
+        if (valorPacote) return executarValorPacote(csv, nomeArquivo, stdout);
+        if (usarMmap) {
+            int status = executarModoMmap((OperacaoLote)operacao, csv, precisao, matematica, capacidadeCache, nomeArquivo, numThreads, stdout);
+            if (perfil) mostrarPerfil();
+            return status;
+        }
+        FILE *entrada = stdin;
+        if (nomeArquivo != NULL && (entrada = fopen(nomeArquivo, "r")) == NULL) {
+            fprintf(stderr, "Erro: nao foi possivel abrir '%s'.\n", nomeArquivo);
+            return EXIT_FAILURE;
+        }
+        if (nomePacote != NULL) {
+            int status = executarCompilarPacote(precisao, matematica, entrada, nomePacote);
+            if (entrada != stdin) fclose(entrada);
+            return status;
+        }
+        CacheCalc *cache = criarCache(capacidadeCache);
+        int status = executarModoLote((OperacaoLote)operacao, csv, precisao, matematica, cache, entrada, stdout);
+        if (cache != NULL) {
+            EstatisticasCache estatisticas;
+            getEstatisticasCache(cache, &estatisticas);
+            mostrarEstatisticasCache(&estatisticas);
+            liberarCache(cache);
+        }
+        if (entrada != stdin) fclose(entrada);
+        if (perfil) mostrarPerfil();
+        return status;
+    }
+
     int opcao;
-    char entrada[512];
-    Expressao expr;
+    long capacidade = 512, capacidadeConvertida = 0;
+    char *entrada = (char*)malloc(capacidade), *convertida = NULL; // Crescem com a expressão digitada
+    Expressao expr = { NULL, NULL, 0 };
+    ErroCalc erro;
+    if (entrada == NULL) {
+        fprintf(stderr, "Erro de alocação de memória para a linha de entrada.\n");
+        return EXIT_FAILURE;
+    }
 
     do {
         mostrarMenu();
@@ -28,43 +603,92 @@ int main() {
         switch(opcao) {
             case 1:
                 printf("Digite a expressao infixa:\n");
-                fgets(entrada, sizeof(entrada), stdin);
-                entrada[strcspn(entrada, "\n")] = '\0';
+                lerExpressao(&entrada, &capacidade);
 
-                strcpy(expr.inFixa, entrada);
-                strcpy(expr.posFixa, getFormaPosFixa(entrada));
+                expr.inFixa = entrada;
+                expr.posFixa = reservarConversao(&convertida, &capacidadeConvertida, entrada);
+                if (getFormaPosFixa_r(entrada, expr.posFixa, (int)capacidadeConvertida, &erro) < 0) {
+                    mostrarErro(entrada, &erro);
+                    break;
+                }
                 printf("Forma posfixa: %s\n\n", expr.posFixa);
                 break;
 
             case 2:
                 printf("Digite a expressao posfixa:\n");
-                fgets(entrada, sizeof(entrada), stdin);
-                entrada[strcspn(entrada, "\n")] = '\0';
+                lerExpressao(&entrada, &capacidade);
 
-                strcpy(expr.posFixa, entrada);
-                strcpy(expr.inFixa, getFormaInFixa(entrada));
+                expr.posFixa = entrada;
+                expr.inFixa = reservarConversao(&convertida, &capacidadeConvertida, entrada);
+                int n = getFormaInFixa_r(entrada, expr.inFixa, (int)capacidadeConvertida, &erro);
+                long exato = n < 0 && erro.codigo == CALC_ERRO_BUFFER_PEQUENO ? getTamanhoInFixaN(entrada, (int)strlen(entrada), &erro) : -1;
+                if (exato >= 0) { // Com dup, a infixa passou da estimativa
+                    expr.inFixa = reservarBuffer(&convertida, &capacidadeConvertida, exato + 1);
+                    n = getFormaInFixa_r(entrada, expr.inFixa, (int)capacidadeConvertida, &erro);
+                }
+                if (n < 0) {
+                    mostrarErro(entrada, &erro);
+                    break;
+                }
                 printf("Forma infixa: %s\n\n", expr.inFixa);
                 break;
 
             case 3:
                 printf("Digite a expressao infixa:\n");
-                fgets(entrada, sizeof(entrada), stdin);
-                entrada[strcspn(entrada, "\n")] = '\0';
+                lerExpressao(&entrada, &capacidade);
 
-                strcpy(expr.inFixa, entrada);
-                expr.Valor = getValorInFixa(entrada);
+                expr.inFixa = entrada;
+                if (avaliarInFixa(entrada, &expr.Valor, &erro) != CALC_OK) {
+                    mostrarErro(entrada, &erro);
+                    break;
+                }
                 printf("Valor da expressao: %.2f\n\n", expr.Valor);
                 break;
 
             case 4:
                 printf("Digite a expressao posfixa:\n");
-                fgets(entrada, sizeof(entrada), stdin);
-                entrada[strcspn(entrada, "\n")] = '\0';
+                lerExpressao(&entrada, &capacidade);
+
+                expr.posFixa = entrada;
+                if (avaliarPosFixa(entrada, &expr.Valor, &erro) != CALC_OK) {
+                    mostrarErro(entrada, &erro);
+                    break;
+                }
+                printf("Valor da expressao: %.2f\n\n", expr.Valor);
+                break;
+
+            case 5: {
+                printf("Digite a expressao infixa (ex: x*x + 3*y):\n");
+                lerExpressao(&entrada, &capacidade);
+
+                Programa prog;
+                if (compilarInFixa(entrada, &prog, &erro) != CALC_OK) {
+                    mostrarErro(entrada, &erro);
+                    break;
+                }
+                float *valores = (float*)malloc((prog.numVariaveis > 0 ? prog.numVariaveis : 1) * sizeof(float));
+                if (valores == NULL) {
+                    fprintf(stderr, "Erro de alocação de memória para as variáveis.\n");
+                    liberarPrograma(&prog);
+                    break;
+                }
+                for (int i = 0; i < prog.numVariaveis; i++) {
+                    printf("Valor de %s: ", prog.variaveis[i]);
+                    scanf("%f", &valores[i]);
+                }
+                getchar();
 
-                strcpy(expr.posFixa, entrada);
-                expr.Valor = getValorPosFixa(entrada);
+                expr.inFixa = entrada;
+                int cod = executarPrograma(&prog, valores, &expr.Valor, &erro);
+                liberarPrograma(&prog);
+                free(valores);
+                if (cod != CALC_OK) {
+                    mostrarErro(entrada, &erro);
+                    break;
+                }
                 printf("Valor da expressao: %.2f\n\n", expr.Valor);
                 break;
+            }
 
             case 0:
                 printf("Encerrando o programa...\n");
@@ -76,5 +700,7 @@ int main() {
 
     } while(opcao != 0);
 
+    free(entrada);
+    free(convertida);
     return 0;
 }
@@ -0,0 +1,696 @@
+//servidor.c
+// Servidor local de avaliação de expressões (socket Unix ou TCP em 127.0.0.1) e gerador de carga para ele.
+// Compilar: make servidor (ou gcc -O2 -pthread servidor.c calculadora.c -o servidor -lm; só Linux: usa epoll)
+// Uso: servidor escutar <endereco> [--threads N]
+//      servidor carga <endereco> [--conexoes C] [--pedidos N] [--janela W] [--operacao OP] [--precisao P] [--rapida] [arquivo]
+// <endereco> é o caminho de um socket Unix, ou tcp:PORTA para 127.0.0.1:PORTA.
+//
+// Protocolo (inteiros e double na ordem de bytes da máquina, já que cliente e servidor são locais):
+//   pedido:   uint32 tamanho do texto, uint8 operação, uint8 Precisao, uint8 ModoMatematica, uint8 0, texto
+//   resposta: uint32 tamanho do corpo, uint8 CodigoErro, 3 bytes 0, int32 posição do erro (-1 sem erro), corpo
+// Operações: 0 infixa para pós-fixa, 1 pós-fixa para infixa, 2 valor da infixa, 3 valor da pós-fixa.
+// O corpo é o texto convertido ou o valor em double (8 bytes), e fica vazio quando há erro. Uma conexão pode
+// mandar vários pedidos sem esperar as respostas (pipelining), que voltam na mesma ordem. Um pedido com
+// operação, precisão ou modo inválidos, ou com texto acima de MAX_TEXTO_PEDIDO, encerra a conexão.
+#define _GNU_SOURCE // Para accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "calculadora.h"
+
+#define MAX_TEXTO_PEDIDO (16 << 20)
+#define LEITURA_MINIMA (64 * 1024) // Espaço livre garantido antes de cada leitura de uma conexão
+#define EVENTOS_POR_ESPERA 64
+
+enum { OPERACAO_POSFIXA, OPERACAO_INFIXA, OPERACAO_VALOR_INFIXA, OPERACAO_VALOR_POSFIXA, NUM_OPERACOES };
+
+typedef struct {
+    uint32_t tamanho; // Bytes do texto que segue
+    uint8_t operacao, precisao, matematica, reservado;
+} CabecalhoPedido;
+
+typedef struct {
+    uint32_t tamanho; // Bytes do corpo que segue
+    uint8_t codigo, reservado[3];
+    int32_t posicao;
+} CabecalhoResposta;
+
+// Tempo atual em segundos
+static double agora() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+    char *dados;
+    long tamanho;
+    long capacidade;
+} Buffer;
+
+// Garante espaço para mais n bytes
+static void reservar(Buffer *b, long n) {
+    if (b->tamanho + n <= b->capacidade) return;
+    long capacidade = b->capacidade ? b->capacidade : 4096;
+    while (capacidade < b->tamanho + n) capacidade *= 2;
+    b->dados = (char*)realloc(b->dados, capacidade);
+    if (b->dados == NULL) {
+        fprintf(stderr, "Erro de alocação de memória para os buffers das conexões.\n");
+        exit(EXIT_FAILURE);
+    }
+    b->capacidade = capacidade;
+}
+
+static void anexar(Buffer *b, const void *dados, long n) {
+    reservar(b, n);
+    memcpy(b->dados + b->tamanho, dados, n);
+    b->tamanho += n;
+}
+
+// Atende um pedido com a memória de trabalho de ctx e acrescenta a resposta a saida; retorna o CodigoErro
+static int responder(ContextoCalc *ctx, const CabecalhoPedido *pedido, const char *texto, Buffer *saida) {
+    ErroCalc erro = { CALC_OK, -1 };
+    int len = (int)pedido->tamanho, n = -1, cod = CALC_OK;
+    double valor;
+    // Sem dup, a conversão para infixa acrescenta no máximo "(", ")" e dois espaços por operador
+    long espaco = pedido->operacao <= OPERACAO_INFIXA ? 4L * len + 16 : (long)sizeof(double);
+    reservar(saida, sizeof(CabecalhoResposta) + espaco);
+    char *corpo = saida->dados + saida->tamanho + sizeof(CabecalhoResposta);
+
+    reiniciarContexto(ctx);
+    switch (pedido->operacao) {
+        case OPERACAO_POSFIXA:
+            n = getFormaPosFixaContexto(ctx, texto, len, corpo, (int)espaco, &erro);
+            break;
+        case OPERACAO_INFIXA:
+            n = getFormaInFixaContexto(ctx, texto, len, corpo, (int)espaco, &erro);
+            // Cada dup repete a subexpressão e a infixa pode passar da estimativa: a resposta cresce para o tamanho exato
+            if (n < 0 && erro.codigo == CALC_ERRO_BUFFER_PEQUENO && (espaco = getTamanhoInFixaContexto(ctx, texto, len, &erro) + 1) > 0) {
+                reservar(saida, sizeof(CabecalhoResposta) + espaco);
+                corpo = saida->dados + saida->tamanho + sizeof(CabecalhoResposta);
+                n = getFormaInFixaContexto(ctx, texto, len, corpo, (int)espaco, &erro);
+            }
+            break;
+        case OPERACAO_VALOR_INFIXA:
+            cod = avaliarInFixaPrecisaoContexto(ctx, texto, len, (Precisao)pedido->precisao, (ModoMatematica)pedido->matematica, &valor, &erro);
+            break;
+        case OPERACAO_VALOR_POSFIXA:
+            cod = avaliarPosFixaPrecisaoContexto(ctx, texto, len, (Precisao)pedido->precisao, (ModoMatematica)pedido->matematica, &valor, &erro);
+            break;
+    }
+    if (pedido->operacao <= OPERACAO_INFIXA) {
+        if (n < 0) cod = erro.codigo;
+    } else if (cod == CALC_OK) {
+        memcpy(corpo, &valor, sizeof(double));
+        n = sizeof(double);
+    }
+    if (cod != CALC_OK) n = 0;
+
+    CabecalhoResposta resposta = { (uint32_t)n, (uint8_t)cod, { 0, 0, 0 }, cod == CALC_OK ? -1 : erro.posicao };
+    memcpy(saida->dados + saida->tamanho, &resposta, sizeof(resposta));
+    saida->tamanho += sizeof(resposta) + n;
+    return cod;
+}
+
+// Abre o socket de escuta (não bloqueante) em endereco; *tcp recebe 1 se for TCP. Retorna -1 se falhar.
+static int criarEscuta(const char *endereco, int *tcp) {
+    int fd;
+    *tcp = strncmp(endereco, "tcp:", 4) == 0;
+    if (*tcp) {
+        struct sockaddr_in sa;
+        int sim = 1;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons((uint16_t)atoi(endereco + 4));
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) return -1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &sim, sizeof(sim));
+        if (bind(fd, (struct sockaddr*)&sa, sizeof(sa)) != 0 || listen(fd, SOMAXCONN) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    struct sockaddr_un su;
+    struct stat info;
+    memset(&su, 0, sizeof(su));
+    su.sun_family = AF_UNIX;
+    if (strlen(endereco) >= sizeof(su.sun_path)) return -1;
+    strcpy(su.sun_path, endereco);
+    // Um socket que sobrou de uma execução anterior é removido; qualquer outro arquivo, não
+    if (stat(endereco, &info) == 0 && S_ISSOCK(info.st_mode)) unlink(endereco);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) return -1;
+    if (bind(fd, (struct sockaddr*)&su, sizeof(su)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// ===== Servidor =====
+// Cada trabalhador tem o seu epoll, as suas conexões e o seu ContextoCalc, então uma conexão é sempre
+// atendida pela mesma thread, sem travas. O socket de escuta está em todos os epoll com EPOLLEXCLUSIVE,
+// e cada despertar aceita uma conexão só, o que as espalha entre os trabalhadores. A cada leitura, todos os
+// pedidos completos no buffer da conexão são atendidos em lote e as respostas saem numa única escrita.
+// Se o socket não aceita toda a resposta, a conexão para de ser lida até a saída esvaziar.
+
+typedef struct Conexao {
+    int fd;
+    Buffer entrada; // Bytes recebidos de pedidos ainda incompletos
+    Buffer saida; // Respostas ainda não enviadas
+    long enviados; // Bytes de saida já enviados
+    int esperandoEscrita; // 1 enquanto só EPOLLOUT é observado
+    int fimEntrada; // O cliente fechou o envio: encerrar depois de mandar as respostas
+    struct Conexao *anterior, *proximo; // Conexões abertas do trabalhador
+} Conexao;
+
+typedef struct {
+    int id;
+    int epoll;
+    int escuta, tcp;
+    ContextoCalc *contexto; // Memória de trabalho de todos os pedidos deste trabalhador
+    Conexao *conexoes;
+    long long pedidos, lotes, erros, numConexoes;
+} Trabalhador;
+
+static char marcaEscuta, marcaParada; // data.ptr dos eventos que não são de conexões
+static int eventoParada = -1; // eventfd escrito por SIGINT e SIGTERM
+
+static void pedirParada(int sinal) {
+    uint64_t um = 1;
+    (void)sinal;
+    if (write(eventoParada, &um, sizeof(um)) < 0) { /* Nada a fazer num tratador de sinal */ }
+}
+
+static void observar(Trabalhador *t, Conexao *c, int operacao, uint32_t eventos) {
+    struct epoll_event ev;
+    ev.events = eventos;
+    ev.data.ptr = c;
+    epoll_ctl(t->epoll, operacao, c->fd, &ev);
+}
+
+static void fecharConexao(Trabalhador *t, Conexao *c) {
+    if (c->anterior != NULL) c->anterior->proximo = c->proximo;
+    else t->conexoes = c->proximo;
+    if (c->proximo != NULL) c->proximo->anterior = c->anterior;
+    close(c->fd); // Sai do epoll junto
+    free(c->entrada.dados);
+    free(c->saida.dados);
+    free(c);
+}
+
+static void aceitarConexao(Trabalhador *t) {
+    int fd = accept4(t->escuta, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return; // Outro trabalhador levou a conexão, ou faltam descritores
+    Conexao *c = (Conexao*)calloc(1, sizeof(Conexao));
+    if (c == NULL) {
+        close(fd);
+        return;
+    }
+    if (t->tcp) {
+        int sim = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &sim, sizeof(sim));
+    }
+    c->fd = fd;
+    c->proximo = t->conexoes;
+    if (t->conexoes != NULL) t->conexoes->anterior = c;
+    t->conexoes = c;
+    t->numConexoes++;
+    observar(t, c, EPOLL_CTL_ADD, EPOLLIN);
+}
+
+// Atende todos os pedidos completos do buffer de entrada; retorna -1 se algum viola o protocolo
+static int atenderPedidos(Trabalhador *t, Conexao *c) {
+    long p = 0, atendidos = 0;
+    int violou = 0;
+    while (c->entrada.tamanho - p >= (long)sizeof(CabecalhoPedido)) {
+        CabecalhoPedido pedido;
+        memcpy(&pedido, c->entrada.dados + p, sizeof(pedido));
+        if (pedido.tamanho > MAX_TEXTO_PEDIDO || pedido.operacao >= NUM_OPERACOES ||
+            pedido.precisao > PRECISAO_LONG_DOUBLE || pedido.matematica > MATEMATICA_RAPIDA) {
+            violou = 1;
+            break;
+        }
+        if (c->entrada.tamanho - p - (long)sizeof(pedido) < (long)pedido.tamanho) break;
+        if (responder(t->contexto, &pedido, c->entrada.dados + p + sizeof(pedido), &c->saida) != CALC_OK) t->erros++;
+        p += sizeof(pedido) + pedido.tamanho;
+        atendidos++;
+    }
+    memmove(c->entrada.dados, c->entrada.dados + p, c->entrada.tamanho - p);
+    c->entrada.tamanho -= p;
+    t->pedidos += atendidos;
+    if (atendidos > 0) t->lotes++;
+    return violou ? -1 : 0;
+}
+
+// Envia o que o socket aceitar da saída; retorna -1 se a conexão caiu
+static int enviarSaida(Conexao *c) {
+    while (c->enviados < c->saida.tamanho) {
+        ssize_t n = send(c->fd, c->saida.dados + c->enviados, c->saida.tamanho - c->enviados, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        c->enviados += n;
+    }
+    c->saida.tamanho = 0;
+    c->enviados = 0;
+    return 0;
+}
+
+static void atenderConexao(Trabalhador *t, Conexao *c) {
+    if (c->esperandoEscrita) {
+        if (enviarSaida(c) < 0) {
+            fecharConexao(t, c);
+        } else if (c->saida.tamanho == 0) {
+            if (c->fimEntrada) {
+                fecharConexao(t, c);
+                return;
+            }
+            c->esperandoEscrita = 0;
+            observar(t, c, EPOLL_CTL_MOD, EPOLLIN);
+        }
+        return;
+    }
+
+    reservar(&c->entrada, LEITURA_MINIMA);
+    ssize_t n = recv(c->fd, c->entrada.dados + c->entrada.tamanho, c->entrada.capacidade - c->entrada.tamanho, 0);
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        fecharConexao(t, c);
+        return;
+    }
+    if (n > 0) c->entrada.tamanho += n;
+    if (n == 0) c->fimEntrada = 1;
+    int violou = atenderPedidos(t, c) < 0; // Os pedidos antes da violação ainda recebem resposta, se couber no socket
+    if (enviarSaida(c) < 0 || violou || (c->fimEntrada && c->saida.tamanho == 0)) {
+        fecharConexao(t, c);
+    } else if (c->saida.tamanho > 0) {
+        c->esperandoEscrita = 1;
+        observar(t, c, EPOLL_CTL_MOD, EPOLLOUT);
+    }
+}
+
+static void *executarTrabalhador(void *arg) {
+    Trabalhador *t = (Trabalhador*)arg;
+    struct epoll_event eventos[EVENTOS_POR_ESPERA];
+    for (;;) {
+        int n = epoll_wait(t->epoll, eventos, EVENTOS_POR_ESPERA, -1);
+        if (n < 0 && errno != EINTR) break;
+        for (int i = 0; i < n; i++) {
+            if (eventos[i].data.ptr == &marcaParada) return NULL;
+            if (eventos[i].data.ptr == &marcaEscuta) aceitarConexao(t);
+            else atenderConexao(t, (Conexao*)eventos[i].data.ptr);
+        }
+    }
+    return NULL;
+}
+
+static int executarServidor(const char *endereco, int numThreads) {
+    int tcp, escuta = criarEscuta(endereco, &tcp);
+    if (escuta < 0) {
+        fprintf(stderr, "Erro: nao foi possivel escutar em '%s': %s\n", endereco, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (numThreads <= 0) numThreads = getNumeroNucleos();
+    Trabalhador *trabalhadores = (Trabalhador*)calloc(numThreads, sizeof(Trabalhador));
+    pthread_t *threads = (pthread_t*)malloc(numThreads * sizeof(pthread_t));
+    if (trabalhadores == NULL || threads == NULL || (eventoParada = eventfd(0, EFD_CLOEXEC)) < 0) {
+        fprintf(stderr, "Erro ao preparar os trabalhadores do servidor.\n");
+        return EXIT_FAILURE;
+    }
+
+    struct sigaction acao;
+    memset(&acao, 0, sizeof(acao));
+    acao.sa_handler = pedirParada;
+    sigaction(SIGINT, &acao, NULL);
+    sigaction(SIGTERM, &acao, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int w = 0; w < numThreads; w++) {
+        Trabalhador *t = &trabalhadores[w];
+        struct epoll_event ev;
+        t->id = w;
+        t->escuta = escuta;
+        t->tcp = tcp;
+        t->contexto = criarContexto(0); // Sem memória, os pedidos usam malloc
+        if ((t->epoll = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+            fprintf(stderr, "Erro ao criar o epoll: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = &marcaEscuta;
+        epoll_ctl(t->epoll, EPOLL_CTL_ADD, escuta, &ev);
+        ev.events = EPOLLIN; // Sem EPOLLEXCLUSIVE: a parada acorda todos
+        ev.data.ptr = &marcaParada;
+        epoll_ctl(t->epoll, EPOLL_CTL_ADD, eventoParada, &ev);
+    }
+    fprintf(stderr, "Escutando em %s com %d threads (Ctrl+C encerra)\n", endereco, numThreads);
+
+    // A thread principal trabalha como trabalhador 0
+    for (int w = 1; w < numThreads; w++) {
+        if (pthread_create(&threads[w], NULL, executarTrabalhador, &trabalhadores[w]) != 0) {
+            fprintf(stderr, "Erro ao criar thread.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    executarTrabalhador(&trabalhadores[0]);
+
+    long long pedidos = 0, lotes = 0, erros = 0, numConexoes = 0;
+    for (int w = 0; w < numThreads; w++) {
+        Trabalhador *t = &trabalhadores[w];
+        if (w > 0) pthread_join(threads[w], NULL);
+        while (t->conexoes != NULL) fecharConexao(t, t->conexoes);
+        pedidos += t->pedidos;
+        lotes += t->lotes;
+        erros += t->erros;
+        numConexoes += t->numConexoes;
+        liberarContexto(t->contexto);
+        close(t->epoll);
+    }
+    fprintf(stderr, "%lld pedidos (%lld com erro) em %lld conexoes, %.1f pedidos por lote\n",
+            pedidos, erros, numConexoes, lotes > 0 ? (double)pedidos / lotes : 0.0);
+    close(escuta);
+    close(eventoParada);
+    if (!tcp) unlink(endereco);
+    free(trabalhadores);
+    free(threads);
+    return EXIT_SUCCESS;
+}
+
+// ===== Gerador de carga =====
+// Cada conexão é uma thread que mantém até janela pedidos em andamento: completa a janela, envia tudo
+// numa escrita, lê o que chegou e confere cada resposta, byte a byte, com a que responder calcula
+// localmente para o mesmo pedido. A latência vai do envio do pedido até a sua resposta estar completa.
+
+// Pedido pronto para envio e a resposta esperada
+typedef struct {
+    Buffer pedido;
+    Buffer resposta;
+} Modelo;
+
+typedef struct {
+    int id;
+    const char *endereco;
+    const Modelo *modelos;
+    int numModelos;
+    long pedidos; // Pedidos desta conexão
+    int janela;
+    double *latencias; // Uma por pedido, em segundos
+    long divergencias;
+    int falhou;
+} ClienteCarga;
+
+static int conectar(const char *endereco) {
+    int fd;
+    if (strncmp(endereco, "tcp:", 4) == 0) {
+        struct sockaddr_in sa;
+        int sim = 1;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons((uint16_t)atoi(endereco + 4));
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) return -1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &sim, sizeof(sim));
+        if (connect(fd, (struct sockaddr*)&sa, sizeof(sa)) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    struct sockaddr_un su;
+    memset(&su, 0, sizeof(su));
+    su.sun_family = AF_UNIX;
+    if (strlen(endereco) >= sizeof(su.sun_path)) return -1;
+    strcpy(su.sun_path, endereco);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&su, sizeof(su)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void *executarCliente(void *arg) {
+    ClienteCarga *c = (ClienteCarga*)arg;
+    Buffer saida = { NULL, 0, 0 }, entrada = { NULL, 0, 0 };
+    double *enviadoEm = (double*)malloc(c->janela * sizeof(double)); // Por número do pedido, módulo janela
+    long enviados = 0, recebidos = 0;
+    int fd = conectar(c->endereco);
+    if (fd < 0 || enviadoEm == NULL) {
+        c->falhou = 1;
+        free(enviadoEm);
+        return NULL;
+    }
+
+    while (recebidos < c->pedidos) {
+        saida.tamanho = 0;
+        double inicio = agora();
+        for (; enviados < c->pedidos && enviados - recebidos < c->janela; enviados++) {
+            const Modelo *m = &c->modelos[(c->id + enviados) % c->numModelos];
+            anexar(&saida, m->pedido.dados, m->pedido.tamanho);
+            enviadoEm[enviados % c->janela] = inicio;
+        }
+        for (long p = 0; p < saida.tamanho;) {
+            ssize_t n = send(fd, saida.dados + p, saida.tamanho - p, MSG_NOSIGNAL);
+            if (n <= 0 && errno != EINTR) {
+                c->falhou = 1;
+                goto fim;
+            }
+            if (n > 0) p += n;
+        }
+
+        reservar(&entrada, LEITURA_MINIMA);
+        ssize_t n = recv(fd, entrada.dados + entrada.tamanho, entrada.capacidade - entrada.tamanho, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            c->falhou = 1;
+            goto fim;
+        }
+        entrada.tamanho += n;
+        double chegada = agora();
+        long p = 0;
+        while (entrada.tamanho - p >= (long)sizeof(CabecalhoResposta)) {
+            CabecalhoResposta resposta;
+            memcpy(&resposta, entrada.dados + p, sizeof(resposta));
+            long total = sizeof(resposta) + resposta.tamanho;
+            if (entrada.tamanho - p < total) break;
+            const Modelo *m = &c->modelos[(c->id + recebidos) % c->numModelos];
+            if (total != m->resposta.tamanho || memcmp(entrada.dados + p, m->resposta.dados, total) != 0) c->divergencias++;
+            c->latencias[recebidos] = chegada - enviadoEm[recebidos % c->janela];
+            recebidos++;
+            p += total;
+        }
+        memmove(entrada.dados, entrada.dados + p, entrada.tamanho - p);
+        entrada.tamanho -= p;
+    }
+
+fim:
+    close(fd);
+    free(enviadoEm);
+    free(saida.dados);
+    free(entrada.dados);
+    return NULL;
+}
+
+static int compararDouble(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Expressões usadas sem arquivo: curtas e longas, e duas com erro (de domínio e de sintaxe)
+static const char *const expressoesPadrao[] = {
+    "3 * (12 + 4)",
+    "2 ^ 3 ^ 2 % 7",
+    "raiz(16) + sen(30) * cos(60) - log(100) / 2",
+    "((1.5 + 2,25) * (8 - 4) / 5) ^ 2 % 7 + tg(45) * (8 - (3 + 10) * 11.125)",
+    "(29 - 95.4) % 92.1 * (38 / 3.5 / (75 - 24)) % ((82 * 84 - 88 * 32) * sen(81 - 71)) + log(1.5) * 36",
+    "raiz(2 - 6)",
+    "3 + * 4",
+};
+
+// Monta os modelos: cada expressão com cada operação pedida (todas se operacao < 0). As operações sobre
+// pós-fixa recebem a forma pós-fixa da expressão (ou ela mesma, se não converter).
+static Modelo *criarModelos(char **expressoes, int numExpressoes, int operacao, int precisao, int matematica, int *numModelos) {
+    int numOperacoes = operacao < 0 ? NUM_OPERACOES : 1;
+    Modelo *modelos = (Modelo*)calloc((size_t)numExpressoes * numOperacoes, sizeof(Modelo));
+    char *posFixa = NULL;
+    long capacidade = 0;
+    if (modelos == NULL) exit(EXIT_FAILURE);
+    for (int e = 0; e < numExpressoes; e++) {
+        long len = (long)strlen(expressoes[e]);
+        if (4 * len + 16 > capacidade) {
+            capacidade = 4 * len + 16;
+            if ((posFixa = (char*)realloc(posFixa, capacidade)) == NULL) exit(EXIT_FAILURE);
+        }
+        if (getFormaPosFixaN(expressoes[e], (int)len, posFixa, (int)capacidade, NULL) < 0) strcpy(posFixa, expressoes[e]);
+        for (int k = 0; k < numOperacoes; k++) {
+            Modelo *m = &modelos[e * numOperacoes + k];
+            int op = operacao < 0 ? k : operacao;
+            const char *texto = op == OPERACAO_INFIXA || op == OPERACAO_VALOR_POSFIXA ? posFixa : expressoes[e];
+            CabecalhoPedido pedido = { (uint32_t)strlen(texto), (uint8_t)op, (uint8_t)precisao, (uint8_t)matematica, 0 };
+            anexar(&m->pedido, &pedido, sizeof(pedido));
+            anexar(&m->pedido, texto, pedido.tamanho);
+            responder(NULL, &pedido, texto, &m->resposta);
+        }
+    }
+    free(posFixa);
+    *numModelos = numExpressoes * numOperacoes;
+    return modelos;
+}
+
+static int executarCarga(const char *endereco, int numConexoes, long pedidos, int janela, int operacao,
+                         int precisao, int matematica, const char *nomeArquivo) {
+    char **expressoes = (char**)expressoesPadrao;
+    int numExpressoes = sizeof(expressoesPadrao) / sizeof(expressoesPadrao[0]);
+    if (nomeArquivo != NULL) { // Uma expressão infixa por linha
+        FILE *arquivo = fopen(nomeArquivo, "r");
+        char linha[65536];
+        int capacidade = 0;
+        if (arquivo == NULL) {
+            fprintf(stderr, "Erro: nao foi possivel abrir '%s'.\n", nomeArquivo);
+            return EXIT_FAILURE;
+        }
+        expressoes = NULL;
+        numExpressoes = 0;
+        while (fgets(linha, sizeof(linha), arquivo) != NULL) {
+            linha[strcspn(linha, "\r\n")] = '\0';
+            if (numExpressoes == capacidade) {
+                capacidade = capacidade ? 2 * capacidade : 1024;
+                if ((expressoes = (char**)realloc(expressoes, capacidade * sizeof(char*))) == NULL) exit(EXIT_FAILURE);
+            }
+            if ((expressoes[numExpressoes++] = strdup(linha)) == NULL) exit(EXIT_FAILURE);
+        }
+        fclose(arquivo);
+        if (numExpressoes == 0) {
+            fprintf(stderr, "Erro: '%s' nao tem expressoes.\n", nomeArquivo);
+            return EXIT_FAILURE;
+        }
+    }
+    int numModelos;
+    Modelo *modelos = criarModelos(expressoes, numExpressoes, operacao, precisao, matematica, &numModelos);
+
+    ClienteCarga *clientes = (ClienteCarga*)calloc(numConexoes, sizeof(ClienteCarga));
+    pthread_t *threads = (pthread_t*)malloc(numConexoes * sizeof(pthread_t));
+    double *latencias = (double*)malloc(pedidos * sizeof(double));
+    if (clientes == NULL || threads == NULL || latencias == NULL) exit(EXIT_FAILURE);
+    long inicioLatencias = 0;
+    for (int k = 0; k < numConexoes; k++) {
+        long meus = pedidos / numConexoes + (k < pedidos % numConexoes);
+        clientes[k] = (ClienteCarga){ k, endereco, modelos, numModelos, meus, janela, latencias + inicioLatencias, 0, 0 };
+        inicioLatencias += meus;
+    }
+
+    double inicio = agora();
+    for (int k = 0; k < numConexoes; k++) {
+        if (pthread_create(&threads[k], NULL, executarCliente, &clientes[k]) != 0) {
+            fprintf(stderr, "Erro ao criar thread.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    long divergencias = 0;
+    int falhas = 0;
+    for (int k = 0; k < numConexoes; k++) {
+        pthread_join(threads[k], NULL);
+        divergencias += clientes[k].divergencias;
+        falhas += clientes[k].falhou;
+    }
+    double tempo = agora() - inicio;
+    if (falhas > 0) {
+        fprintf(stderr, "Erro: %d de %d conexoes com '%s' falharam.\n", falhas, numConexoes, endereco);
+        return EXIT_FAILURE;
+    }
+
+    qsort(latencias, pedidos, sizeof(double), compararDouble);
+    printf("%ld pedidos em %d conexoes (janela %d), %d modelos: %.3f s\n", pedidos, numConexoes, janela, numModelos, tempo);
+    printf("vazao: %.0f pedidos/s\n", pedidos / tempo);
+    printf("latencia (us): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           latencias[pedidos / 2] * 1e6, latencias[pedidos * 9 / 10] * 1e6, latencias[pedidos * 99 / 100] * 1e6,
+           latencias[pedidos * 999 / 1000] * 1e6, latencias[pedidos - 1] * 1e6);
+    printf("respostas diferentes da esperada: %ld\n", divergencias);
+
+    for (int m = 0; m < numModelos; m++) {
+        free(modelos[m].pedido.dados);
+        free(modelos[m].resposta.dados);
+    }
+    if (nomeArquivo != NULL) {
+        for (int e = 0; e < numExpressoes; e++) free(expressoes[e]);
+        free(expressoes);
+    }
+    free(modelos);
+    free(clientes);
+    free(threads);
+    free(latencias);
+    return divergencias > 0 ? 2 : EXIT_SUCCESS;
+}
+
+static void mostrarUso(const char *programa) {
+    fprintf(stderr, "Uso: %s escutar <endereco> [--threads N]\n", programa);
+    fprintf(stderr, "     %s carga <endereco> [--conexoes C] [--pedidos N] [--janela W] [--operacao OP] [--precisao P] [--rapida] [arquivo]\n", programa);
+    fprintf(stderr, "<endereco>: caminho de um socket Unix, ou tcp:PORTA (127.0.0.1)\n");
+    fprintf(stderr, "OP: posfixa, infixa, valor-infixa, valor-posfixa ou todas (padrao); P: float (padrao), double ou long\n");
+    fprintf(stderr, "arquivo: expressoes infixas, uma por linha (padrao: algumas embutidas)\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || (strcmp(argv[1], "escutar") != 0 && strcmp(argv[1], "carga") != 0)) {
+        mostrarUso(argv[0]);
+        return EXIT_FAILURE;
+    }
+    int numThreads = 0, numConexoes = 4, janela = 32, operacao = -1, precisao = PRECISAO_FLOAT, matematica = MATEMATICA_EXATA;
+    long pedidos = 1000000;
+    const char *nomeArquivo = NULL;
+    static const char *const nomesOperacoes[] = { "posfixa", "infixa", "valor-infixa", "valor-posfixa" };
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) numThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--conexoes") == 0 && i + 1 < argc) numConexoes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pedidos") == 0 && i + 1 < argc) pedidos = atol(argv[++i]);
+        else if (strcmp(argv[i], "--janela") == 0 && i + 1 < argc) janela = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rapida") == 0) matematica = MATEMATICA_RAPIDA;
+        else if (strcmp(argv[i], "--operacao") == 0 && i + 1 < argc) {
+            i++;
+            operacao = -2;
+            for (int k = 0; k < NUM_OPERACOES; k++) {
+                if (strcmp(argv[i], nomesOperacoes[k]) == 0) operacao = k;
+            }
+            if (strcmp(argv[i], "todas") == 0) operacao = -1;
+            if (operacao == -2) {
+                mostrarUso(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--precisao") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "float") == 0) precisao = PRECISAO_FLOAT;
+            else if (strcmp(argv[i], "double") == 0) precisao = PRECISAO_DOUBLE;
+            else if (strcmp(argv[i], "long") == 0) precisao = PRECISAO_LONG_DOUBLE;
+            else {
+                mostrarUso(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (argv[i][0] != '-' && nomeArquivo == NULL) nomeArquivo = argv[i];
+        else {
+            mostrarUso(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (strcmp(argv[1], "escutar") == 0) return executarServidor(argv[2], numThreads);
+    if (numConexoes < 1 || janela < 1 || pedidos < 1) {
+        mostrarUso(argv[0]);
+        return EXIT_FAILURE;
+    }
+    return executarCarga(argv[2], numConexoes, pedidos, janela, operacao, precisao, matematica, nomeArquivo);
+}